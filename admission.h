@@ -0,0 +1,261 @@
+#ifndef MYSH_ADMISSION_H
+#define MYSH_ADMISSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "shell_resource.h"
+#include "job.h"
+#include "event.h"
+#include "lineedit.h"
+
+// admission control for `&` jobs. a background job is queued instead of started while
+// too many are running, the load average is too high or memory is under pressure.
+// queued jobs are started in order by a timer polled from the event loop, by `wait` and
+// before each command line
+static struct {
+    // 0 turns a limit off
+    int max_running;
+    double max_load;
+    // percent of time some task stalled on memory over the last 10s, from PSI
+    double max_memory_pressure;
+    int timer_fd;
+} mysh_sched_policy = { 0, 0.0, 0.0, -1 };
+
+// the 1 minute load average, or -1 if unknown
+static double mysh_read_loadavg() {
+    char buf[128];
+    int fd = open("/proc/loadavg", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1.0;
+    }
+
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1.0;
+    }
+    buf[n] = '\0';
+
+    return strtod(buf, NULL);
+}
+
+// `some avg10` of /proc/pressure/memory, or -1 if the kernel has no PSI
+static double mysh_read_memory_pressure() {
+    char buf[256];
+    int fd = open("/proc/pressure/memory", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1.0;
+    }
+
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return -1.0;
+    }
+    buf[n] = '\0';
+
+    char* avg = strstr(buf, "some avg10=");
+    return (avg != NULL ? strtod(avg + 11, NULL) : -1.0);
+}
+
+static int mysh_count_running_jobs(mysh_resource* shell) {
+    int n = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        n += (!job->is_queued && !job->is_foreground && !mysh_is_job_completed(job) && !mysh_is_job_stopped(job));
+    }
+
+    return n;
+}
+
+static bool mysh_is_sched_enabled() {
+    return mysh_sched_policy.max_running > 0 || mysh_sched_policy.max_load > 0.0 || mysh_sched_policy.max_memory_pressure > 0.0;
+}
+
+// whether one more background job may start now
+static bool mysh_can_admit(mysh_resource* shell) {
+    if (mysh_sched_policy.max_running > 0 && mysh_count_running_jobs(shell) >= mysh_sched_policy.max_running) {
+        return false;
+    }
+    if (mysh_sched_policy.max_load > 0.0 && mysh_read_loadavg() >= mysh_sched_policy.max_load) {
+        return false;
+    }
+    if (mysh_sched_policy.max_memory_pressure > 0.0 && mysh_read_memory_pressure() >= mysh_sched_policy.max_memory_pressure) {
+        return false;
+    }
+
+    return true;
+}
+
+static bool mysh_has_queued_jobs(mysh_resource* shell) {
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        if (job->is_queued) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void mysh_sched_tick(mysh_resource* shell, int fd, void* ctx) {
+    uint64_t expirations;
+    ssize_t n = read(fd, &expirations, sizeof(expirations));
+    (void)n;
+
+    mysh_admit_jobs(shell);
+    mysh_request_repaint();
+}
+
+// the timer only runs while something is queued
+static void mysh_arm_sched_timer(bool is_armed) {
+    if (mysh_sched_policy.timer_fd < 0) {
+        if (!is_armed) {
+            return;
+        }
+
+        mysh_sched_policy.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+        if (mysh_sched_policy.timer_fd < 0) {
+            return;
+        }
+        mysh_watch_fd(mysh_sched_policy.timer_fd, POLLIN, mysh_sched_tick, NULL);
+    }
+
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (is_armed) {
+        spec.it_interval.tv_nsec = MYSH_SCHED_INTERVAL * 1000000L;
+        spec.it_value = spec.it_interval;
+    }
+    timerfd_settime(mysh_sched_policy.timer_fd, 0, &spec, NULL);
+}
+
+// adds the scheduler timer to `fds` for mysh_wait_any() while jobs are queued. returns how many
+int mysh_sched_fds(mysh_resource* shell, struct pollfd* fds) {
+    if (mysh_sched_policy.timer_fd < 0 || !mysh_has_queued_jobs(shell)) {
+        return 0;
+    }
+
+    fds[0].fd = mysh_sched_policy.timer_fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    return 1;
+}
+
+// ticks the scheduler if poll() found its timer ready. returns whether it ticked
+bool mysh_service_sched(mysh_resource* shell, struct pollfd* fds, int n) {
+    if (n == 0 || fds[0].revents == 0) {
+        return false;
+    }
+
+    mysh_sched_tick(shell, fds[0].fd, NULL);
+    return true;
+}
+
+bool mysh_should_queue(mysh_resource* shell) {
+    if (!mysh_is_sched_enabled()) {
+        return false;
+    }
+
+    // older jobs go first
+    mysh_update_status(shell->first_job);
+    if (!mysh_has_queued_jobs(shell) && mysh_can_admit(shell)) {
+        return false;
+    }
+
+    mysh_arm_sched_timer(true);
+    return true;
+}
+
+void mysh_admit_jobs(mysh_resource* shell) {
+    if (!mysh_has_queued_jobs(shell)) {
+        mysh_arm_sched_timer(false);
+        return;
+    }
+
+    mysh_update_status(shell->first_job);
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        if (!job->is_queued) {
+            continue;
+        }
+        if (mysh_is_sched_enabled() && !mysh_can_admit(shell)) {
+            break;
+        }
+
+        mysh_start_queued_job(shell, job, false);
+    }
+
+    mysh_arm_sched_timer(mysh_has_queued_jobs(shell));
+}
+
+// sched [-j N] [-l LOAD] [-m PERCENT] | sched off
+int mysh_sched(mysh_resource* shell, char** argv) {
+    if (argv[1] != NULL && strcmp(argv[1], "off") == 0) {
+        mysh_sched_policy.max_running = 0;
+        mysh_sched_policy.max_load = 0.0;
+        mysh_sched_policy.max_memory_pressure = 0.0;
+        mysh_admit_jobs(shell);
+        return 0;
+    }
+
+    for (int i = 1; argv[i] != NULL; i += 2) {
+        if (argv[i + 1] == NULL) {
+            fprintf(stderr, "usage: sched [-j N] [-l LOAD] [-m PERCENT] | sched off\n");
+            return 2;
+        }
+
+        char* end;
+        double value = strtod(argv[i + 1], &end);
+        if (*end != '\0' || value < 0.0) {
+            fprintf(stderr, "mysh: sched: `%s': not a non-negative number\n", argv[i + 1]);
+            return 2;
+        }
+
+        if (strcmp(argv[i], "-j") == 0) {
+            mysh_sched_policy.max_running = (int)value;
+        }
+        else if (strcmp(argv[i], "-l") == 0) {
+            mysh_sched_policy.max_load = value;
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            mysh_sched_policy.max_memory_pressure = value;
+        }
+        else {
+            fprintf(stderr, "mysh: sched: unknown option `%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (argv[1] != NULL) {
+        // a looser policy may let queued jobs start
+        mysh_admit_jobs(shell);
+        return 0;
+    }
+
+    int num_queued = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        num_queued += job->is_queued;
+    }
+
+    double load = mysh_read_loadavg();
+    double pressure = mysh_read_memory_pressure();
+    printf("running jobs: %d (limit %d)\n", mysh_count_running_jobs(shell), mysh_sched_policy.max_running);
+    printf("load average: %.2f (limit %.2f)\n", load, mysh_sched_policy.max_load);
+    if (pressure >= 0.0) {
+        printf("memory pressure: %.2f%% (limit %.2f%%)\n", pressure, mysh_sched_policy.max_memory_pressure);
+    }
+    else {
+        printf("memory pressure: unavailable (limit %.2f%%)\n", mysh_sched_policy.max_memory_pressure);
+    }
+    printf("queued jobs: %d\n", num_queued);
+
+    return 0;
+}
+
+#endif // MYSH_ADMISSION_H
@@ -0,0 +1,735 @@
+#ifndef MYSH_ARITH_H
+#define MYSH_ARITH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "mystring.h"
+#include "variable.h"
+#include "shell_resource.h"
+
+// `$(( ))` and `let` evaluate 64-bit integer expressions with the operators of C.
+// an expression is compiled to postfix code once and kept by its source text, so running
+// a function or a script again only evaluates it. `&&`, `||` and `?:` become jumps.
+// a name is a shell variable whose value is read as a number, unset or empty is 0
+
+// defined in expand.h
+static void mysh_expand_var(mysh_resource* shell, const char* name, mysh_string* out);
+
+typedef enum {
+    arith_push,
+    arith_load,
+    // `$name`, expanded like in a word
+    arith_expand,
+    arith_store,
+    // `name op= value`, `arg` is the variable and `op` the binary operator in `value`
+    arith_update,
+    arith_pre_inc,
+    arith_pre_dec,
+    arith_post_inc,
+    arith_post_dec,
+    arith_neg,
+    arith_not,
+    arith_compl,
+    arith_mul,
+    arith_div,
+    arith_mod,
+    arith_add,
+    arith_sub,
+    arith_shl,
+    arith_shr,
+    arith_lt,
+    arith_le,
+    arith_gt,
+    arith_ge,
+    arith_eq,
+    arith_ne,
+    arith_and,
+    arith_xor,
+    arith_or,
+    // makes the top 0 or 1
+    arith_bool,
+    arith_pop,
+    // pops and jumps to `arg` if it is zero or non-zero
+    arith_jz,
+    arith_jnz,
+    arith_jmp
+} mysh_arith_op;
+
+typedef struct {
+    unsigned char op;
+    // the operator of arith_update
+    unsigned char sub_op;
+    // a constant, an index into `names` or a jump target
+    int64_t arg;
+} mysh_arith_insn;
+
+typedef struct mysh_arith_tag {
+    struct mysh_arith_tag* next;
+    char* source;
+    mysh_arith_insn* code;
+    int size;
+    char** names;
+    int num_names;
+} mysh_arith;
+
+typedef struct {
+    const char* p;
+    mysh_arith* prog;
+    int capacity;
+    const char* error;
+} mysh_arith_parser;
+
+#define MYSH_ARITH_BUCKETS (256)
+// compiled expressions kept at most. the cache is emptied when it is full
+#define MYSH_ARITH_MAX_CACHED (1024)
+
+static struct {
+    mysh_arith* buckets[MYSH_ARITH_BUCKETS];
+    int size;
+} mysh_arith_cache;
+
+static int mysh_arith_emit(mysh_arith_parser* ps, mysh_arith_op op, int64_t arg) {
+    mysh_arith* prog = ps->prog;
+    if (prog->size == ps->capacity) {
+        ps->capacity = (ps->capacity == 0 ? 16 : ps->capacity * 2);
+        prog->code = (mysh_arith_insn*)realloc(prog->code, sizeof(mysh_arith_insn) * ps->capacity);
+        if (prog->code == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    prog->code[prog->size].op = op;
+    prog->code[prog->size].sub_op = 0;
+    prog->code[prog->size].arg = arg;
+
+    return prog->size++;
+}
+
+static int mysh_arith_name(mysh_arith_parser* ps, const char* name, size_t len) {
+    mysh_arith* prog = ps->prog;
+    for (int i = 0; i < prog->num_names; ++i) {
+        if (strncmp(prog->names[i], name, len) == 0 && prog->names[i][len] == '\0') {
+            return i;
+        }
+    }
+
+    prog->names = (char**)realloc(prog->names, sizeof(char*) * (prog->num_names + 1));
+    char* copy = strndup(name, len);
+    if (prog->names == NULL || copy == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    prog->names[prog->num_names] = copy;
+    return prog->num_names++;
+}
+
+static void mysh_arith_skip_spaces(mysh_arith_parser* ps) {
+    while (isspace((unsigned char)*ps->p)) {
+        ++ps->p;
+    }
+}
+
+// consumes `op` if it is next and not the start of a longer operator in `longer`
+static bool mysh_arith_accept(mysh_arith_parser* ps, const char* op, const char* longer) {
+    mysh_arith_skip_spaces(ps);
+
+    size_t len = strlen(op);
+    if (strncmp(ps->p, op, len) != 0) {
+        return false;
+    }
+    if (longer != NULL && strchr(longer, ps->p[len]) != NULL && ps->p[len] != '\0') {
+        return false;
+    }
+
+    ps->p += len;
+    return true;
+}
+
+static bool mysh_arith_is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_';
+}
+
+static bool mysh_arith_is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+static bool mysh_arith_comma(mysh_arith_parser* ps);
+
+static bool mysh_arith_assign(mysh_arith_parser* ps);
+
+static bool mysh_arith_primary(mysh_arith_parser* ps) {
+    mysh_arith_skip_spaces(ps);
+    const char* p = ps->p;
+
+    if (isdigit((unsigned char)*p)) {
+        char* end;
+        unsigned long long n = strtoull(p, &end, 0);
+        if (mysh_arith_is_name_char(*end)) {
+            ps->error = p;
+            return false;
+        }
+
+        ps->p = end;
+        mysh_arith_emit(ps, arith_push, (int64_t)n);
+        return true;
+    }
+
+    if (*p == '$') {
+        const char* name = ++p;
+        size_t len;
+        if (*p == '{') {
+            const char* close = strchr(++name, '}');
+            if (close == NULL) {
+                ps->error = p;
+                return false;
+            }
+            len = close - name;
+            p = close + 1;
+        }
+        else if (mysh_arith_is_name_start(*p)) {
+            while (mysh_arith_is_name_char(*p)) {
+                ++p;
+            }
+            len = p - name;
+        }
+        else if (isdigit((unsigned char)*p) || *p == '#' || *p == '?' || *p == '$') {
+            len = 1;
+            ++p;
+        }
+        else {
+            ps->error = p;
+            return false;
+        }
+
+        ps->p = p;
+        mysh_arith_emit(ps, arith_expand, mysh_arith_name(ps, name, len));
+        return true;
+    }
+
+    if (mysh_arith_is_name_start(*p)) {
+        const char* name = p;
+        while (mysh_arith_is_name_char(*p)) {
+            ++p;
+        }
+        ps->p = p;
+
+        int index = mysh_arith_name(ps, name, p - name);
+        if (mysh_arith_accept(ps, "++", NULL)) {
+            mysh_arith_emit(ps, arith_post_inc, index);
+        }
+        else if (mysh_arith_accept(ps, "--", NULL)) {
+            mysh_arith_emit(ps, arith_post_dec, index);
+        }
+        else {
+            mysh_arith_emit(ps, arith_load, index);
+        }
+        return true;
+    }
+
+    if (*p == '(') {
+        ps->p = p + 1;
+        if (!mysh_arith_comma(ps)) {
+            return false;
+        }
+        if (!mysh_arith_accept(ps, ")", NULL)) {
+            ps->error = ps->p;
+            return false;
+        }
+        return true;
+    }
+
+    ps->error = p;
+    return false;
+}
+
+static bool mysh_arith_unary(mysh_arith_parser* ps) {
+    mysh_arith_skip_spaces(ps);
+
+    bool is_inc = mysh_arith_accept(ps, "++", NULL);
+    if (is_inc || mysh_arith_accept(ps, "--", NULL)) {
+        mysh_arith_skip_spaces(ps);
+        const char* name = ps->p;
+        while (mysh_arith_is_name_char(*ps->p)) {
+            ++ps->p;
+        }
+        if (ps->p == name || !mysh_arith_is_name_start(*name)) {
+            ps->error = name;
+            return false;
+        }
+
+        mysh_arith_emit(ps, (is_inc ? arith_pre_inc : arith_pre_dec), mysh_arith_name(ps, name, ps->p - name));
+        return true;
+    }
+
+    mysh_arith_op op;
+    if (mysh_arith_accept(ps, "-", NULL)) {
+        op = arith_neg;
+    }
+    else if (mysh_arith_accept(ps, "+", NULL)) {
+        return mysh_arith_unary(ps);
+    }
+    else if (mysh_arith_accept(ps, "!", NULL)) {
+        op = arith_not;
+    }
+    else if (mysh_arith_accept(ps, "~", NULL)) {
+        op = arith_compl;
+    }
+    else {
+        return mysh_arith_primary(ps);
+    }
+
+    if (!mysh_arith_unary(ps)) {
+        return false;
+    }
+    mysh_arith_emit(ps, op, 0);
+    return true;
+}
+
+// binary operators from the tightest; `longer` keeps e.g. `<` from matching `<<` or `<=`
+static const struct {
+    const char* token;
+    const char* longer;
+    mysh_arith_op op;
+    int level;
+} mysh_arith_binary_ops[] = {
+    { "*", "=", arith_mul, 0 },
+    { "/", "=", arith_div, 0 },
+    { "%", "=", arith_mod, 0 },
+    { "+", "=+", arith_add, 1 },
+    { "-", "=-", arith_sub, 1 },
+    { "<<", "=", arith_shl, 2 },
+    { ">>", "=", arith_shr, 2 },
+    { "<=", NULL, arith_le, 3 },
+    { ">=", NULL, arith_ge, 3 },
+    { "<", "<=", arith_lt, 3 },
+    { ">", ">=", arith_gt, 3 },
+    { "==", NULL, arith_eq, 4 },
+    { "!=", NULL, arith_ne, 4 },
+    { "&", "&=", arith_and, 5 },
+    { "^", "=", arith_xor, 6 },
+    { "|", "|=", arith_or, 7 }
+};
+
+#define MYSH_ARITH_LEVELS (8)
+
+static bool mysh_arith_binary(mysh_arith_parser* ps, int level) {
+    if (!(level == 0 ? mysh_arith_unary(ps) : mysh_arith_binary(ps, level - 1))) {
+        return false;
+    }
+
+    for (;;) {
+        mysh_arith_op op = arith_push;
+        for (size_t i = 0; i < sizeof(mysh_arith_binary_ops) / sizeof(mysh_arith_binary_ops[0]); ++i) {
+            if (mysh_arith_binary_ops[i].level == level
+                && mysh_arith_accept(ps, mysh_arith_binary_ops[i].token, mysh_arith_binary_ops[i].longer)) {
+                op = mysh_arith_binary_ops[i].op;
+                break;
+            }
+        }
+        if (op == arith_push) {
+            return true;
+        }
+
+        if (!(level == 0 ? mysh_arith_unary(ps) : mysh_arith_binary(ps, level - 1))) {
+            return false;
+        }
+        mysh_arith_emit(ps, op, 0);
+    }
+}
+
+// `a && b` is a; jz F; b; bool; jmp E; F: push 0; E:
+static bool mysh_arith_logical(mysh_arith_parser* ps, bool is_or) {
+    if (!(is_or ? mysh_arith_logical(ps, false) : mysh_arith_binary(ps, MYSH_ARITH_LEVELS - 1))) {
+        return false;
+    }
+
+    while (mysh_arith_accept(ps, (is_or ? "||" : "&&"), NULL)) {
+        int skip = mysh_arith_emit(ps, (is_or ? arith_jnz : arith_jz), 0);
+        if (!(is_or ? mysh_arith_logical(ps, false) : mysh_arith_binary(ps, MYSH_ARITH_LEVELS - 1))) {
+            return false;
+        }
+        mysh_arith_emit(ps, arith_bool, 0);
+        int end = mysh_arith_emit(ps, arith_jmp, 0);
+        ps->prog->code[skip].arg = mysh_arith_emit(ps, arith_push, is_or);
+        ps->prog->code[end].arg = ps->prog->size;
+    }
+
+    return true;
+}
+
+static bool mysh_arith_conditional(mysh_arith_parser* ps) {
+    if (!mysh_arith_logical(ps, true)) {
+        return false;
+    }
+    if (!mysh_arith_accept(ps, "?", NULL)) {
+        return true;
+    }
+
+    int to_else = mysh_arith_emit(ps, arith_jz, 0);
+    if (!mysh_arith_comma(ps)) {
+        return false;
+    }
+    if (!mysh_arith_accept(ps, ":", NULL)) {
+        ps->error = ps->p;
+        return false;
+    }
+
+    int to_end = mysh_arith_emit(ps, arith_jmp, 0);
+    ps->prog->code[to_else].arg = ps->prog->size;
+    if (!mysh_arith_assign(ps)) {
+        return false;
+    }
+    ps->prog->code[to_end].arg = ps->prog->size;
+
+    return true;
+}
+
+static const struct {
+    const char* token;
+    mysh_arith_op op;
+} mysh_arith_assign_ops[] = {
+    { "*=", arith_mul },
+    { "/=", arith_div },
+    { "%=", arith_mod },
+    { "+=", arith_add },
+    { "-=", arith_sub },
+    { "<<=", arith_shl },
+    { ">>=", arith_shr },
+    { "&=", arith_and },
+    { "^=", arith_xor },
+    { "|=", arith_or },
+    { "=", arith_store }
+};
+
+static bool mysh_arith_assign(mysh_arith_parser* ps) {
+    mysh_arith_skip_spaces(ps);
+
+    const char* start = ps->p;
+    const char* p = start;
+    if (mysh_arith_is_name_start(*p)) {
+        while (mysh_arith_is_name_char(*p)) {
+            ++p;
+        }
+        const char* name_end = p;
+        while (isspace((unsigned char)*p)) {
+            ++p;
+        }
+
+        for (size_t i = 0; i < sizeof(mysh_arith_assign_ops) / sizeof(mysh_arith_assign_ops[0]); ++i) {
+            size_t len = strlen(mysh_arith_assign_ops[i].token);
+            if (strncmp(p, mysh_arith_assign_ops[i].token, len) != 0 || (len == 1 && p[1] == '=')) {
+                continue;
+            }
+
+            int index = mysh_arith_name(ps, start, name_end - start);
+            ps->p = p + len;
+            if (!mysh_arith_assign(ps)) {
+                return false;
+            }
+
+            mysh_arith_op op = mysh_arith_assign_ops[i].op;
+            int at = mysh_arith_emit(ps, (op == arith_store ? arith_store : arith_update), index);
+            ps->prog->code[at].sub_op = op;
+            return true;
+        }
+    }
+
+    return mysh_arith_conditional(ps);
+}
+
+static bool mysh_arith_comma(mysh_arith_parser* ps) {
+    if (!mysh_arith_assign(ps)) {
+        return false;
+    }
+
+    while (mysh_arith_accept(ps, ",", NULL)) {
+        mysh_arith_emit(ps, arith_pop, 0);
+        if (!mysh_arith_assign(ps)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void mysh_free_arith(mysh_arith* prog) {
+    for (int i = 0; i < prog->num_names; ++i) {
+        free(prog->names[i]);
+    }
+    free(prog->names);
+    free(prog->code);
+    free(prog->source);
+    free(prog);
+}
+
+static void mysh_clear_arith_cache() {
+    for (int i = 0; i < MYSH_ARITH_BUCKETS; ++i) {
+        while (mysh_arith_cache.buckets[i] != NULL) {
+            mysh_arith* prog = mysh_arith_cache.buckets[i];
+            mysh_arith_cache.buckets[i] = prog->next;
+            mysh_free_arith(prog);
+        }
+    }
+    mysh_arith_cache.size = 0;
+}
+
+// returns the compiled `source`, or NULL after reporting a syntax error
+static mysh_arith* mysh_compile_arith(const char* source) {
+    mysh_arith** bucket = &mysh_arith_cache.buckets[mysh_hash_name(source) % MYSH_ARITH_BUCKETS];
+    for (mysh_arith* prog = *bucket; prog != NULL; prog = prog->next) {
+        if (strcmp(prog->source, source) == 0) {
+            return prog;
+        }
+    }
+
+    mysh_arith* prog = (mysh_arith*)calloc(1, sizeof(mysh_arith));
+    if (prog == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mysh_arith_parser ps = { source, prog, 0, NULL };
+    mysh_arith_skip_spaces(&ps);
+    bool ok = true;
+    if (*ps.p == '\0') {
+        mysh_arith_emit(&ps, arith_push, 0);
+    }
+    else {
+        ok = mysh_arith_comma(&ps);
+    }
+    mysh_arith_skip_spaces(&ps);
+    if (ok && *ps.p != '\0') {
+        ok = false;
+        ps.error = ps.p;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "mysh: %s: syntax error near `%s'\n", source, (*ps.error != '\0' ? ps.error : "end"));
+        mysh_free_arith(prog);
+        return NULL;
+    }
+
+    prog->source = strdup(source);
+    if (prog->source == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mysh_arith_cache.size >= MYSH_ARITH_MAX_CACHED) {
+        mysh_clear_arith_cache();
+    }
+    prog->next = *bucket;
+    *bucket = prog;
+    ++mysh_arith_cache.size;
+
+    return prog;
+}
+
+static bool mysh_arith_number(const char* name, const char* value, int64_t* out) {
+    while (value != NULL && isspace((unsigned char)*value)) {
+        ++value;
+    }
+    if (value == NULL || *value == '\0') {
+        *out = 0;
+        return true;
+    }
+
+    char* end;
+    long long n = strtoll(value, &end, 0);
+    while (isspace((unsigned char)*end)) {
+        ++end;
+    }
+    if (*end != '\0') {
+        fprintf(stderr, "mysh: %s: %s: not a number\n", name, value);
+        return false;
+    }
+
+    *out = (int64_t)n;
+    return true;
+}
+
+// wraps around like unsigned arithmetic instead of overflowing
+static bool mysh_arith_apply(mysh_arith_op op, int64_t a, int64_t b, int64_t* out) {
+    uint64_t ua = (uint64_t)a;
+    uint64_t ub = (uint64_t)b;
+
+    switch (op) {
+    case arith_mul: *out = (int64_t)(ua * ub); break;
+    case arith_add: *out = (int64_t)(ua + ub); break;
+    case arith_sub: *out = (int64_t)(ua - ub); break;
+    case arith_div:
+    case arith_mod:
+        if (b == 0) {
+            fprintf(stderr, "mysh: division by 0\n");
+            return false;
+        }
+        if (b == -1) {
+            *out = (op == arith_div ? (int64_t)(0 - ua) : 0);
+        }
+        else {
+            *out = (op == arith_div ? a / b : a % b);
+        }
+        break;
+    case arith_shl: *out = (int64_t)(ua << (ub & 63)); break;
+    case arith_shr: *out = a >> (ub & 63); break;
+    case arith_lt: *out = a < b; break;
+    case arith_le: *out = a <= b; break;
+    case arith_gt: *out = a > b; break;
+    case arith_ge: *out = a >= b; break;
+    case arith_eq: *out = a == b; break;
+    case arith_ne: *out = a != b; break;
+    case arith_and: *out = a & b; break;
+    case arith_xor: *out = a ^ b; break;
+    case arith_or: *out = a | b; break;
+    default: *out = b; break;
+    }
+
+    return true;
+}
+
+static bool mysh_arith_get(mysh_resource* shell, const char* name, int64_t* out) {
+    return mysh_arith_number(name, mysh_lookup_var(shell->scope, name), out);
+}
+
+static void mysh_arith_set(mysh_resource* shell, const char* name, int64_t value) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    mysh_set_var(shell->scope, name, buf);
+}
+
+// every instruction pushes at most one value, so the code size bounds the stack
+static bool mysh_run_arith(mysh_resource* shell, const mysh_arith* prog, int64_t* result) {
+    int64_t small[64];
+    int64_t* stack = (prog->size < 64 ? small : (int64_t*)malloc(sizeof(int64_t) * (prog->size + 1)));
+    if (stack == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mysh_string text = { NULL, 0, 0, { 0 } };
+    bool ok = true;
+    int top = 0;
+    for (int pc = 0; ok && pc < prog->size; ++pc) {
+        const mysh_arith_insn* in = &prog->code[pc];
+        const char* name = (in->op >= arith_load && in->op <= arith_post_dec ? prog->names[in->arg] : NULL);
+        int64_t v = 0;
+
+        switch (in->op) {
+        case arith_push:
+            stack[top++] = in->arg;
+            break;
+        case arith_load:
+            ok = mysh_arith_get(shell, name, &v);
+            stack[top++] = v;
+            break;
+        case arith_expand:
+            ms_assign_raw(&text, "");
+            mysh_expand_var(shell, name, &text);
+            ok = mysh_arith_number(name, text.ptr, &v);
+            stack[top++] = v;
+            break;
+        case arith_store:
+            mysh_arith_set(shell, name, stack[top - 1]);
+            break;
+        case arith_update:
+            ok = mysh_arith_get(shell, name, &v) && mysh_arith_apply(in->sub_op, v, stack[top - 1], &v);
+            if (ok) {
+                stack[top - 1] = v;
+                mysh_arith_set(shell, name, v);
+            }
+            break;
+        case arith_pre_inc:
+        case arith_pre_dec:
+        case arith_post_inc:
+        case arith_post_dec: {
+            ok = mysh_arith_get(shell, name, &v);
+            int64_t next = (int64_t)((uint64_t)v + (in->op == arith_pre_inc || in->op == arith_post_inc ? 1 : -1));
+            mysh_arith_set(shell, name, next);
+            stack[top++] = (in->op == arith_pre_inc || in->op == arith_pre_dec ? next : v);
+            break;
+        }
+        case arith_neg:
+            stack[top - 1] = (int64_t)(0 - (uint64_t)stack[top - 1]);
+            break;
+        case arith_not:
+            stack[top - 1] = !stack[top - 1];
+            break;
+        case arith_compl:
+            stack[top - 1] = ~stack[top - 1];
+            break;
+        case arith_bool:
+            stack[top - 1] = (stack[top - 1] != 0);
+            break;
+        case arith_pop:
+            --top;
+            break;
+        case arith_jz:
+        case arith_jnz:
+            v = stack[--top];
+            if ((v == 0) == (in->op == arith_jz)) {
+                pc = (int)in->arg - 1;
+            }
+            break;
+        case arith_jmp:
+            pc = (int)in->arg - 1;
+            break;
+        default:
+            --top;
+            ok = mysh_arith_apply(in->op, stack[top - 1], stack[top], &stack[top - 1]);
+            break;
+        }
+    }
+
+    *result = (top > 0 ? stack[top - 1] : 0);
+    if (stack != small) {
+        free(stack);
+    }
+    ms_relase(&text);
+
+    return ok;
+}
+
+// evaluates `source`. returns false after reporting an error
+static bool mysh_eval_arith(mysh_resource* shell, const char* source, int64_t* result) {
+    mysh_arith* prog = mysh_compile_arith(source);
+    return prog != NULL && mysh_run_arith(shell, prog, result);
+}
+
+// `$(( source ))`. returns false after reporting an error, which aborts the command
+static bool mysh_arith_subst(mysh_resource* shell, const char* source, mysh_string* out) {
+    int64_t value;
+    if (!mysh_eval_arith(shell, source, &value)) {
+        return false;
+    }
+
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%lld", (long long)value);
+    ms_append_raw(out, buf);
+    return true;
+}
+
+// let expr... succeeds if the last expression is not 0
+int mysh_let(mysh_resource* shell, char** argv) {
+    if (argv[1] == NULL) {
+        fprintf(stderr, "usage: let expr...\n");
+        return 2;
+    }
+
+    int64_t value = 0;
+    for (int i = 1; argv[i] != NULL; ++i) {
+        if (!mysh_eval_arith(shell, argv[i], &value)) {
+            return 1;
+        }
+    }
+
+    return (value != 0 ? 0 : 1);
+}
+
+#endif // MYSH_ARITH_H
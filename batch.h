@@ -0,0 +1,269 @@
+#ifndef MYSH_BATCH_H
+#define MYSH_BATCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "process.h"
+#include "job.h"
+
+extern char** environ;
+
+// kept free for the auxiliary vector and whatever the kernel puts on the stack, as xargs does
+#define MYSH_BATCH_HEADROOM (4096)
+// the kernel limit for a single argument (MAX_ARG_STRLEN)
+#define MYSH_BATCH_MAX_ARG (32 * 4096)
+
+// bytes an argument takes from ARG_MAX
+static size_t mysh_arg_size(const char* arg) {
+    return strlen(arg) + 1 + sizeof(char*);
+}
+
+// bytes left for argv after the environment
+static size_t mysh_batch_space() {
+    long arg_max = sysconf(_SC_ARG_MAX);
+    if (arg_max <= 0) {
+        arg_max = 128 * 1024;
+    }
+
+    size_t used = sizeof(char*) + MYSH_BATCH_HEADROOM;
+    for (char** env = environ; *env != NULL; ++env) {
+        used += mysh_arg_size(*env);
+    }
+
+    return ((size_t)arg_max > used ? (size_t)arg_max - used : 0);
+}
+
+// the words repeated in every batch: the command and `num_fixed` words after it, or everything
+// up to and including the first `--` if `num_fixed` is negative. options cannot be told from
+// their values (`grep -e PAT`), so without either only the command is repeated
+static int mysh_batch_prefix(char** argv, int argc, int num_fixed) {
+    if (num_fixed >= 0) {
+        return (1 + num_fixed < argc ? 1 + num_fixed : argc);
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            return i + 1;
+        }
+    }
+
+    return 1;
+}
+
+// splits argv[prefix..argc) into runs that fit in `space` together with the prefix.
+// since the order of arguments is kept, filling each run greedily gives the fewest runs.
+// returns the number of runs and stores the end of each run into `ends`, or -1 if an argument can never fit
+static int mysh_split_batches(char** argv, int argc, int prefix, size_t space, int** ends) {
+    size_t prefix_size = 0;
+    for (int i = 0; i < prefix; ++i) {
+        prefix_size += mysh_arg_size(argv[i]);
+    }
+
+    int capacity = 8;
+    int num = 0;
+    *ends = (int*)malloc(sizeof(int) * capacity);
+    if (*ends == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t size = prefix_size;
+    int count = 0;
+    for (int i = prefix; i < argc; ++i) {
+        size_t arg_size = mysh_arg_size(argv[i]);
+        if (strlen(argv[i]) >= MYSH_BATCH_MAX_ARG || prefix_size + arg_size > space) {
+            fprintf(stderr, "mysh: batch: argument too long: %.32s...\n", argv[i]);
+            free(*ends);
+            *ends = NULL;
+            return -1;
+        }
+
+        if (count > 0 && size + arg_size > space) {
+            if (num == capacity) {
+                capacity *= 2;
+                *ends = (int*)realloc(*ends, sizeof(int) * capacity);
+                if (*ends == NULL) {
+                    fprintf(stderr, "mysh: error occurred in allocation.\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            (*ends)[num++] = i;
+            size = prefix_size;
+            count = 0;
+        }
+
+        size += arg_size;
+        ++count;
+    }
+
+    // the last run, which is also the only one when there are no arguments
+    if (num == capacity) {
+        *ends = (int*)realloc(*ends, sizeof(int) * (capacity + 1));
+        if (*ends == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    (*ends)[num++] = argc;
+
+    return num;
+}
+
+static mysh_process* mysh_new_batch_process(char** argv, int prefix, int begin, int end) {
+    mysh_process* proc = mysh_new_process();
+    proc->argc = prefix + (end - begin);
+    proc->argv = (char**)malloc(sizeof(char*) * (proc->argc + 1));
+    if (proc->argv == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < prefix; ++i) {
+        proc->argv[i] = strdup(argv[i]);
+    }
+    for (int i = begin; i < end; ++i) {
+        proc->argv[prefix + i - begin] = strdup(argv[i]);
+    }
+    proc->argv[proc->argc] = NULL;
+
+    return proc;
+}
+
+static int mysh_count_running(mysh_job* job) {
+    int n = 0;
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        n += !proc->is_stopped;
+    }
+
+    return n;
+}
+
+// waits until fewer than `limit` batches of `job` are running, or the job is stopped
+static void mysh_wait_batches(mysh_resource* shell, mysh_job* job, int limit) {
+    while (mysh_count_running(job) >= limit && !mysh_is_job_stopped(job)) {
+        // like every other wait, this keeps captured output, timers and admission going
+        int status;
+        pid_t pid = mysh_wait_any(shell, &status);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (pid > 0) {
+            mysh_set_status(shell->first_job, pid, status);
+        }
+    }
+}
+
+// runs argv[0] with argv[1..argc) split so that each exec stays under ARG_MAX.
+// at most `num_parallel` batches run at once; they all belong to one job
+static int mysh_run_batches(mysh_resource* shell, char** argv, int argc, int num_parallel, int num_fixed) {
+    int prefix = mysh_batch_prefix(argv, argc, num_fixed);
+
+    int* ends = NULL;
+    int num_batches = mysh_split_batches(argv, argc, prefix, mysh_batch_space(), &ends);
+    if (num_batches < 0) {
+        return 1;
+    }
+
+    mysh_job* job = mysh_add_job(shell);
+    job->in_fd = STDIN_FILENO;
+    job->out_fd = STDOUT_FILENO;
+    job->err_fd = STDERR_FILENO;
+    job->termios = shell->original_termios;
+
+    for (int i = 0; i < prefix; ++i) {
+        ms_append_raw(&job->command, argv[i]);
+        ms_push(&job->command, ' ');
+    }
+    ms_append_raw(&job->command, "...");
+
+    bool is_foreground = shell->is_interactive;
+    mysh_process* last = NULL;
+    int begin = prefix;
+    int status = 0;
+
+    for (int b = 0; b < num_batches; ++b) {
+        mysh_wait_batches(shell, job, num_parallel);
+        if (job->first_proc != NULL && mysh_is_job_stopped(job) && !mysh_is_job_completed(job)) {
+            fprintf(stderr, "mysh: batch: stopped, %d of %d batches not started\n", num_batches - b, num_batches);
+            break;
+        }
+
+        mysh_process* proc = mysh_new_batch_process(argv, prefix, begin, ends[b]);
+        begin = ends[b];
+
+        if (last == NULL) {
+            job->first_proc = proc;
+        }
+        else {
+            last->next = proc;
+        }
+        last = proc;
+
+        fflush(stdout);
+
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("mysh: failed to fork");
+            exit(EXIT_FAILURE);
+        }
+        else if (pid == 0) {
+            mysh_exec_process(shell, proc, job->group_id, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, is_foreground);
+        }
+
+        proc->pid = pid;
+        if (shell->is_interactive) {
+            if (job->group_id == 0) {
+                job->group_id = pid;
+            }
+
+            setpgid(pid, job->group_id);
+        }
+    }
+
+    mysh_wait_batches(shell, job, 1);
+
+    if (shell->is_interactive) {
+        tcsetpgrp(shell->terminal_fd, shell->group_id);
+        tcgetattr(shell->terminal_fd, &job->termios);
+        tcsetattr(shell->terminal_fd, TCSADRAIN, &shell->original_termios);
+    }
+
+    // the last failure, like `$?` of the batches run one after another
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        int s = 0;
+        if (WIFEXITED(proc->status)) {
+            s = WEXITSTATUS(proc->status);
+        }
+        else if (WIFSIGNALED(proc->status)) {
+            s = 128 + WTERMSIG(proc->status);
+        }
+        else if (WIFSTOPPED(proc->status)) {
+            s = 128 + WSTOPSIG(proc->status);
+        }
+
+        if (s != 0) {
+            status = s;
+        }
+    }
+
+    if (mysh_is_job_completed(job)) {
+        mysh_remove_job(shell, job);
+    }
+
+    free(ends);
+    return status;
+}
+
+#endif // MYSH_BATCH_H
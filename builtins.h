@@ -5,6 +5,10 @@
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <poll.h>
+#include <ctype.h>
+#include <signal.h>
 
 #include <unistd.h>
 #include <sys/types.h>
@@ -12,6 +16,8 @@
 
 #include "shell_resource.h"
 #include "job.h"
+#include "batch.h"
+#include "plugin_api.h"
 
 static const char* builtin_str[] = {
     "cd",
@@ -19,7 +25,25 @@ static const char* builtin_str[] = {
 	"jobs",
     "fg",
     "bg",
-    "mug"
+    "mug",
+    "local",
+    "return",
+    "echo",
+    "batch",
+    "cache",
+    "zygote",
+    "wait",
+    "sched",
+    "kill",
+    "cgroup",
+    "enable",
+    "cat",
+    "tee",
+    "capture",
+    "let",
+    "timeout",
+    "every",
+    "z"
 };
 
 static int mysh_cd(mysh_resource* shell, char** argv);
@@ -28,6 +52,39 @@ static int mysh_jobs(mysh_resource* shell, char** argv);
 static int mysh_fg(mysh_resource* shell, char** argv);
 static int mysh_bg(mysh_resource* shell, char** argv);
 static int mysh_mug(mysh_resource* shell, char** argv);
+static int mysh_local(mysh_resource* shell, char** argv);
+static int mysh_return(mysh_resource* shell, char** argv);
+static int mysh_echo(mysh_resource* shell, char** argv);
+static int mysh_batch(mysh_resource* shell, char** argv);
+static int mysh_wait(mysh_resource* shell, char** argv);
+static int mysh_kill(mysh_resource* shell, char** argv);
+// defined in cache.h
+static int mysh_cache(mysh_resource* shell, char** argv);
+// defined in zygote.h
+static int mysh_zygote_builtin(mysh_resource* shell, char** argv);
+// defined in admission.h
+static int mysh_sched(mysh_resource* shell, char** argv);
+// defined in cgroup.h
+static int mysh_cgroup_builtin(mysh_resource* shell, char** argv);
+// defined in plugin.h
+static int mysh_enable(mysh_resource* shell, char** argv);
+// defined in copy.h
+static int mysh_cat(mysh_resource* shell, char** argv);
+static int mysh_tee(mysh_resource* shell, char** argv);
+// defined in joboutput.h
+static int mysh_capture_builtin(mysh_resource* shell, char** argv);
+static void mysh_print_job_output(mysh_job* job, int num_lines);
+static bool mysh_has_unseen_output(mysh_job* job);
+// defined in arith.h
+static int mysh_let(mysh_resource* shell, char** argv);
+// defined in timer.h
+static int mysh_timeout(mysh_resource* shell, char** argv);
+static int mysh_every(mysh_resource* shell, char** argv);
+static bool mysh_is_job_periodic(mysh_job* job);
+static bool mysh_describe_periodic(mysh_job* job, char* buf, size_t size);
+// defined in dirjump.h
+static int mysh_jump(mysh_resource* shell, char** argv);
+static void mysh_visit_dir(mysh_resource* shell);
 
 static int (*const builtin_func[]) (mysh_resource*, char**) = {
     mysh_cd,
@@ -35,17 +92,93 @@ static int (*const builtin_func[]) (mysh_resource*, char**) = {
 	mysh_jobs,
     mysh_fg,
     mysh_bg,
-    mysh_mug
+    mysh_mug,
+    mysh_local,
+    mysh_return,
+    mysh_echo,
+    mysh_batch,
+    mysh_cache,
+    mysh_zygote_builtin,
+    mysh_wait,
+    mysh_sched,
+    mysh_kill,
+    mysh_cgroup_builtin,
+    mysh_enable,
+    mysh_cat,
+    mysh_tee,
+    mysh_capture_builtin,
+    mysh_let,
+    mysh_timeout,
+    mysh_every,
+    mysh_jump
 };
 
-static int mysh_num_builtins() {
-    return sizeof(builtin_str) / sizeof(char*);
+#define MYSH_NUM_BUILTINS (sizeof(builtin_str) / sizeof(char*))
+#define MYSH_BUILTIN_BUCKETS (64)
+
+typedef struct mysh_builtin_tag {
+    struct mysh_builtin_tag* next;
+    const char* name;
+    // one of the builtins above
+    int (*func)(mysh_resource*, char**);
+    // or one loaded by `enable -f`
+    mysh_plugin_fn plugin_fn;
+    void* plugin_ctx;
+} mysh_builtin;
+
+// every builtin by name. the ones above are linked in on the first lookup
+static struct {
+    bool is_ready;
+    mysh_builtin* buckets[MYSH_BUILTIN_BUCKETS];
+    mysh_builtin shell_builtins[MYSH_NUM_BUILTINS];
+} mysh_builtin_table;
+
+static mysh_builtin** mysh_builtin_bucket(const char* name) {
+    if (!mysh_builtin_table.is_ready) {
+        mysh_builtin_table.is_ready = true;
+        for (size_t i = 0; i < MYSH_NUM_BUILTINS; ++i) {
+            mysh_builtin* b = &mysh_builtin_table.shell_builtins[i];
+            uint32_t h = mysh_hash_name(builtin_str[i]) % MYSH_BUILTIN_BUCKETS;
+            b->name = builtin_str[i];
+            b->func = builtin_func[i];
+            b->next = mysh_builtin_table.buckets[h];
+            mysh_builtin_table.buckets[h] = b;
+        }
+    }
+
+    return &mysh_builtin_table.buckets[mysh_hash_name(name) % MYSH_BUILTIN_BUCKETS];
+}
+
+// returns NULL if `name` is not a builtin
+static mysh_builtin* mysh_find_builtin(const char* name) {
+    for (mysh_builtin* b = *mysh_builtin_bucket(name); b != NULL; b = b->next) {
+        if (strcmp(name, b->name) == 0) {
+            return b;
+        }
+    }
+
+    return NULL;
+}
+
+// defined in plugin.h
+static int mysh_call_plugin(mysh_resource* shell, mysh_builtin* builtin, char** argv);
+
+static int mysh_call_builtin(mysh_resource* shell, mysh_builtin* builtin, char** argv) {
+    if (builtin->func != NULL) {
+        return builtin->func(shell, argv);
+    }
+
+    return mysh_call_plugin(shell, builtin, argv);
 }
 
 int mysh_cd(mysh_resource* shell, char** argv) {
 	if (argv[1] == NULL) {
 		return 0;
 	}
+    // cd -j WORDS... is z WORDS...
+    if (strcmp(argv[1], "-j") == 0) {
+        return mysh_jump(shell, argv + 1);
+    }
 
 	int err = chdir(argv[1]);
 	if (err) {
@@ -53,16 +186,49 @@ int mysh_cd(mysh_resource* shell, char** argv) {
 	}
 	else {
         mysh_set_curdir_name(shell);
+        mysh_visit_dir(shell);
 	}
 
     return 0;
 }
 
 int mysh_exit(mysh_resource* shell, char** argv) {
-    return 1;
+    shell->is_exiting = true;
+
+    return (argv[1] != NULL ? atoi(argv[1]) : shell->last_status);
+}
+
+// jobs -o %N [LINES]
+static int mysh_jobs_output(mysh_resource* shell, char** argv) {
+    const char* spec = argv[2];
+    int idx = (spec != NULL ? atoi(spec[0] == '%' ? spec + 1 : spec) : 0);
+
+    mysh_job* job = shell->first_job;
+    for (int i = 1; i < idx && job != NULL; ++i) {
+        job = job->next;
+    }
+
+    if (idx <= 0 || job == NULL) {
+        fprintf(stderr, "mysh: jobs: %s: no such job\n", spec != NULL ? spec : "");
+        return 1;
+    }
+    if (job->output == NULL) {
+        fprintf(stderr, "mysh: jobs: %s: output not captured, see `capture on`\n", spec);
+        return 1;
+    }
+
+    int num_lines = (argv[3] != NULL ? atoi(argv[3]) : 10);
+    mysh_print_job_output(job, num_lines > 0 ? num_lines : 10);
+
+    return 0;
 }
 
 int mysh_jobs(mysh_resource* shell, char** argv) {
+    if (argv[1] != NULL && strcmp(argv[1], "-o") == 0) {
+        mysh_update_status(shell->first_job);
+        return mysh_jobs_output(shell, argv);
+    }
+
 	if (shell->first_job == NULL) {
         return 0;
     }
@@ -75,7 +241,18 @@ int mysh_jobs(mysh_resource* shell, char** argv) {
     while (cur_job != NULL) {
         mysh_job* next_job = cur_job->next;
 
-        if (mysh_is_job_completed(cur_job)) {
+        char periodic[64];
+        if (mysh_describe_periodic(cur_job, periodic, sizeof(periodic))) {
+            mysh_fprint_job(stdout, cur_job, periodic, idx);
+            prev_job = cur_job;
+        }
+        else if (mysh_is_job_completed(cur_job) && mysh_has_unseen_output(cur_job)) {
+            // kept until `jobs -o` has shown its output
+            mysh_fprint_job(stdout, cur_job, "completed", idx);
+            cur_job->is_notified = true;
+            prev_job = cur_job;
+        }
+        else if (mysh_is_job_completed(cur_job)) {
             if (!cur_job->is_notified) {
                 mysh_fprint_job(stdout, cur_job, "completed", idx);
             }
@@ -92,6 +269,10 @@ int mysh_jobs(mysh_resource* shell, char** argv) {
 
             mysh_release_job(cur_job);
         }
+        else if (cur_job->is_queued) {
+            mysh_fprint_job(stdout, cur_job, "queued", idx);
+            prev_job = cur_job;
+        }
         else if (mysh_is_job_stopped(cur_job)) {
             mysh_fprint_job(stdout, cur_job, "stopped", idx);
             prev_job = cur_job;
@@ -193,4 +374,235 @@ int mysh_mug(mysh_resource* shell, char** argv) {
     return 0;
 }
 
+int mysh_local(mysh_resource* shell, char** argv) {
+    mysh_scope* frame = mysh_positional_scope(shell->scope);
+    if (frame == NULL || frame->parent == NULL) {
+        fprintf(stderr, "mysh: local: can only be used in a function\n");
+        return 1;
+    }
+
+    for (int i = 1; argv[i] != NULL; ++i) {
+        char* eq = strchr(argv[i], '=');
+        size_t len = (eq != NULL ? (size_t)(eq - argv[i]) : strlen(argv[i]));
+        if (!mysh_is_var_name(argv[i], len)) {
+            fprintf(stderr, "mysh: local: `%s': not a valid identifier\n", argv[i]);
+            return 1;
+        }
+
+        if (eq != NULL) {
+            *eq = '\0';
+            mysh_set_local_var(frame, argv[i], eq + 1);
+            *eq = '=';
+        }
+        else if (mysh_scope_find(frame, argv[i]) == NULL) {
+            mysh_set_local_var(frame, argv[i], "");
+        }
+    }
+
+    return 0;
+}
+
+int mysh_return(mysh_resource* shell, char** argv) {
+    shell->is_returning = true;
+
+    return (argv[1] != NULL ? atoi(argv[1]) : shell->last_status);
+}
+
+int mysh_echo(mysh_resource* shell, char** argv) {
+    int first = 1;
+    bool newline = true;
+    if (argv[1] != NULL && strcmp(argv[1], "-n") == 0) {
+        newline = false;
+        first = 2;
+    }
+
+    for (int i = first; argv[i] != NULL; ++i) {
+        if (i != first) {
+            fputc(' ', stdout);
+        }
+        fputs(argv[i], stdout);
+    }
+
+    if (newline) {
+        fputc('\n', stdout);
+    }
+
+    return 0;
+}
+
+// waits for the running and queued background jobs. the status is that of the last one
+int mysh_wait(mysh_resource* shell, char** argv) {
+    while (true) {
+        mysh_admit_jobs(shell);
+
+        bool is_running = false;
+        bool is_queued = false;
+        for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+            is_queued |= job->is_queued;
+            is_running |= (!job->is_queued && !mysh_is_job_completed(job) && !mysh_is_job_stopped(job));
+        }
+
+        if (is_running) {
+            int status;
+            pid_t pid = mysh_wait_any(shell, &status);
+            if (pid < 0 && errno != EINTR) {
+                break;
+            }
+            if (pid > 0) {
+                mysh_set_status(shell->first_job, pid, status);
+            }
+        }
+        else if (is_queued) {
+            // held back by the load, which is polled
+            poll(NULL, 0, MYSH_SCHED_INTERVAL);
+        }
+        else {
+            break;
+        }
+    }
+
+    int status = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        if (mysh_is_job_completed(job)) {
+            status = mysh_job_status(job);
+        }
+    }
+
+    return status;
+}
+
+// a signal number from `9`, `KILL` or `SIGKILL`, or -1
+static int mysh_signal_number(const char* name) {
+    static const struct {
+        const char* name;
+        int number;
+    } signals[] = {
+        { "HUP", SIGHUP }, { "INT", SIGINT }, { "QUIT", SIGQUIT }, { "KILL", SIGKILL },
+        { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "TERM", SIGTERM }, { "CONT", SIGCONT },
+        { "STOP", SIGSTOP }, { "TSTP", SIGTSTP }
+    };
+
+    if (isdigit((unsigned char)name[0])) {
+        char* end;
+        long n = strtol(name, &end, 10);
+        return (*end == '\0' && n >= 0 && n < NSIG ? (int)n : -1);
+    }
+
+    if (strncmp(name, "SIG", 3) == 0) {
+        name += 3;
+    }
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); ++i) {
+        if (strcmp(name, signals[i].name) == 0) {
+            return signals[i].number;
+        }
+    }
+
+    return -1;
+}
+
+// kill [-s SIG | -SIG] %job|pid...
+int mysh_kill(mysh_resource* shell, char** argv) {
+    int sig = SIGTERM;
+    int first = 1;
+    if (argv[1] != NULL && strcmp(argv[1], "-s") == 0 && argv[2] != NULL) {
+        sig = mysh_signal_number(argv[2]);
+        first = 3;
+    }
+    else if (argv[1] != NULL && argv[1][0] == '-' && argv[1][1] != '\0') {
+        sig = mysh_signal_number(argv[1] + 1);
+        first = 2;
+    }
+
+    if (sig < 0) {
+        fprintf(stderr, "mysh: kill: %s: invalid signal\n", argv[first - 1]);
+        return 2;
+    }
+    if (argv[first] == NULL) {
+        fprintf(stderr, "usage: kill [-s SIG | -SIG] %%job|pid...\n");
+        return 2;
+    }
+
+    int status = 0;
+    for (int i = first; argv[i] != NULL; ++i) {
+        if (argv[i][0] != '%') {
+            if (kill((pid_t)atoi(argv[i]), sig) < 0) {
+                fprintf(stderr, "mysh: kill: %s: %s\n", argv[i], strerror(errno));
+                status = 1;
+            }
+            continue;
+        }
+
+        int idx = atoi(argv[i] + 1);
+        mysh_job* job = shell->first_job;
+        for (int j = 1; j < idx && job != NULL; ++j) {
+            job = job->next;
+        }
+
+        if (idx <= 0 || job == NULL || (mysh_is_job_completed(job) && !mysh_is_job_periodic(job))) {
+            fprintf(stderr, "mysh: kill: %s: no such job\n", argv[i]);
+            status = 1;
+        }
+        else if (!mysh_signal_job(job, sig)) {
+            fprintf(stderr, "mysh: kill: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+// batch [-j N] [-p N] [--] command [args...]
+int mysh_batch(mysh_resource* shell, char** argv) {
+    int first = 1;
+    int num_parallel = 1;
+    int num_fixed = -1;
+
+    while (argv[first] != NULL && argv[first][0] == '-') {
+        if (strcmp(argv[first], "--") == 0) {
+            ++first;
+            break;
+        }
+
+        if (strcmp(argv[first], "-j") == 0 && argv[first + 1] != NULL) {
+            num_parallel = atoi(argv[first + 1]);
+            first += 2;
+        }
+        else if (strncmp(argv[first], "-j", 2) == 0) {
+            num_parallel = atoi(argv[first] + 2);
+            ++first;
+        }
+        else if (strcmp(argv[first], "-p") == 0 && argv[first + 1] != NULL) {
+            char* end;
+            num_fixed = (int)strtol(argv[first + 1], &end, 10);
+            if (*end != '\0' || num_fixed < 0) {
+                fprintf(stderr, "mysh: batch: -p needs a number of words\n");
+                return 2;
+            }
+            first += 2;
+            continue;
+        }
+        else {
+            fprintf(stderr, "mysh: batch: unknown option `%s'\n", argv[first]);
+            return 2;
+        }
+
+        if (num_parallel <= 0) {
+            fprintf(stderr, "mysh: batch: -j needs a positive number\n");
+            return 2;
+        }
+    }
+
+    if (argv[first] == NULL) {
+        fprintf(stderr, "usage: batch [-j N] [-p N] [--] command [args...]\n");
+        return 2;
+    }
+
+    int argc = 0;
+    while (argv[first + argc] != NULL) {
+        ++argc;
+    }
+
+    return mysh_run_batches(shell, argv + first, argc, num_parallel, num_fixed);
+}
+
 #endif // MYSH_BUILTINS_H
\ No newline at end of file
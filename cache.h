@@ -0,0 +1,500 @@
+#ifndef MYSH_CACHE_H
+#define MYSH_CACHE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "process.h"
+#include "exec.h"
+
+#define MYSH_CACHE_MAGIC ("myshc001")
+#define MYSH_CACHE_DEFAULT_MAX (64 * 1024 * 1024)
+
+// an entry is a file named after the hash of its key: the header, the key itself and the captured stdout
+typedef struct {
+    char magic[8];
+    int32_t status;
+    uint32_t key_length;
+    uint64_t data_length;
+} mysh_cache_header;
+
+static struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long stores;
+    unsigned long evictions;
+    size_t max_size;
+} mysh_cache_stats = { 0, 0, 0, 0, 0 };
+
+static uint64_t mysh_hash_bytes(const char* data, size_t len) {
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+
+    return h;
+}
+
+static size_t mysh_cache_max_size() {
+    if (mysh_cache_stats.max_size == 0) {
+        const char* env = getenv("MYSH_CACHE_MAX");
+        long long n = (env != NULL ? atoll(env) : 0);
+        mysh_cache_stats.max_size = (n > 0 ? (size_t)n : MYSH_CACHE_DEFAULT_MAX);
+    }
+
+    return mysh_cache_stats.max_size;
+}
+
+// like `mkdir -p`. `who` prefixes the error message
+static bool mysh_make_dirs(mysh_string* path, const char* who) {
+    for (size_t i = 1; i <= path->length; ++i) {
+        if (path->ptr[i] != '/' && path->ptr[i] != '\0') {
+            continue;
+        }
+
+        char c = path->ptr[i];
+        path->ptr[i] = '\0';
+        int err = mkdir(path->ptr, 0700);
+        path->ptr[i] = c;
+
+        if (err < 0 && errno != EEXIST) {
+            fprintf(stderr, "mysh: %s: %s: %s\n", who, path->ptr, strerror(errno));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// $MYSH_CACHE_DIR, or mysh/ under the XDG cache directory. created if needed
+static bool mysh_cache_dir(mysh_string* out) {
+    const char* dir = getenv("MYSH_CACHE_DIR");
+    if (dir != NULL && dir[0] != '\0') {
+        ms_assign_raw(out, dir);
+    }
+    else if ((dir = getenv("XDG_CACHE_HOME")) != NULL && dir[0] != '\0') {
+        ms_assign_raw(out, dir);
+        ms_append_raw(out, "/mysh");
+    }
+    else if ((dir = getenv("HOME")) != NULL && dir[0] != '\0') {
+        ms_assign_raw(out, dir);
+        ms_append_raw(out, "/.cache/mysh");
+    }
+    else {
+        fprintf(stderr, "mysh: cache: no cache directory, set MYSH_CACHE_DIR\n");
+        return false;
+    }
+
+    return mysh_make_dirs(out, "cache");
+}
+
+// the key is everything the output may depend on: the working directory, argv,
+// the selected environment variables and the identity of the key files
+static void mysh_cache_key(char** argv, char** env_names, int num_env, char** key_files, int num_files, mysh_string* key) {
+    char buf[128];
+
+    ms_assign_raw(key, "cwd:");
+    char* cwd = getcwd(NULL, 0);
+    if (cwd != NULL) {
+        ms_append_raw(key, cwd);
+        free(cwd);
+    }
+    ms_push(key, '\n');
+
+    for (int i = 0; argv[i] != NULL; ++i) {
+        ms_append_raw(key, "arg:");
+        ms_append_raw(key, argv[i]);
+        ms_push(key, '\n');
+    }
+
+    for (int i = 0; i < num_env; ++i) {
+        const char* value = getenv(env_names[i]);
+        ms_append_raw(key, "env:");
+        ms_append_raw(key, env_names[i]);
+        ms_append_raw(key, (value != NULL ? "=" : "-"));
+        ms_append_raw(key, (value != NULL ? value : ""));
+        ms_push(key, '\n');
+    }
+
+    for (int i = 0; i < num_files; ++i) {
+        struct stat st;
+        ms_append_raw(key, "file:");
+        ms_append_raw(key, key_files[i]);
+
+        if (stat(key_files[i], &st) == 0) {
+            snprintf(buf, sizeof(buf), " %lu %lu %lld %ld.%09ld\n",
+                (unsigned long)st.st_dev, (unsigned long)st.st_ino, (long long)st.st_size,
+                (long)st.st_mtim.tv_sec, st.st_mtim.tv_nsec);
+        }
+        else {
+            snprintf(buf, sizeof(buf), " missing\n");
+        }
+        ms_append_raw(key, buf);
+    }
+}
+
+static void mysh_cache_path(const mysh_string* dir, const mysh_string* key, mysh_string* path) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", (unsigned long long)mysh_hash_bytes(key->ptr, key->length));
+
+    ms_assign_raw(path, dir->ptr);
+    ms_append_raw(path, name);
+}
+
+// writes a cached output to stdout. returns false if `path` has no entry for `key`
+static bool mysh_cache_replay(const char* path, const mysh_string* key, int* status) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(mysh_cache_header)) {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        close(fd);
+        return false;
+    }
+
+    const mysh_cache_header* header = (const mysh_cache_header*)map;
+    const char* stored_key = (const char*)map + sizeof(mysh_cache_header);
+    bool ok = (memcmp(header->magic, MYSH_CACHE_MAGIC, sizeof(header->magic)) == 0
+        && header->key_length == key->length
+        && sizeof(mysh_cache_header) + header->key_length + header->data_length == (uint64_t)st.st_size
+        && memcmp(stored_key, key->ptr, key->length) == 0);
+
+    if (ok) {
+        fwrite(stored_key + header->key_length, 1, header->data_length, stdout);
+        fflush(stdout);
+        *status = header->status;
+
+        // the mtime orders entries for eviction
+        futimens(fd, NULL);
+    }
+
+    munmap(map, st.st_size);
+    close(fd);
+
+    return ok;
+}
+
+typedef struct {
+    char* name;
+    off_t size;
+    struct timespec mtime;
+} mysh_cache_file;
+
+static int mysh_compare_cache_files(const void* a, const void* b) {
+    const mysh_cache_file* x = (const mysh_cache_file*)a;
+    const mysh_cache_file* y = (const mysh_cache_file*)b;
+    if (x->mtime.tv_sec != y->mtime.tv_sec) {
+        return (x->mtime.tv_sec < y->mtime.tv_sec ? -1 : 1);
+    }
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec) {
+        return (x->mtime.tv_nsec < y->mtime.tv_nsec ? -1 : 1);
+    }
+    return 0;
+}
+
+// lists the entries in `dir`. returns the total size of them
+static size_t mysh_list_cache(const char* dir, mysh_cache_file** files, int* num_files) {
+    *files = NULL;
+    *num_files = 0;
+
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return 0;
+    }
+
+    int capacity = 0;
+    size_t total = 0;
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        struct stat st;
+        if (fstatat(dirfd(d), ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        if (*num_files == capacity) {
+            capacity = (capacity == 0 ? 64 : capacity * 2);
+            *files = (mysh_cache_file*)realloc(*files, sizeof(mysh_cache_file) * capacity);
+            if (*files == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        mysh_cache_file* file = &(*files)[(*num_files)++];
+        file->name = strdup(ent->d_name);
+        file->size = st.st_size;
+        file->mtime = st.st_mtim;
+        total += st.st_size;
+    }
+    closedir(d);
+
+    return total;
+}
+
+// removes the least recently used entries until the store fits in the limit
+static void mysh_evict_cache(const mysh_string* dir) {
+    mysh_cache_file* files;
+    int num_files;
+    size_t total = mysh_list_cache(dir->ptr, &files, &num_files);
+
+    if (total > mysh_cache_max_size()) {
+        qsort(files, num_files, sizeof(mysh_cache_file), mysh_compare_cache_files);
+
+        int dfd = open(dir->ptr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        for (int i = 0; i < num_files && total > mysh_cache_max_size(); ++i) {
+            if (unlinkat(dfd, files[i].name, 0) == 0) {
+                total -= files[i].size;
+                ++mysh_cache_stats.evictions;
+            }
+        }
+        close(dfd);
+    }
+
+    for (int i = 0; i < num_files; ++i) {
+        free(files[i].name);
+    }
+    free(files);
+}
+
+// writes the entry to a temporary file first so that readers never see half of it
+static void mysh_cache_store(const mysh_string* dir, const char* path, const mysh_string* key, const mysh_string* data, int status) {
+    if (sizeof(mysh_cache_header) + key->length + data->length > mysh_cache_max_size()) {
+        return;
+    }
+
+    mysh_string tmp = { NULL, 0, 0, { 0 } };
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "/.tmp.%d", (int)getpid());
+    ms_init(&tmp, dir->ptr);
+    ms_append_raw(&tmp, suffix);
+
+    int fd = open(tmp.ptr, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "mysh: cache: %s: %s\n", tmp.ptr, strerror(errno));
+        ms_relase(&tmp);
+        return;
+    }
+
+    mysh_cache_header header;
+    memcpy(header.magic, MYSH_CACHE_MAGIC, sizeof(header.magic));
+    header.status = status;
+    header.key_length = key->length;
+    header.data_length = data->length;
+
+    bool ok = mysh_write_all(fd, (const char*)&header, sizeof(header))
+        && mysh_write_all(fd, key->ptr, key->length)
+        && mysh_write_all(fd, data->ptr, data->length);
+    close(fd);
+
+    if (ok && rename(tmp.ptr, path) == 0) {
+        ++mysh_cache_stats.stores;
+        mysh_evict_cache(dir);
+    }
+    else {
+        unlink(tmp.ptr);
+    }
+
+    ms_relase(&tmp);
+}
+
+// runs `argv` with its stdout captured and shown as it comes
+static int mysh_cache_run(mysh_resource* shell, char** argv, mysh_string* out) {
+    mysh_process* proc = mysh_new_process();
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        ++argc;
+    }
+
+    proc->argc = argc;
+    proc->argv = (char**)malloc(sizeof(char*) * (argc + 1));
+    if (proc->argv == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < argc; ++i) {
+        proc->argv[i] = strdup(argv[i]);
+    }
+    proc->argv[argc] = NULL;
+
+    if (mysh_is_inline(shell, proc)) {
+        int status = mysh_capture_inline(shell, proc, out);
+        mysh_release_process(proc);
+
+        fwrite(out->ptr, 1, out->length, stdout);
+        fflush(stdout);
+        return status;
+    }
+
+    mysh_string command = { NULL, 0, 0, { 0 } };
+    ms_init(&command, "cache ");
+    for (int i = 0; i < argc; ++i) {
+        if (i != 0) {
+            ms_push(&command, ' ');
+        }
+        ms_append_raw(&command, argv[i]);
+    }
+
+    // mysh_capture_forked() takes `proc`
+    int status = mysh_capture_forked(shell, proc, command.ptr, out, true);
+    ms_relase(&command);
+
+    return status;
+}
+
+static int mysh_cache_report() {
+    mysh_string dir = { NULL, 0, 0, { 0 } };
+    if (!mysh_cache_dir(&dir)) {
+        return 1;
+    }
+
+    mysh_cache_file* files;
+    int num_files;
+    size_t total = mysh_list_cache(dir.ptr, &files, &num_files);
+    for (int i = 0; i < num_files; ++i) {
+        free(files[i].name);
+    }
+    free(files);
+
+    unsigned long lookups = mysh_cache_stats.hits + mysh_cache_stats.misses;
+    printf("cache: %s\n", dir.ptr);
+    printf("  hits: %lu, misses: %lu (%.1f%% hit)\n", mysh_cache_stats.hits, mysh_cache_stats.misses,
+        lookups > 0 ? 100.0 * mysh_cache_stats.hits / lookups : 0.0);
+    printf("  stores: %lu, evictions: %lu\n", mysh_cache_stats.stores, mysh_cache_stats.evictions);
+    printf("  entries: %d, size: %zu / %zu bytes\n", num_files, total, mysh_cache_max_size());
+
+    ms_relase(&dir);
+    return 0;
+}
+
+static int mysh_cache_clear() {
+    mysh_string dir = { NULL, 0, 0, { 0 } };
+    if (!mysh_cache_dir(&dir)) {
+        return 1;
+    }
+
+    mysh_cache_file* files;
+    int num_files;
+    mysh_list_cache(dir.ptr, &files, &num_files);
+
+    int dfd = open(dir.ptr, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    for (int i = 0; i < num_files; ++i) {
+        unlinkat(dfd, files[i].name, 0);
+        free(files[i].name);
+    }
+    close(dfd);
+    free(files);
+
+    ms_relase(&dir);
+    return 0;
+}
+
+// cache [--key-files f...] [--env NAME...] -- cmd args...
+// cache --stats | --clear | --max-size BYTES
+int mysh_cache(mysh_resource* shell, char** argv) {
+    char** key_files = NULL;
+    int num_files = 0;
+    char** env_names = NULL;
+    int num_env = 0;
+
+    // the words after --key-files or --env, up to the next option
+    int i = 1;
+    int* num_list = NULL;
+    for (; argv[i] != NULL; ++i) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        }
+        if (strcmp(argv[i], "--stats") == 0) {
+            return mysh_cache_report();
+        }
+        if (strcmp(argv[i], "--clear") == 0) {
+            return mysh_cache_clear();
+        }
+        if (strcmp(argv[i], "--max-size") == 0) {
+            long long n = (argv[i + 1] != NULL ? atoll(argv[i + 1]) : 0);
+            if (n <= 0) {
+                fprintf(stderr, "mysh: cache: --max-size needs a positive number\n");
+                return 2;
+            }
+
+            mysh_cache_stats.max_size = (size_t)n;
+            return 0;
+        }
+
+        if (strcmp(argv[i], "--key-files") == 0) {
+            key_files = argv + i + 1;
+            num_list = &num_files;
+        }
+        else if (strcmp(argv[i], "--env") == 0) {
+            env_names = argv + i + 1;
+            num_list = &num_env;
+        }
+        else if (num_list != NULL && strncmp(argv[i], "--", 2) != 0) {
+            ++*num_list;
+        }
+        else {
+            fprintf(stderr, "mysh: cache: unknown option `%s'\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if (argv[i] == NULL) {
+        fprintf(stderr, "usage: cache [--key-files f...] [--env NAME...] -- command [args...]\n");
+        return 2;
+    }
+
+    mysh_string dir = { NULL, 0, 0, { 0 } };
+    if (!mysh_cache_dir(&dir)) {
+        return 1;
+    }
+
+    mysh_string key = { NULL, 0, 0, { 0 } };
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    mysh_cache_key(argv + i, env_names, num_env, key_files, num_files, &key);
+    mysh_cache_path(&dir, &key, &path);
+
+    int status = 0;
+    if (mysh_cache_replay(path.ptr, &key, &status)) {
+        ++mysh_cache_stats.hits;
+    }
+    else {
+        ++mysh_cache_stats.misses;
+
+        mysh_string out = { NULL, 0, 0, { 0 } };
+        ms_init(&out, "");
+        status = mysh_cache_run(shell, argv + i, &out);
+        mysh_cache_store(&dir, path.ptr, &key, &out, status);
+        ms_relase(&out);
+    }
+
+    ms_relase(&path);
+    ms_relase(&key);
+    ms_relase(&dir);
+
+    return status;
+}
+
+#endif // MYSH_CACHE_H
@@ -0,0 +1,300 @@
+#ifndef MYSH_CGROUP_H
+#define MYSH_CGROUP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "job.h"
+
+// with `cgroup on` or MYSH_CGROUP=1 every job gets a cgroup v2 leaf `mysh.PID/job.N` under the
+// cgroup of the shell, which has to be delegated to us. processes that leave the process group,
+// e.g. daemons, stay in the cgroup, so stopping and killing a job reaches them through cgroup.freeze
+// and cgroup.kill, and cpu.stat and memory.peak account for all of them.
+// without a delegated cgroup2 hierarchy jobs are controlled with signals as before
+
+static struct {
+    bool is_enabled;
+    // mysh.PID, the parent of the job leaves
+    mysh_string root;
+    int root_fd;
+    unsigned int next_id;
+} mysh_cgroups = { false, { NULL, 0, 0, { 0 } }, -1, 0 };
+
+// the mount point of the cgroup2 hierarchy
+static bool mysh_cgroup_mount(mysh_string* out) {
+    FILE* file = fopen("/proc/self/mountinfo", "re");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[1024];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        char* sep = strstr(line, " - cgroup2 ");
+        if (sep == NULL) {
+            continue;
+        }
+
+        // id parent major:minor root mount-point ...
+        char* p = line;
+        for (int i = 0; i < 4 && p != NULL; ++i) {
+            p = strchr(p, ' ');
+            p = (p != NULL ? p + 1 : NULL);
+        }
+        char* end = (p != NULL ? strchr(p, ' ') : NULL);
+        if (end != NULL) {
+            *end = '\0';
+            ms_assign_raw(out, p);
+            found = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+// the cgroup2 path of the shell, relative to the mount point
+static bool mysh_own_cgroup(mysh_string* out) {
+    FILE* file = fopen("/proc/self/cgroup", "re");
+    if (file == NULL) {
+        return false;
+    }
+
+    char line[1024];
+    bool found = false;
+    while (!found && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            ms_assign_raw(out, line + 3);
+            found = true;
+        }
+    }
+
+    fclose(file);
+    return found;
+}
+
+static bool mysh_write_cgroup_file(int dir_fd, const char* name, const char* value) {
+    int fd = openat(dir_fd, name, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = mysh_write_all(fd, value, strlen(value));
+    close(fd);
+
+    return ok;
+}
+
+static bool mysh_read_cgroup_file(int dir_fd, const char* name, char* buf, size_t size) {
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) {
+        return false;
+    }
+
+    buf[n] = '\0';
+    return true;
+}
+
+// enables what the parent offers, so that memory.peak and friends exist in the leaves
+static void mysh_enable_controllers(int dir_fd) {
+    char buf[256];
+    if (!mysh_read_cgroup_file(dir_fd, "cgroup.controllers", buf, sizeof(buf))) {
+        return;
+    }
+
+    for (char* name = strtok(buf, " \n"); name != NULL; name = strtok(NULL, " \n")) {
+        char value[64];
+        snprintf(value, sizeof(value), "+%s", name);
+        mysh_write_cgroup_file(dir_fd, "cgroup.subtree_control", value);
+    }
+}
+
+// the root goes once cgroups are off and the last leaf is gone
+static void mysh_remove_cgroup_root() {
+    if (mysh_cgroups.is_enabled || mysh_cgroups.root_fd < 0) {
+        return;
+    }
+
+    if (rmdir(mysh_cgroups.root.ptr) == 0) {
+        close(mysh_cgroups.root_fd);
+        mysh_cgroups.root_fd = -1;
+        ms_relase(&mysh_cgroups.root);
+    }
+}
+
+// running jobs keep their leaves until they are released
+static void mysh_disable_cgroups() {
+    mysh_cgroups.is_enabled = false;
+    mysh_remove_cgroup_root();
+}
+
+static bool mysh_enable_cgroups() {
+    if (mysh_cgroups.root_fd >= 0) {
+        mysh_cgroups.is_enabled = true;
+        return true;
+    }
+
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    mysh_string own = { NULL, 0, 0, { 0 } };
+    ms_init(&path, "");
+    ms_init(&own, "");
+
+    bool ok = mysh_cgroup_mount(&path) && mysh_own_cgroup(&own);
+    if (ok) {
+        if (strcmp(own.ptr, "/") != 0) {
+            ms_append_raw(&path, own.ptr);
+        }
+
+        // moving processes into the leaves needs write access to the common ancestor
+        ms_append_raw(&path, "/cgroup.procs");
+        ok = (access(path.ptr, W_OK) == 0);
+        path.length -= strlen("/cgroup.procs");
+        path.ptr[path.length] = '\0';
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "/mysh.%d", (int)getpid());
+    ms_append_raw(&path, name);
+
+    if (ok && mkdir(path.ptr, 0755) < 0 && errno != EEXIST) {
+        ok = false;
+    }
+    int fd = (ok ? open(path.ptr, O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1);
+    ms_relase(&own);
+
+    if (fd < 0) {
+        fprintf(stderr, "mysh: cgroup: no delegated cgroup2 hierarchy, using signals\n");
+        ms_relase(&path);
+        return false;
+    }
+
+    mysh_enable_controllers(fd);
+
+    mysh_cgroups.root.ptr = NULL;
+    ms_init(&mysh_cgroups.root, path.ptr);
+    mysh_cgroups.root_fd = fd;
+    mysh_cgroups.is_enabled = true;
+    ms_relase(&path);
+
+    return true;
+}
+
+// creates the leaf of a job about to be launched. the job falls back to signals if this fails
+void mysh_cgroup_prepare(mysh_job* job) {
+    if (!mysh_cgroups.is_enabled || job->cgroup_fd >= 0) {
+        return;
+    }
+
+    unsigned int id = ++mysh_cgroups.next_id;
+    char name[32];
+    snprintf(name, sizeof(name), "job.%u", id);
+    if (mkdirat(mysh_cgroups.root_fd, name, 0755) < 0) {
+        return;
+    }
+
+    job->cgroup_fd = openat(mysh_cgroups.root_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    job->cgroup_id = (job->cgroup_fd >= 0 ? id : 0);
+}
+
+// moves `pid`, 0 for the caller, into the leaf of `job`. called by both the shell and the
+// child, like setpgid(), so that the child is in the leaf before it execs whoever wins the race
+void mysh_cgroup_attach(mysh_job* job, pid_t pid) {
+    if (job->cgroup_fd < 0) {
+        return;
+    }
+
+    char value[32];
+    snprintf(value, sizeof(value), "%d", (int)pid);
+    mysh_write_cgroup_file(job->cgroup_fd, "cgroup.procs", value);
+}
+
+void mysh_cgroup_release(mysh_job* job) {
+    if (job->cgroup_fd < 0) {
+        return;
+    }
+
+    close(job->cgroup_fd);
+    job->cgroup_fd = -1;
+
+    // processes which outlived the job keep the leaf
+    if (mysh_cgroups.root_fd >= 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "job.%u", job->cgroup_id);
+        unlinkat(mysh_cgroups.root_fd, name, AT_REMOVEDIR);
+        mysh_remove_cgroup_root();
+    }
+}
+
+// freezes or thaws every process of `job`. returns false if the job has no leaf
+bool mysh_cgroup_freeze(mysh_job* job, bool is_frozen) {
+    return job->cgroup_fd >= 0 && mysh_write_cgroup_file(job->cgroup_fd, "cgroup.freeze", is_frozen ? "1" : "0");
+}
+
+// SIGKILLs every process of `job`. returns false if the job has no leaf or the kernel has no cgroup.kill
+static bool mysh_cgroup_kill(mysh_job* job) {
+    return job->cgroup_fd >= 0 && mysh_write_cgroup_file(job->cgroup_fd, "cgroup.kill", "1");
+}
+
+// `cpu 1.23s mem 4.5M` of the leaf of `job`
+bool mysh_cgroup_usage(mysh_job* job, char* buf, size_t size) {
+    char stat[512];
+    if (job->cgroup_fd < 0 || !mysh_read_cgroup_file(job->cgroup_fd, "cpu.stat", stat, sizeof(stat))) {
+        return false;
+    }
+
+    char* usage = strstr(stat, "usage_usec ");
+    double cpu = (usage != NULL ? strtoull(usage + 11, NULL, 10) / 1e6 : 0.0);
+
+    char mem[64];
+    if (mysh_read_cgroup_file(job->cgroup_fd, "memory.peak", mem, sizeof(mem))
+        || mysh_read_cgroup_file(job->cgroup_fd, "memory.current", mem, sizeof(mem))) {
+        snprintf(buf, size, "cpu %.2fs mem %.1fM", cpu, strtoull(mem, NULL, 10) / (1024.0 * 1024.0));
+    }
+    else {
+        snprintf(buf, size, "cpu %.2fs", cpu);
+    }
+
+    return true;
+}
+
+// cgroup [on|off]
+int mysh_cgroup_builtin(mysh_resource* shell, char** argv) {
+    if (argv[1] == NULL) {
+        if (mysh_cgroups.is_enabled) {
+            printf("cgroup: on (%s)\n", mysh_cgroups.root.ptr);
+        }
+        else {
+            printf("cgroup: off\n");
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "on") == 0) {
+        return mysh_enable_cgroups() ? 0 : 1;
+    }
+    if (strcmp(argv[1], "off") == 0) {
+        mysh_disable_cgroups();
+        return 0;
+    }
+
+    fprintf(stderr, "usage: cgroup [on|off]\n");
+    return 2;
+}
+
+#endif // MYSH_CGROUP_H
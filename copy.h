@@ -0,0 +1,439 @@
+#ifndef MYSH_COPY_H
+#define MYSH_COPY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+
+#include "shell_resource.h"
+#include "redirect.h"
+#include "job.h"
+
+// `cat` and `tee` as builtins. the data is moved by the kernel where it can be:
+// copy_file_range() between regular files, sendfile() out of a regular file,
+// splice() and tee() when a pipe is involved, and read()/write() otherwise
+
+// bytes per splice()-like call
+#define MYSH_COPY_CHUNK (1 << 20)
+// the buffer of the read()/write() fallback
+#define MYSH_COPY_BUFFER (128 * 1024)
+
+typedef enum {
+    copy_range,
+    copy_sendfile,
+    copy_splice
+} mysh_copy_method;
+
+static volatile sig_atomic_t mysh_copy_interrupted = 0;
+static struct sigaction mysh_saved_sigint;
+static struct sigaction mysh_saved_sigpipe;
+static bool mysh_copy_in_shell = false;
+
+static void mysh_interrupt_copy(int sig) {
+    mysh_copy_interrupted = 1;
+}
+
+// the interactive shell ignores SIGINT and would die of SIGPIPE, so while it copies by itself
+// ^C interrupts the copy and a closed reader ends it. children keep the default behavior
+static void mysh_begin_copy() {
+    mysh_copy_interrupted = 0;
+
+    struct sigaction current;
+    sigaction(SIGINT, NULL, &current);
+    mysh_copy_in_shell = (current.sa_handler == SIG_IGN);
+    if (!mysh_copy_in_shell) {
+        return;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);
+    // no SA_RESTART, so that a blocked read() returns EINTR
+    sa.sa_handler = mysh_interrupt_copy;
+    sigaction(SIGINT, &sa, &mysh_saved_sigint);
+
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, &mysh_saved_sigpipe);
+}
+
+static void mysh_end_copy() {
+    if (mysh_copy_in_shell) {
+        sigaction(SIGINT, &mysh_saved_sigint, NULL);
+        sigaction(SIGPIPE, &mysh_saved_sigpipe, NULL);
+        mysh_copy_in_shell = false;
+    }
+}
+
+// errors which only mean that `method` does not work for these fds
+static bool mysh_copy_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+// returns 1 once the input is exhausted, 0 if `method` cannot be used for these fds
+// and -1 on errors, with errno set
+static int mysh_copy_with(int in, int out, mysh_copy_method method) {
+    bool has_moved = false;
+    while (true) {
+        ssize_t n;
+        switch (method) {
+        case copy_range:
+            n = copy_file_range(in, NULL, out, NULL, MYSH_COPY_CHUNK, 0);
+            break;
+        case copy_sendfile:
+            n = sendfile(out, in, NULL, MYSH_COPY_CHUNK);
+            break;
+        default:
+            n = splice(in, NULL, out, NULL, MYSH_COPY_CHUNK, SPLICE_F_MOVE);
+            break;
+        }
+
+        if (n > 0) {
+            has_moved = true;
+            continue;
+        }
+        if (n == 0) {
+            return 1;
+        }
+
+        if (errno == EINTR && !mysh_copy_interrupted) {
+            continue;
+        }
+        if (!has_moved && mysh_copy_unsupported(errno)) {
+            return 0;
+        }
+        return -1;
+    }
+}
+
+static bool mysh_copy_by_buffer(int in, int out, FILE* stream) {
+    char* buf = (char*)malloc(MYSH_COPY_BUFFER);
+    if (buf == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = true;
+    while (ok) {
+        ssize_t n = read(in, buf, MYSH_COPY_BUFFER);
+        if (n < 0 && errno == EINTR && !mysh_copy_interrupted) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = (n == 0);
+            break;
+        }
+
+        if (stream != NULL) {
+            ok = (fwrite(buf, 1, n, stream) == (size_t)n);
+        }
+        else {
+            ok = mysh_write_all(out, buf, n);
+        }
+    }
+
+    int err = errno;
+    free(buf);
+    errno = err;
+
+    return ok;
+}
+
+// copies everything from `in` to `out`. returns false with errno set on errors
+static bool mysh_copy_fd(int in, int out) {
+    struct stat in_stat, out_stat;
+    if (fstat(in, &in_stat) < 0 || fstat(out, &out_stat) < 0) {
+        return false;
+    }
+
+    mysh_copy_method methods[2];
+    int num_methods = 0;
+    if (S_ISREG(in_stat.st_mode) && S_ISREG(out_stat.st_mode)) {
+        methods[num_methods++] = copy_range;
+    }
+    if (S_ISREG(in_stat.st_mode)) {
+        methods[num_methods++] = copy_sendfile;
+    }
+    else if (S_ISFIFO(in_stat.st_mode) || S_ISFIFO(out_stat.st_mode)) {
+        methods[num_methods++] = copy_splice;
+    }
+
+    for (int i = 0; i < num_methods; ++i) {
+        int result = mysh_copy_with(in, out, methods[i]);
+        if (result != 0) {
+            return result > 0;
+        }
+    }
+
+    return mysh_copy_by_buffer(in, out, NULL);
+}
+
+// a builtin inside `$(...)` has its stdout in memory rather than on fd 1
+static bool mysh_stdout_is_fd() {
+    return fileno(stdout) == STDOUT_FILENO;
+}
+
+static int mysh_copy_status(const char* builtin, const char* name) {
+    if (mysh_copy_interrupted) {
+        return 128 + SIGINT;
+    }
+    if (errno == EPIPE) {
+        // what the reader would have seen if we had been killed
+        return 128 + SIGPIPE;
+    }
+
+    fprintf(stderr, "mysh: %s: %s: %s\n", builtin, name, strerror(errno));
+    return 1;
+}
+
+// collects the operands of `argv` into `operands`, which has room for all of argv. like getopt(),
+// options may come anywhere before `--` and `-` alone is an operand. sets `has_option` if one of
+// `letters` was given, and returns false on any other option, which the builtin leaves to the
+// command it stands in for
+static bool mysh_copy_operands(char** argv, const char* letters, char** operands, bool* has_option) {
+    int num_operands = 0;
+    bool is_option_end = false;
+    for (int i = 1; argv[i] != NULL; ++i) {
+        const char* arg = argv[i];
+        if (is_option_end || arg[0] != '-' || arg[1] == '\0') {
+            operands[num_operands++] = argv[i];
+            continue;
+        }
+        if (strcmp(arg, "--") == 0) {
+            is_option_end = true;
+            continue;
+        }
+
+        for (int j = 1; arg[j] != '\0'; ++j) {
+            if (arg[j] == '-' || strchr(letters, arg[j]) == NULL) {
+                return false;
+            }
+        }
+        *has_option = true;
+    }
+    operands[num_operands] = NULL;
+
+    return true;
+}
+
+static char** mysh_new_operands(char** argv) {
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        ++argc;
+    }
+
+    char** operands = (char**)malloc(sizeof(char*) * (argc + 1));
+    if (operands == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return operands;
+}
+
+// cat [-u] [--] [file...]. `-` is stdin. other options run the real cat
+int mysh_cat(mysh_resource* shell, char** argv) {
+    // -u asks for no buffering, which there is none of anyway
+    char** files = mysh_new_operands(argv);
+    bool has_option = false;
+    if (!mysh_copy_operands(argv, "u", files, &has_option)) {
+        free(files);
+        return mysh_run_external(shell, argv);
+    }
+    if (files[0] == NULL) {
+        files[0] = "-";
+        files[1] = NULL;
+    }
+
+    bool is_fd = mysh_stdout_is_fd();
+    fflush(stdout);
+
+    mysh_begin_copy();
+
+    int status = 0;
+    for (int i = 0; files[i] != NULL && !mysh_copy_interrupted; ++i) {
+        bool is_stdin = (strcmp(files[i], "-") == 0);
+        int fd = (is_stdin ? STDIN_FILENO : open(files[i], O_RDONLY | O_CLOEXEC));
+        if (fd < 0) {
+            fprintf(stderr, "mysh: cat: %s: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        bool ok = (is_fd ? mysh_copy_fd(fd, STDOUT_FILENO) : mysh_copy_by_buffer(fd, -1, stdout));
+        if (!ok) {
+            status = mysh_copy_status("cat", files[i]);
+        }
+        if (!is_stdin) {
+            close(fd);
+        }
+        if (!ok && status != 1) {
+            break;
+        }
+    }
+
+    mysh_end_copy();
+    free(files);
+
+    return status;
+}
+
+// duplicates what is in the pipe `in` to the pipe `out` with tee(), then to all but the last of `fds`
+// through the empty pipe `through`, which is at least as large as `in`, and finally consumes it
+// into the last of `fds`. returns like mysh_copy_with()
+static int mysh_tee_by_splice(int in, int out, int* fds, int num_fds, int through[2]) {
+    bool has_moved = false;
+    while (true) {
+        ssize_t n = tee(in, out, MYSH_COPY_CHUNK, 0);
+        if (n < 0) {
+            if (errno == EINTR && !mysh_copy_interrupted) {
+                continue;
+            }
+            return (!has_moved && mysh_copy_unsupported(errno) ? 0 : -1);
+        }
+        if (n == 0) {
+            return 1;
+        }
+        has_moved = true;
+
+        // tee() always starts at the head of `in`, so every copy has to take all `n` bytes at once
+        for (int i = 0; i < num_fds; ++i) {
+            int from = in;
+            if (i != num_fds - 1) {
+                if (tee(in, through[1], n, 0) != n) {
+                    return -1;
+                }
+                from = through[0];
+            }
+
+            for (ssize_t left = n; left > 0;) {
+                ssize_t m = splice(from, NULL, fds[i], NULL, left, SPLICE_F_MOVE);
+                if (m < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (m <= 0) {
+                    return -1;
+                }
+                left -= m;
+            }
+        }
+    }
+}
+
+static bool mysh_tee_by_buffer(int in, int* fds, int num_fds, bool is_fd) {
+    char* buf = (char*)malloc(MYSH_COPY_BUFFER);
+    if (buf == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = true;
+    while (ok) {
+        ssize_t n = read(in, buf, MYSH_COPY_BUFFER);
+        if (n < 0 && errno == EINTR && !mysh_copy_interrupted) {
+            continue;
+        }
+        if (n <= 0) {
+            ok = (n == 0);
+            break;
+        }
+
+        ok = (is_fd ? mysh_write_all(STDOUT_FILENO, buf, n) : fwrite(buf, 1, n, stdout) == (size_t)n);
+        for (int i = 0; i < num_fds && ok; ++i) {
+            ok = mysh_write_all(fds[i], buf, n);
+        }
+    }
+
+    int err = errno;
+    free(buf);
+    errno = err;
+
+    return ok;
+}
+
+// tee [-a] [--] [file...]. other options run the real tee
+int mysh_tee(mysh_resource* shell, char** argv) {
+    char** files = mysh_new_operands(argv);
+    bool is_append = false;
+    if (!mysh_copy_operands(argv, "a", files, &is_append)) {
+        free(files);
+        return mysh_run_external(shell, argv);
+    }
+    int flags = O_WRONLY | O_CREAT | (is_append ? O_APPEND : O_TRUNC) | O_CLOEXEC;
+
+    int num_files = 0;
+    while (files[num_files] != NULL) {
+        ++num_files;
+    }
+
+    int* fds = (int*)malloc(sizeof(int) * (num_files + 1));
+    if (fds == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int status = 0;
+    int num_fds = 0;
+    bool all_regular = true;
+    for (int i = 0; i < num_files; ++i) {
+        int fd = open(files[i], flags, 0666);
+        if (fd < 0) {
+            fprintf(stderr, "mysh: tee: %s: %s\n", files[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+
+        struct stat st;
+        all_regular &= (fstat(fd, &st) == 0 && S_ISREG(st.st_mode));
+        fds[num_fds++] = fd;
+    }
+
+    bool is_fd = mysh_stdout_is_fd();
+    fflush(stdout);
+
+    mysh_begin_copy();
+
+    // splice() does not append, so -a takes the slow path
+    struct stat in_stat, out_stat;
+    int result = 0;
+    if (num_fds == 0 && is_fd) {
+        result = (mysh_copy_fd(STDIN_FILENO, STDOUT_FILENO) ? 1 : -1);
+    }
+    else if (is_fd && all_regular && !(flags & O_APPEND)
+        && fstat(STDIN_FILENO, &in_stat) == 0 && S_ISFIFO(in_stat.st_mode)
+        && fstat(STDOUT_FILENO, &out_stat) == 0 && S_ISFIFO(out_stat.st_mode)) {
+        int through[2];
+        if (pipe2(through, O_CLOEXEC) == 0) {
+            int size = fcntl(STDIN_FILENO, F_GETPIPE_SZ);
+            if (size > 0 && fcntl(through[1], F_SETPIPE_SZ, size) >= size) {
+                result = mysh_tee_by_splice(STDIN_FILENO, STDOUT_FILENO, fds, num_fds, through);
+            }
+            close(through[0]);
+            close(through[1]);
+        }
+    }
+
+    bool ok = (result != 0 ? result > 0 : mysh_tee_by_buffer(STDIN_FILENO, fds, num_fds, is_fd));
+    if (!ok) {
+        status = mysh_copy_status("tee", "-");
+    }
+
+    mysh_end_copy();
+
+    for (int i = 0; i < num_fds; ++i) {
+        close(fds[i]);
+    }
+    free(fds);
+    free(files);
+
+    return status;
+}
+
+#endif // MYSH_COPY_H
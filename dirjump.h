@@ -0,0 +1,693 @@
+#ifndef MYSH_DIRJUMP_H
+#define MYSH_DIRJUMP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "cache.h"
+
+// every directory an interactive `cd` enters is remembered with a visit count and the time of
+// the last visit. `z WORDS` and `cd -j WORDS` go to the best match by frecency.
+// the records live in a file which all shells map shared: a visit changes its record in place
+// and a new directory is appended, so the file is only rewritten to drop forgotten directories
+
+#define MYSH_DIRS_MAGIC ("myshz001")
+#define MYSH_DIRS_INITIAL_SIZE (64 * 1024)
+// counts are scaled down once their sum passes this, and directories which fall below 1 are forgotten
+#define MYSH_DIRS_MAX_COUNT (100000.0)
+#define MYSH_DIRS_AGING (0.9)
+
+typedef struct {
+    char magic[8];
+    // bytes of records after the header
+    uint64_t used;
+    // bytes of forgotten records, dropped by the next compaction
+    uint64_t dead;
+    double total_count;
+    // set once a compacted file took the place of this one
+    uint32_t is_replaced;
+    uint32_t reserved;
+} mysh_dirs_header;
+
+typedef struct {
+    // 0 for a forgotten directory
+    double count;
+    int64_t last_visit;
+    uint32_t length;
+    uint32_t reserved;
+    // the path follows, NUL-terminated and padded to 8 bytes
+} mysh_dir_record;
+
+// ids of the records whose lowercase path contains a trigram. trigrams of the last
+// component are also kept under key | MYSH_TRIGRAM_LAST
+typedef struct {
+    uint32_t key;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t* ids;
+} mysh_trigram_list;
+
+#define MYSH_TRIGRAM_LAST (1u << 24)
+
+typedef struct {
+    uint32_t id;
+    double score;
+} mysh_dir_match;
+
+static struct {
+    bool is_disabled;
+    int fd;
+    char* map;
+    size_t map_size;
+    mysh_string path;
+
+    // offsets of the records read from the file so far, by id
+    uint64_t* offsets;
+    uint32_t num_records;
+    uint32_t records_capacity;
+    uint64_t indexed;
+
+    // ids + 1 by path, open addressing
+    uint32_t* by_path;
+    uint32_t by_path_capacity;
+
+    // built on the first query
+    mysh_trigram_list* trigrams;
+    uint32_t num_trigrams;
+    uint32_t trigrams_capacity;
+    uint32_t trigram_records;
+} mysh_dirs = { false, -1, NULL, 0, { NULL, 0, 0, { 0 } }, NULL, 0, 0, 0, NULL, 0, NULL, 0, 0, 0 };
+
+static mysh_dirs_header* mysh_dirs_head() {
+    return (mysh_dirs_header*)mysh_dirs.map;
+}
+
+static mysh_dir_record* mysh_dirs_record(uint32_t id) {
+    return (mysh_dir_record*)(mysh_dirs.map + sizeof(mysh_dirs_header) + mysh_dirs.offsets[id]);
+}
+
+static const char* mysh_dirs_record_path(const mysh_dir_record* rec) {
+    return (const char*)(rec + 1);
+}
+
+static size_t mysh_dirs_record_size(uint32_t length) {
+    return (sizeof(mysh_dir_record) + length + 1 + 7) & ~(size_t)7;
+}
+
+// $MYSH_DIRS_FILE, or mysh/dirs under the XDG data directory
+static bool mysh_dirs_file(mysh_string* out) {
+    const char* file = getenv("MYSH_DIRS_FILE");
+    const char* dir;
+    if (file != NULL) {
+        ms_assign_raw(out, file);
+        return file[0] != '\0';
+    }
+
+    if ((dir = getenv("XDG_DATA_HOME")) != NULL && dir[0] != '\0') {
+        ms_assign_raw(out, dir);
+        ms_append_raw(out, "/mysh");
+    }
+    else if ((dir = getenv("HOME")) != NULL && dir[0] != '\0') {
+        ms_assign_raw(out, dir);
+        ms_append_raw(out, "/.local/share/mysh");
+    }
+    else {
+        return false;
+    }
+
+    if (!mysh_make_dirs(out, "z")) {
+        return false;
+    }
+    ms_append_raw(out, "/dirs");
+
+    return true;
+}
+
+static void mysh_dirs_close() {
+    if (mysh_dirs.map != NULL) {
+        munmap(mysh_dirs.map, mysh_dirs.map_size);
+    }
+    if (mysh_dirs.fd >= 0) {
+        close(mysh_dirs.fd);
+    }
+    for (uint32_t i = 0; i < mysh_dirs.trigrams_capacity; ++i) {
+        free(mysh_dirs.trigrams[i].ids);
+    }
+    free(mysh_dirs.trigrams);
+    free(mysh_dirs.by_path);
+    free(mysh_dirs.offsets);
+
+    mysh_dirs.fd = -1;
+    mysh_dirs.map = NULL;
+    mysh_dirs.map_size = 0;
+    mysh_dirs.offsets = NULL;
+    mysh_dirs.num_records = mysh_dirs.records_capacity = 0;
+    mysh_dirs.indexed = 0;
+    mysh_dirs.by_path = NULL;
+    mysh_dirs.by_path_capacity = 0;
+    mysh_dirs.trigrams = NULL;
+    mysh_dirs.num_trigrams = mysh_dirs.trigrams_capacity = mysh_dirs.trigram_records = 0;
+}
+
+static bool mysh_dirs_map(size_t size) {
+    if (mysh_dirs.map != NULL) {
+        munmap(mysh_dirs.map, mysh_dirs.map_size);
+    }
+
+    mysh_dirs.map = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mysh_dirs.fd, 0);
+    if (mysh_dirs.map == MAP_FAILED) {
+        mysh_dirs.map = NULL;
+        mysh_dirs.map_size = 0;
+        return false;
+    }
+
+    mysh_dirs.map_size = size;
+    return true;
+}
+
+static bool mysh_dirs_open() {
+    if (mysh_dirs.is_disabled) {
+        return false;
+    }
+    if (mysh_dirs.path.ptr == NULL) {
+        ms_init(&mysh_dirs.path, "");
+    }
+    if (!mysh_dirs_file(&mysh_dirs.path)) {
+        mysh_dirs.is_disabled = true;
+        return false;
+    }
+
+    mysh_dirs.fd = open(mysh_dirs.path.ptr, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (mysh_dirs.fd < 0) {
+        fprintf(stderr, "mysh: z: %s: %s\n", mysh_dirs.path.ptr, strerror(errno));
+        mysh_dirs.is_disabled = true;
+        return false;
+    }
+
+    flock(mysh_dirs.fd, LOCK_EX);
+    struct stat st;
+    bool ok = (fstat(mysh_dirs.fd, &st) == 0);
+    if (ok && st.st_size == 0) {
+        mysh_dirs_header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, MYSH_DIRS_MAGIC, sizeof(header.magic));
+
+        ok = (ftruncate(mysh_dirs.fd, MYSH_DIRS_INITIAL_SIZE) == 0
+            && pwrite(mysh_dirs.fd, &header, sizeof(header), 0) == sizeof(header));
+        st.st_size = MYSH_DIRS_INITIAL_SIZE;
+    }
+    flock(mysh_dirs.fd, LOCK_UN);
+
+    ok = ok && (size_t)st.st_size >= sizeof(mysh_dirs_header) && mysh_dirs_map(st.st_size)
+        && memcmp(mysh_dirs_head()->magic, MYSH_DIRS_MAGIC, sizeof(mysh_dirs_head()->magic)) == 0;
+    if (!ok) {
+        fprintf(stderr, "mysh: z: %s: not a directory index\n", mysh_dirs.path.ptr);
+        mysh_dirs_close();
+        mysh_dirs.is_disabled = true;
+        return false;
+    }
+
+    return true;
+}
+
+static uint32_t mysh_dirs_find(const char* path, size_t length) {
+    if (mysh_dirs.by_path_capacity == 0) {
+        return UINT32_MAX;
+    }
+
+    uint32_t mask = mysh_dirs.by_path_capacity - 1;
+    for (uint32_t i = (uint32_t)mysh_hash_bytes(path, length) & mask; mysh_dirs.by_path[i] != 0; i = (i + 1) & mask) {
+        mysh_dir_record* rec = mysh_dirs_record(mysh_dirs.by_path[i] - 1);
+        if (rec->length == length && memcmp(mysh_dirs_record_path(rec), path, length) == 0) {
+            return mysh_dirs.by_path[i] - 1;
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+static void mysh_dirs_insert_path(uint32_t id) {
+    uint32_t mask = mysh_dirs.by_path_capacity - 1;
+    mysh_dir_record* rec = mysh_dirs_record(id);
+    uint32_t i = (uint32_t)mysh_hash_bytes(mysh_dirs_record_path(rec), rec->length) & mask;
+    while (mysh_dirs.by_path[i] != 0) {
+        i = (i + 1) & mask;
+    }
+    mysh_dirs.by_path[i] = id + 1;
+}
+
+static void mysh_dirs_add_record(uint64_t offset) {
+    if (mysh_dirs.num_records == mysh_dirs.records_capacity) {
+        mysh_dirs.records_capacity = (mysh_dirs.records_capacity == 0 ? 256 : mysh_dirs.records_capacity * 2);
+        mysh_dirs.offsets = (uint64_t*)realloc(mysh_dirs.offsets, sizeof(uint64_t) * mysh_dirs.records_capacity);
+        if (mysh_dirs.offsets == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    mysh_dirs.offsets[mysh_dirs.num_records++] = offset;
+
+    // at most half full
+    if (mysh_dirs.num_records * 2 > mysh_dirs.by_path_capacity) {
+        free(mysh_dirs.by_path);
+        mysh_dirs.by_path_capacity = (mysh_dirs.by_path_capacity == 0 ? 1024 : mysh_dirs.by_path_capacity * 2);
+        mysh_dirs.by_path = (uint32_t*)calloc(mysh_dirs.by_path_capacity, sizeof(uint32_t));
+        if (mysh_dirs.by_path == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t id = 0; id < mysh_dirs.num_records; ++id) {
+            mysh_dirs_insert_path(id);
+        }
+    }
+    else {
+        mysh_dirs_insert_path(mysh_dirs.num_records - 1);
+    }
+}
+
+// opens the file on first use and catches up with what other shells did to it
+static bool mysh_dirs_sync() {
+    if (mysh_dirs.fd >= 0 && mysh_dirs_head()->is_replaced) {
+        mysh_dirs_close();
+    }
+    if (mysh_dirs.fd < 0 && !mysh_dirs_open()) {
+        return false;
+    }
+
+    uint64_t used = __atomic_load_n(&mysh_dirs_head()->used, __ATOMIC_ACQUIRE);
+    if (sizeof(mysh_dirs_header) + used > mysh_dirs.map_size) {
+        struct stat st;
+        if (fstat(mysh_dirs.fd, &st) < 0 || sizeof(mysh_dirs_header) + used > (uint64_t)st.st_size || !mysh_dirs_map(st.st_size)) {
+            mysh_dirs_close();
+            return false;
+        }
+    }
+
+    while (mysh_dirs.indexed < used) {
+        mysh_dirs_add_record(mysh_dirs.indexed);
+        mysh_dirs.indexed += mysh_dirs_record_size(mysh_dirs_record(mysh_dirs.num_records - 1)->length);
+    }
+
+    return true;
+}
+
+// rewrites the file without forgotten records once they take half of it. other shells see
+// is_replaced on the old file and open the new one
+static void mysh_dirs_compact() {
+    mysh_dirs_header* head = mysh_dirs_head();
+    if (head->used < MYSH_DIRS_INITIAL_SIZE || head->dead * 2 < head->used) {
+        return;
+    }
+
+    mysh_string tmp_path = { NULL, 0, 0, { 0 } };
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".%d", (int)getpid());
+    ms_init(&tmp_path, mysh_dirs.path.ptr);
+    ms_append_raw(&tmp_path, suffix);
+
+    int fd = open(tmp_path.ptr, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    size_t size = MYSH_DIRS_INITIAL_SIZE;
+    while (size < sizeof(mysh_dirs_header) + (head->used - head->dead) * 2) {
+        size *= 2;
+    }
+
+    char* map = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, size) == 0) {
+        map = (char*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp_path.ptr);
+        }
+        ms_relase(&tmp_path);
+        return;
+    }
+
+    mysh_dirs_header* new_head = (mysh_dirs_header*)map;
+    memcpy(new_head, head, sizeof(mysh_dirs_header));
+    new_head->used = new_head->dead = 0;
+    for (uint32_t id = 0; id < mysh_dirs.num_records; ++id) {
+        mysh_dir_record* rec = mysh_dirs_record(id);
+        if (rec->count > 0.0) {
+            size_t rec_size = mysh_dirs_record_size(rec->length);
+            memcpy(map + sizeof(mysh_dirs_header) + new_head->used, rec, rec_size);
+            new_head->used += rec_size;
+        }
+    }
+
+    munmap(map, size);
+    if (rename(tmp_path.ptr, mysh_dirs.path.ptr) == 0) {
+        head->is_replaced = 1;
+    }
+    else {
+        unlink(tmp_path.ptr);
+    }
+    close(fd);
+    ms_relase(&tmp_path);
+}
+
+// keeps the sum of counts bounded, so that old habits give way to new ones
+static void mysh_dirs_age() {
+    mysh_dirs_header* head = mysh_dirs_head();
+    if (head->total_count <= MYSH_DIRS_MAX_COUNT) {
+        return;
+    }
+
+    double factor = MYSH_DIRS_MAX_COUNT * MYSH_DIRS_AGING / head->total_count;
+    head->total_count = 0.0;
+    for (uint32_t id = 0; id < mysh_dirs.num_records; ++id) {
+        mysh_dir_record* rec = mysh_dirs_record(id);
+        if (rec->count <= 0.0) {
+            continue;
+        }
+
+        rec->count *= factor;
+        if (rec->count < 1.0) {
+            rec->count = 0.0;
+            head->dead += mysh_dirs_record_size(rec->length);
+        }
+        head->total_count += rec->count;
+    }
+
+    mysh_dirs_compact();
+}
+
+static void mysh_dirs_forget(uint32_t id) {
+    flock(mysh_dirs.fd, LOCK_EX);
+    mysh_dir_record* rec = mysh_dirs_record(id);
+    if (rec->count > 0.0) {
+        mysh_dirs_head()->total_count -= rec->count;
+        mysh_dirs_head()->dead += mysh_dirs_record_size(rec->length);
+        rec->count = 0.0;
+    }
+    flock(mysh_dirs.fd, LOCK_UN);
+}
+
+// called after every successful `cd`
+void mysh_visit_dir(mysh_resource* shell) {
+    if (!shell->is_interactive || mysh_dirs.is_disabled) {
+        return;
+    }
+
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+        return;
+    }
+
+    // closing the file on failure drops the lock as well
+    do {
+        if (!mysh_dirs_sync()) {
+            free(cwd);
+            return;
+        }
+        flock(mysh_dirs.fd, LOCK_EX);
+    } while (mysh_dirs_head()->is_replaced && flock(mysh_dirs.fd, LOCK_UN) == 0);
+
+    // and what was appended before we got the lock
+    if (!mysh_dirs_sync()) {
+        free(cwd);
+        return;
+    }
+
+    mysh_dirs_header* head = mysh_dirs_head();
+    size_t length = strlen(cwd);
+    uint32_t id = mysh_dirs_find(cwd, length);
+    if (id != UINT32_MAX) {
+        mysh_dir_record* rec = mysh_dirs_record(id);
+        if (rec->count <= 0.0) {
+            head->dead -= mysh_dirs_record_size(rec->length);
+        }
+        rec->count += 1.0;
+        rec->last_visit = (int64_t)time(NULL);
+        head->total_count += 1.0;
+    }
+    else {
+        size_t rec_size = mysh_dirs_record_size(length);
+        size_t end = sizeof(mysh_dirs_header) + head->used + rec_size;
+        size_t size = mysh_dirs.map_size;
+        while (size < end) {
+            size *= 2;
+        }
+
+        if (size == mysh_dirs.map_size || (ftruncate(mysh_dirs.fd, size) == 0 && mysh_dirs_map(size))) {
+            head = mysh_dirs_head();
+            mysh_dir_record* rec = (mysh_dir_record*)(mysh_dirs.map + sizeof(mysh_dirs_header) + head->used);
+            memset(rec, 0, rec_size);
+            rec->count = 1.0;
+            rec->last_visit = (int64_t)time(NULL);
+            rec->length = (uint32_t)length;
+            memcpy(rec + 1, cwd, length);
+            head->total_count += 1.0;
+
+            // readers go by `used`, so the record has to be complete before it
+            __atomic_store_n(&head->used, head->used + rec_size, __ATOMIC_RELEASE);
+            mysh_dirs_sync();
+        }
+    }
+
+    if (mysh_dirs.map != NULL) {
+        mysh_dirs_age();
+    }
+    flock(mysh_dirs.fd, LOCK_UN);
+    free(cwd);
+}
+
+static uint32_t mysh_trigram_key(const char* s) {
+    return ((uint32_t)(unsigned char)tolower((unsigned char)s[0]) << 16)
+        | ((uint32_t)(unsigned char)tolower((unsigned char)s[1]) << 8)
+        | (uint32_t)(unsigned char)tolower((unsigned char)s[2]);
+}
+
+// the slot of `key`, which is empty if no path has it
+static mysh_trigram_list* mysh_trigram_slot(uint32_t key) {
+    uint32_t mask = mysh_dirs.trigrams_capacity - 1;
+    uint32_t i = (key * 2654435761u) & mask;
+    while (mysh_dirs.trigrams[i].ids != NULL && mysh_dirs.trigrams[i].key != key) {
+        i = (i + 1) & mask;
+    }
+
+    return &mysh_dirs.trigrams[i];
+}
+
+static void mysh_trigram_add(uint32_t key, uint32_t id) {
+    if ((mysh_dirs.num_trigrams + 1) * 2 > mysh_dirs.trigrams_capacity) {
+        mysh_trigram_list* old = mysh_dirs.trigrams;
+        uint32_t old_capacity = mysh_dirs.trigrams_capacity;
+
+        mysh_dirs.trigrams_capacity = (old_capacity == 0 ? 4096 : old_capacity * 2);
+        mysh_dirs.trigrams = (mysh_trigram_list*)calloc(mysh_dirs.trigrams_capacity, sizeof(mysh_trigram_list));
+        if (mysh_dirs.trigrams == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+        for (uint32_t i = 0; i < old_capacity; ++i) {
+            if (old[i].ids != NULL) {
+                *mysh_trigram_slot(old[i].key) = old[i];
+            }
+        }
+        free(old);
+    }
+
+    mysh_trigram_list* list = mysh_trigram_slot(key);
+    if (list->ids == NULL) {
+        list->key = key;
+        ++mysh_dirs.num_trigrams;
+    }
+    // a path repeating a trigram was added just before
+    else if (list->ids[list->size - 1] == id) {
+        return;
+    }
+
+    if (list->size == list->capacity) {
+        list->capacity = (list->capacity == 0 ? 4 : list->capacity * 2);
+        list->ids = (uint32_t*)realloc(list->ids, sizeof(uint32_t) * list->capacity);
+        if (list->ids == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->ids[list->size++] = id;
+}
+
+static void mysh_dirs_index_trigrams() {
+    for (; mysh_dirs.trigram_records < mysh_dirs.num_records; ++mysh_dirs.trigram_records) {
+        mysh_dir_record* rec = mysh_dirs_record(mysh_dirs.trigram_records);
+        const char* path = mysh_dirs_record_path(rec);
+        const char* last = strrchr(path, '/');
+        for (uint32_t i = 0; i + 3 <= rec->length; ++i) {
+            uint32_t key = mysh_trigram_key(path + i);
+            mysh_trigram_add(key, mysh_dirs.trigram_records);
+            if (last != NULL && path + i > last) {
+                mysh_trigram_add(key | MYSH_TRIGRAM_LAST, mysh_dirs.trigram_records);
+            }
+        }
+    }
+}
+
+// the words appear in the path in order, ignoring case, and the last one in its last component
+static bool mysh_dir_matches(const char* path, char** words, int num_words) {
+    const char* last = strrchr(path, '/');
+    for (int i = 0; i < num_words; ++i) {
+        if (i == num_words - 1 && strchr(words[i], '/') == NULL && last != NULL && path < last + 1) {
+            path = last + 1;
+        }
+
+        const char* found = strcasestr(path, words[i]);
+        if (found == NULL) {
+            return false;
+        }
+        path = found + strlen(words[i]);
+    }
+
+    return true;
+}
+
+static double mysh_frecency(const mysh_dir_record* rec, int64_t now) {
+    int64_t age = now - rec->last_visit;
+    if (age < 3600) {
+        return rec->count * 4.0;
+    }
+    if (age < 24 * 3600) {
+        return rec->count * 2.0;
+    }
+    if (age < 7 * 24 * 3600) {
+        return rec->count * 0.5;
+    }
+
+    return rec->count * 0.25;
+}
+
+// candidates come from the rarest trigram of the words, or from every record if all words are shorter.
+// returns the number of matches, which the caller frees
+static size_t mysh_dirs_query(char** words, int num_words, const char* exclude, mysh_dir_match** out) {
+    *out = NULL;
+    if (!mysh_dirs_sync()) {
+        return 0;
+    }
+    mysh_dirs_index_trigrams();
+
+    const uint32_t* ids = NULL;
+    uint32_t num_ids = mysh_dirs.num_records;
+    for (int i = 0; i < num_words; ++i) {
+        uint32_t flag = (i == num_words - 1 && strchr(words[i], '/') == NULL ? MYSH_TRIGRAM_LAST : 0);
+        for (size_t j = 0; j + 3 <= strlen(words[i]); ++j) {
+            mysh_trigram_list* list = mysh_trigram_slot(mysh_trigram_key(words[i] + j) | flag);
+            if (list->ids == NULL) {
+                return 0;
+            }
+            if (ids == NULL || list->size < num_ids) {
+                ids = list->ids;
+                num_ids = list->size;
+            }
+        }
+    }
+
+    mysh_dir_match* matches = (mysh_dir_match*)malloc(sizeof(mysh_dir_match) * (num_ids + 1));
+    if (matches == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int64_t now = (int64_t)time(NULL);
+    size_t n = 0;
+    for (uint32_t i = 0; i < num_ids; ++i) {
+        uint32_t id = (ids != NULL ? ids[i] : i);
+        mysh_dir_record* rec = mysh_dirs_record(id);
+        const char* path = mysh_dirs_record_path(rec);
+        if (rec->count <= 0.0 || (exclude != NULL && strcmp(path, exclude) == 0) || !mysh_dir_matches(path, words, num_words)) {
+            continue;
+        }
+
+        matches[n].id = id;
+        matches[n].score = mysh_frecency(rec, now);
+        ++n;
+    }
+
+    *out = matches;
+    return n;
+}
+
+static int mysh_compare_dir_matches(const void* a, const void* b) {
+    double x = ((const mysh_dir_match*)a)->score;
+    double y = ((const mysh_dir_match*)b)->score;
+
+    return (x < y) - (x > y);
+}
+
+// z [-l] [WORDS...]
+int mysh_jump(mysh_resource* shell, char** argv) {
+    bool is_listing = (argv[1] != NULL && strcmp(argv[1], "-l") == 0);
+    char** words = argv + 1 + is_listing;
+    int num_words = 0;
+    while (words[num_words] != NULL) {
+        ++num_words;
+    }
+    is_listing |= (num_words == 0);
+
+    char* cwd = getcwd(NULL, 0);
+    mysh_dir_match* matches;
+    size_t n = mysh_dirs_query(words, num_words, (is_listing ? NULL : cwd), &matches);
+    free(cwd);
+
+    if (is_listing) {
+        qsort(matches, n, sizeof(mysh_dir_match), mysh_compare_dir_matches);
+        for (size_t i = n; i > 0; --i) {
+            printf("%10.1f  %s\n", matches[i - 1].score, mysh_dirs_record_path(mysh_dirs_record(matches[i - 1].id)));
+        }
+        free(matches);
+        return 0;
+    }
+
+    // directories which are gone are forgotten on the way
+    while (n > 0) {
+        size_t best = 0;
+        for (size_t i = 1; i < n; ++i) {
+            if (matches[i].score > matches[best].score) {
+                best = i;
+            }
+        }
+
+        const char* path = mysh_dirs_record_path(mysh_dirs_record(matches[best].id));
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+            mysh_string target = { NULL, 0, 0, { 0 } };
+            ms_init(&target, path);
+            free(matches);
+
+            int status = 0;
+            if (chdir(target.ptr) < 0) {
+                fprintf(stderr, "mysh: %s: %s\n", target.ptr, strerror(errno));
+                status = 1;
+            }
+            else {
+                mysh_set_curdir_name(shell);
+                mysh_visit_dir(shell);
+            }
+            ms_relase(&target);
+            return status;
+        }
+
+        mysh_dirs_forget(matches[best].id);
+        matches[best] = matches[--n];
+    }
+
+    free(matches);
+    fprintf(stderr, "mysh: z: no match\n");
+    return 1;
+}
+
+#endif // MYSH_DIRJUMP_H
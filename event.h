@@ -0,0 +1,119 @@
+#ifndef MYSH_EVENT_H
+#define MYSH_EVENT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "shell_resource.h"
+
+// fds the shell watches while it waits for input, e.g. notifications from background workers
+typedef void (*mysh_event_handler)(mysh_resource* shell, int fd, void* ctx);
+
+typedef struct {
+    int fd;
+    short events;
+    mysh_event_handler handler;
+    void* ctx;
+} mysh_watch;
+
+static struct {
+    mysh_watch* watches;
+    int size;
+    int capacity;
+} mysh_watch_list = { NULL, 0, 0 };
+
+static void mysh_watch_fd(int fd, short events, mysh_event_handler handler, void* ctx) {
+    for (int i = 0; i < mysh_watch_list.size; ++i) {
+        if (mysh_watch_list.watches[i].fd == fd) {
+            mysh_watch_list.watches[i].events = events;
+            mysh_watch_list.watches[i].handler = handler;
+            mysh_watch_list.watches[i].ctx = ctx;
+            return;
+        }
+    }
+
+    if (mysh_watch_list.size == mysh_watch_list.capacity) {
+        mysh_watch_list.capacity = (mysh_watch_list.capacity == 0 ? 8 : mysh_watch_list.capacity * 2);
+        mysh_watch_list.watches = (mysh_watch*)realloc(mysh_watch_list.watches, sizeof(mysh_watch) * mysh_watch_list.capacity);
+        if (mysh_watch_list.watches == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    mysh_watch* w = &mysh_watch_list.watches[mysh_watch_list.size++];
+    w->fd = fd;
+    w->events = events;
+    w->handler = handler;
+    w->ctx = ctx;
+}
+
+static void mysh_unwatch_fd(int fd) {
+    for (int i = 0; i < mysh_watch_list.size; ++i) {
+        if (mysh_watch_list.watches[i].fd == fd) {
+            mysh_watch_list.watches[i] = mysh_watch_list.watches[--mysh_watch_list.size];
+            return;
+        }
+    }
+}
+
+// waits until `fd` is readable, a watched fd has an event or `timeout` ms pass.
+// runs the handlers of watched fds and returns whether `fd` is readable
+static bool mysh_wait_input(mysh_resource* shell, int fd, int timeout) {
+    while (true) {
+        int n = mysh_watch_list.size;
+        struct pollfd* fds = (struct pollfd*)malloc(sizeof(struct pollfd) * (n + 1));
+        if (fds == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        fds[0].fd = fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < n; ++i) {
+            fds[i + 1].fd = mysh_watch_list.watches[i].fd;
+            fds[i + 1].events = mysh_watch_list.watches[i].events;
+        }
+
+        int ret = poll(fds, n + 1, timeout);
+        if (ret < 0 && errno == EINTR) {
+            free(fds);
+            continue;
+        }
+        if (ret <= 0) {
+            free(fds);
+            return false;
+        }
+
+        // handlers may change the list, so look each fd up again
+        for (int i = 1; i <= n; ++i) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+
+            // an fd closed behind our back would make every poll() return at once
+            if (fds[i].revents & POLLNVAL) {
+                mysh_unwatch_fd(fds[i].fd);
+                continue;
+            }
+
+            for (int j = 0; j < mysh_watch_list.size; ++j) {
+                mysh_watch* w = &mysh_watch_list.watches[j];
+                if (w->fd == fds[i].fd) {
+                    w->handler(shell, w->fd, w->ctx);
+                    break;
+                }
+            }
+        }
+
+        bool ready = (fds[0].revents != 0);
+        free(fds);
+
+        return ready;
+    }
+}
+
+#endif // MYSH_EVENT_H
@@ -0,0 +1,532 @@
+#ifndef MYSH_EXEC_H
+#define MYSH_EXEC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "shell_resource.h"
+#include "variable.h"
+#include "process.h"
+#include "job.h"
+#include "builtins.h"
+#include "function.h"
+#include "expand.h"
+#include "parser.h"
+#include "subst.h"
+
+#define MYSH_MAX_FUNCTION_DEPTH (1000)
+#define MYSH_CAPTURE_CHUNK (64 * 1024)
+
+static int mysh_run_list(mysh_resource* shell, mysh_command_list* list);
+
+static int mysh_call_function(mysh_resource* shell, mysh_function* fn, int argc, char** argv) {
+    static int depth = 0;
+    if (depth >= MYSH_MAX_FUNCTION_DEPTH) {
+        fprintf(stderr, "mysh: %s: maximum function nesting level exceeded\n", fn->name);
+        return 1;
+    }
+
+    // the function may redefine itself while running
+    mysh_command_list* body = mysh_retain_list(fn->body);
+
+    ++depth;
+    shell->scope = mysh_new_scope(shell->scope, argc, argv);
+    int status = mysh_run_list(shell, body);
+    shell->scope = mysh_release_scope(shell->scope);
+    --depth;
+
+    mysh_release_list(body);
+    shell->is_returning = false;
+
+    return status;
+}
+
+// whether `proc` can run without forking
+static bool mysh_is_inline(mysh_resource* shell, mysh_process* proc) {
+    if (proc->kind == process_subshell) {
+        return false;
+    }
+    if (proc->kind != process_simple || proc->argc == proc->num_assigns) {
+        return true;
+    }
+
+    const char* name = proc->argv[proc->num_assigns];
+    return mysh_find_function(shell, name) != NULL || mysh_find_builtin(name) != NULL;
+}
+
+int mysh_exec_command(mysh_resource* shell, mysh_process* proc) {
+    if (proc->kind == process_function) {
+        mysh_define_function(shell, proc->name, proc->body);
+        return 0;
+    }
+    if (proc->kind == process_group || proc->kind == process_subshell) {
+        return mysh_run_list(shell, proc->body);
+    }
+
+    if (proc->argc == proc->num_assigns) {
+        for (int i = 0; i < proc->num_assigns; ++i) {
+            char* eq = strchr(proc->argv[i], '=');
+            *eq = '\0';
+            mysh_set_var(shell->scope, proc->argv[i], eq + 1);
+            *eq = '=';
+        }
+
+        return 0;
+    }
+
+    int argc = proc->argc - proc->num_assigns;
+    char** argv = proc->argv + proc->num_assigns;
+
+    mysh_function* fn = (proc->is_external ? NULL : mysh_find_function(shell, argv[0]));
+    mysh_builtin* builtin = (fn == NULL && !proc->is_external ? mysh_find_builtin(argv[0]) : NULL);
+    if (fn == NULL && builtin == NULL) {
+        mysh_exec_external(proc);
+    }
+
+    // `NAME=value cmd` is visible only while cmd runs
+    if (proc->num_assigns > 0) {
+        shell->scope = mysh_new_scope(shell->scope, 0, NULL);
+        for (int i = 0; i < proc->num_assigns; ++i) {
+            char* eq = strchr(proc->argv[i], '=');
+            *eq = '\0';
+            mysh_set_local_var(shell->scope, proc->argv[i], eq + 1);
+            *eq = '=';
+        }
+    }
+
+    int status = (fn != NULL ? mysh_call_function(shell, fn, argc, argv) : mysh_call_builtin(shell, builtin, argv));
+
+    if (proc->num_assigns > 0) {
+        shell->scope = mysh_release_scope(shell->scope);
+    }
+
+    return status;
+}
+
+static void mysh_restore_redirects(mysh_process* proc, int* saved, int num) {
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = num - 1; i >= 0; --i) {
+        int tfd = proc->redirects[i].tfd;
+        if (saved[i] >= 0) {
+            dup2(saved[i], tfd);
+            close(saved[i]);
+        }
+        else {
+            close(tfd);
+        }
+    }
+}
+
+// applies the redirects of `proc` to the shell itself. the previous fds are kept in `saved`
+static bool mysh_apply_redirects(mysh_process* proc, int* saved) {
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = 0; i < proc->num_redirects; ++i) {
+        mysh_redirect_data* red = &proc->redirects[i];
+        if (!mysh_open_file(red)) {
+            mysh_restore_redirects(proc, saved, i);
+            return false;
+        }
+
+        saved[i] = fcntl(red->tfd, F_DUPFD_CLOEXEC, 10);
+        if (dup2(red->ffd, red->tfd) < 0) {
+            perror("mysh: failed to duplicate FD");
+            mysh_close_file(red);
+            mysh_restore_redirects(proc, saved, i + 1);
+            return false;
+        }
+
+        mysh_close_file(red);
+    }
+
+    return true;
+}
+
+static int mysh_run_inline(mysh_resource* shell, mysh_process* proc) {
+    int* saved = NULL;
+    if (proc->num_redirects > 0) {
+        saved = (int*)malloc(sizeof(int) * proc->num_redirects);
+        if (saved == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        if (!mysh_apply_redirects(proc, saved)) {
+            free(saved);
+            return 1;
+        }
+    }
+
+    int status = mysh_exec_command(shell, proc);
+
+    if (saved != NULL) {
+        mysh_restore_redirects(proc, saved, proc->num_redirects);
+        free(saved);
+    }
+
+    return status;
+}
+
+static int mysh_run_pipeline(mysh_resource* shell, mysh_process* pipeline, bool is_foreground, const char* command) {
+    mysh_process* first_proc = mysh_expand_pipeline(shell, pipeline);
+    if (first_proc == NULL) {
+        return 1;
+    }
+
+    // functions, builtins and assignments run in the shell itself unless they are a part of a pipeline or a background job
+    if (is_foreground && first_proc->next == NULL && mysh_is_inline(shell, first_proc)) {
+        mysh_inherit_subst_fds(shell, first_proc);
+        int status = mysh_run_inline(shell, first_proc);
+        mysh_release_subst_fds(shell, first_proc);
+        mysh_release_process(first_proc);
+        return status;
+    }
+
+    // process substitutions are already running, so only plain jobs can wait
+    bool has_subst = false;
+    for (mysh_process* proc = first_proc; proc != NULL; proc = proc->next) {
+        has_subst |= (proc->num_subst_fds > 0);
+    }
+    bool is_queued = (!is_foreground && !has_subst && mysh_should_queue(shell));
+
+    mysh_job* job = mysh_add_job(shell);
+    job->first_proc = first_proc;
+    job->in_fd = STDIN_FILENO;
+    job->out_fd = STDOUT_FILENO;
+    job->err_fd = STDERR_FILENO;
+    job->group_id = 0;
+    job->termios = shell->original_termios;
+
+    ms_assign_raw(&job->command, command);
+
+    if (!is_foreground) {
+        mysh_start_job_output(shell, job);
+    }
+
+    if (is_queued) {
+        job->is_queued = true;
+        return 0;
+    }
+
+    bool ok = mysh_launch_job(shell, job, is_foreground);
+    for (mysh_process* proc = first_proc; proc != NULL; proc = proc->next) {
+        mysh_release_subst_fds(shell, proc);
+    }
+
+    if (!ok) {
+        if (job->group_id == 0) {
+            mysh_remove_job(shell, job);
+        }
+        return 1;
+    }
+
+    if (!is_foreground) {
+        return 0;
+    }
+
+    int status = mysh_job_status(job);
+    if (mysh_is_job_completed(job)) {
+        mysh_remove_job(shell, job);
+    }
+
+    return status;
+}
+
+static int mysh_run_list(mysh_resource* shell, mysh_command_list* list) {
+    int status = shell->last_status;
+
+    for (mysh_command_list* entry = list; entry != NULL; entry = entry->next) {
+        if (shell->is_exiting || shell->is_returning) {
+            break;
+        }
+
+        // skipped branches keep the status, so `a || b && c` runs c when a succeeds
+        if ((entry->connector == connect_and && status != 0) || (entry->connector == connect_or && status == 0)) {
+            continue;
+        }
+
+        status = mysh_run_pipeline(shell, entry->pipeline, entry->is_foreground, entry->command.ptr);
+        shell->last_status = status;
+
+        mysh_reap_substs(shell);
+    }
+
+    return status;
+}
+
+// appends everything readable from `fd` to `out`
+static void mysh_read_all(int fd, mysh_string* out) {
+    if (out->ptr == NULL) {
+        ms_init(out, "");
+    }
+
+    while (true) {
+        ms_reserve(out, out->length + MYSH_CAPTURE_CHUNK);
+
+        ssize_t n = read(fd, out->ptr + out->length, MYSH_CAPTURE_CHUNK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+
+        out->length += n;
+    }
+
+    out->ptr[out->length] = '\0';
+}
+
+// mysh_read_all() which also writes what it reads to stdout at once, so that a long command
+// shows its output while it runs
+static void mysh_read_shown(int fd, mysh_string* out) {
+    if (out->ptr == NULL) {
+        ms_init(out, "");
+    }
+
+    while (true) {
+        ms_reserve(out, out->length + MYSH_CAPTURE_CHUNK);
+
+        ssize_t n = read(fd, out->ptr + out->length, MYSH_CAPTURE_CHUNK);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+
+        fwrite(out->ptr + out->length, 1, n, stdout);
+        fflush(stdout);
+        out->length += n;
+    }
+
+    out->ptr[out->length] = '\0';
+}
+
+// `$(< file)` reads the file without running anything
+static bool mysh_capture_file(mysh_resource* shell, const char* source, mysh_string* out, int* status) {
+    mysh_string line = { NULL, 0, 0, { 0 } };
+    ms_init(&line, source);
+
+    int size = 0;
+    mysh_tokenized_component** coms = mysh_tokenize(line.ptr, &size);
+    if (coms == NULL) {
+        ms_relase(&line);
+        return false;
+    }
+
+    bool is_file = (size == 2
+        && coms[0]->token == token_redirect
+        && ((mysh_redirect_data*)coms[0]->data)->kind == redirect_in
+        && coms[1]->token == token_string);
+
+    if (is_file) {
+        mysh_string name = { NULL, 0, 0, { 0 } };
+        int fd = -1;
+        if (!mysh_expand_word(shell, ((mysh_string*)coms[1]->data)->ptr, &name)) {
+            *status = 1;
+        }
+        else if ((fd = open(name.ptr, O_RDONLY | O_CLOEXEC)) < 0) {
+            fprintf(stderr, "mysh: %s: %s\n", name.ptr, strerror(errno));
+            *status = 1;
+        }
+        else {
+            mysh_read_all(fd, out);
+            close(fd);
+            *status = 0;
+        }
+
+        ms_relase(&name);
+    }
+
+    for (int i = 0; i < size; ++i) {
+        free_tokenized_component(coms[i]);
+    }
+    free(coms);
+    ms_relase(&line);
+
+    return is_file;
+}
+
+// runs a builtin or function in the shell itself with its output going to `out`
+static int mysh_capture_inline(mysh_resource* shell, mysh_process* proc, mysh_string* out) {
+    bool is_exiting = shell->is_exiting;
+    bool is_returning = shell->is_returning;
+    int status;
+
+    bool is_builtin = (proc->kind == process_simple
+        && proc->num_redirects == 0
+        && proc->argc > proc->num_assigns
+        && mysh_find_function(shell, proc->argv[proc->num_assigns]) == NULL);
+
+    if (is_builtin) {
+        // builtins only write through stdio, so their output can go straight into memory
+        char* buf = NULL;
+        size_t len = 0;
+        FILE* mem = open_memstream(&buf, &len);
+        if (mem == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        fflush(stdout);
+        FILE* saved = stdout;
+        stdout = mem;
+        status = mysh_exec_command(shell, proc);
+        stdout = saved;
+        fclose(mem);
+
+        ms_append_raw(out, buf);
+        free(buf);
+    }
+    else {
+        // functions may start other commands, which need a real fd
+        int fd = memfd_create("mysh-capture", MFD_CLOEXEC);
+        if (fd < 0) {
+            perror("mysh: failed to capture output");
+            return 1;
+        }
+
+        fflush(stdout);
+        int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+        dup2(fd, STDOUT_FILENO);
+
+        mysh_inherit_subst_fds(shell, proc);
+        status = mysh_run_inline(shell, proc);
+
+        fflush(stdout);
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+
+        lseek(fd, 0, SEEK_SET);
+        mysh_read_all(fd, out);
+        close(fd);
+    }
+
+    // `$(exit)` or `$(return)` only leaves the substitution
+    shell->is_exiting = is_exiting;
+    shell->is_returning = is_returning;
+
+    return status;
+}
+
+// runs `proc` in the group of the shell writing into a pipe we drain until EOF. with `is_shown`,
+// the output also goes to stdout as it arrives
+static int mysh_capture_forked(mysh_resource* shell, mysh_process* proc, const char* source, mysh_string* out, bool is_shown) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("mysh: failed to create pipe");
+        mysh_release_process(proc);
+        return 1;
+    }
+
+    mysh_job* job = mysh_add_job(shell);
+    job->first_proc = proc;
+    job->in_fd = STDIN_FILENO;
+    job->out_fd = fds[1];
+    job->err_fd = STDERR_FILENO;
+    job->termios = shell->original_termios;
+    job->is_in_shell_group = true;
+
+    ms_assign_raw(&job->command, "$(");
+    ms_append_raw(&job->command, source);
+    ms_push(&job->command, ')');
+
+    bool ok = mysh_launch_job(shell, job, false);
+    mysh_release_subst_fds(shell, proc);
+    close(fds[1]);
+
+    if (ok && is_shown) {
+        mysh_read_shown(fds[0], out);
+    }
+    else if (ok) {
+        mysh_read_all(fds[0], out);
+    }
+    close(fds[0]);
+
+    // the job has no group of its own, so only a process which never started tells that
+    // nothing is left to reap
+    if (!ok) {
+        if (proc->pid == 0) {
+            mysh_remove_job(shell, job);
+        }
+        return 1;
+    }
+
+    mysh_wait_job(shell, job);
+
+    int status = mysh_job_status(job);
+    if (mysh_is_job_completed(job)) {
+        mysh_remove_job(shell, job);
+    }
+
+    return status;
+}
+
+// appends the output of `source` without trailing newlines to `out`.
+// builtins and functions run in the shell itself instead of a subshell
+void mysh_command_subst(mysh_resource* shell, const char* source, mysh_string* out) {
+    mysh_string captured = { NULL, 0, 0, { 0 } };
+    ms_init(&captured, "");
+
+    int status = 0;
+    if (!mysh_capture_file(shell, source, &captured, &status)) {
+        mysh_string line = { NULL, 0, 0, { 0 } };
+        ms_init(&line, source);
+        mysh_command_list* list = mysh_parse_input(line.ptr, NULL, NULL);
+        ms_relase(&line);
+
+        if (list == NULL) {
+            ms_relase(&captured);
+            shell->last_status = 1;
+            return;
+        }
+
+        mysh_process* proc = NULL;
+        if (list->next == NULL && list->is_foreground && list->pipeline->next == NULL && list->pipeline->kind == process_simple) {
+            proc = mysh_expand_process(shell, list->pipeline);
+            if (proc == NULL) {
+                // the error is reported, and like any failed command this outputs nothing
+                status = 1;
+                mysh_release_list(list);
+                list = NULL;
+            }
+            else if (mysh_is_inline(shell, proc)) {
+                status = mysh_capture_inline(shell, proc, &captured);
+                mysh_release_subst_fds(shell, proc);
+                mysh_release_process(proc);
+                proc = NULL;
+
+                mysh_release_list(list);
+                list = NULL;
+            }
+        }
+        else {
+            proc = mysh_new_process();
+            proc->kind = process_subshell;
+            proc->body = mysh_retain_list(list);
+        }
+
+        if (list != NULL) {
+            status = mysh_capture_forked(shell, proc, source, &captured, false);
+            mysh_release_list(list);
+        }
+    }
+
+    while (captured.length > 0 && captured.ptr[captured.length - 1] == '\n') {
+        captured.ptr[--captured.length] = '\0';
+    }
+
+    ms_append_raw(out, captured.ptr);
+    ms_relase(&captured);
+
+    shell->last_status = status;
+}
+
+#endif // MYSH_EXEC_H
\ No newline at end of file
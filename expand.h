@@ -0,0 +1,391 @@
+#ifndef MYSH_EXPAND_H
+#define MYSH_EXPAND_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mystring.h"
+#include "variable.h"
+#include "tokenizer.h"
+#include "process.h"
+#include "shell_resource.h"
+#include "subst.h"
+#include "glob.h"
+#include "arith.h"
+
+// defined in exec.h
+static void mysh_command_subst(mysh_resource* shell, const char* source, mysh_string* out);
+
+static void mysh_expand_var(mysh_resource* shell, const char* name, mysh_string* out) {
+    mysh_scope* pos = mysh_positional_scope(shell->scope);
+    char buf[32];
+
+    if (isdigit((unsigned char)name[0])) {
+        int idx = atoi(name);
+        if (pos != NULL && idx < pos->argc) {
+            ms_append_raw(out, pos->argv[idx]);
+        }
+    }
+    else if (strcmp(name, "#") == 0) {
+        snprintf(buf, sizeof(buf), "%d", pos != NULL ? pos->argc - 1 : 0);
+        ms_append_raw(out, buf);
+    }
+    else if (strcmp(name, "@") == 0 || strcmp(name, "*") == 0) {
+        for (int i = 1; pos != NULL && i < pos->argc; ++i) {
+            if (i != 1) {
+                ms_push(out, ' ');
+            }
+            ms_append_raw(out, pos->argv[i]);
+        }
+    }
+    else if (strcmp(name, "?") == 0) {
+        snprintf(buf, sizeof(buf), "%d", shell->last_status);
+        ms_append_raw(out, buf);
+    }
+    else if (strcmp(name, "$") == 0) {
+        snprintf(buf, sizeof(buf), "%d", (int)getpid());
+        ms_append_raw(out, buf);
+    }
+    else {
+        const char* value = mysh_lookup_var(shell->scope, name);
+        if (value != NULL) {
+            ms_append_raw(out, value);
+        }
+    }
+}
+
+// keeps the wildcards in out[from, end) from being globbed
+static void mysh_escape_glob(mysh_string* out, size_t from) {
+    size_t n = 0;
+    for (size_t i = from; i < out->length; ++i) {
+        n += mysh_is_glob_char(out->ptr[i]);
+    }
+    if (n == 0) {
+        return;
+    }
+
+    char* tail = strdup(out->ptr + from);
+    if (tail == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    out->ptr[from] = '\0';
+    out->length = from;
+    for (const char* p = tail; *p != '\0'; ++p) {
+        if (mysh_is_glob_char(*p)) {
+            ms_push(out, MYSH_CTL_ESC);
+        }
+        ms_push(out, *p);
+    }
+
+    free(tail);
+}
+
+// copies the text up to the closing `delim` into `name` and returns the position of the delimiter
+static const char* mysh_copy_until(const char* p, char delim, mysh_string* name) {
+    const char* end = p;
+    while (*end != delim && *end != '\0') {
+        ++end;
+    }
+
+    ms_assign_n(name, p, end - p);
+    return end;
+}
+
+// resolves the references the tokenizer left in `word`. returns false after reporting an error.
+// if `as_pattern` is set, quoted and substituted wildcards are kept escaped for mysh_glob()
+static bool mysh_expand_word_as(mysh_resource* shell, const char* word, mysh_string* out, bool as_pattern) {
+    ms_assign_raw(out, "");
+
+    bool ok = true;
+    mysh_string name = { NULL, 0, 0, { 0 } };
+    for (const char* p = word; *p != '\0'; ++p) {
+        if (*p == MYSH_CTL_PROCSUB) {
+            char dir = *++p;
+            p = mysh_copy_until(p + 1, MYSH_CTL_PROCSUB, &name);
+
+            size_t from = out->length;
+            int fd = mysh_open_procsub(shell, dir, name.ptr);
+            if (fd >= 0) {
+                char buf[32];
+                snprintf(buf, sizeof(buf), "/dev/fd/%d", fd);
+                ms_append_raw(out, buf);
+            }
+            if (as_pattern) {
+                mysh_escape_glob(out, from);
+            }
+
+            if (*p == '\0') {
+                break;
+            }
+            continue;
+        }
+
+        if (*p == MYSH_CTL_CMDSUB) {
+            p = mysh_copy_until(p + 1, MYSH_CTL_CMDSUB, &name);
+
+            size_t from = out->length;
+            mysh_command_subst(shell, name.ptr, out);
+            if (as_pattern) {
+                mysh_escape_glob(out, from);
+            }
+
+            if (*p == '\0') {
+                break;
+            }
+            continue;
+        }
+
+        if (*p == MYSH_CTL_ARITH) {
+            p = mysh_copy_until(p + 1, MYSH_CTL_ARITH, &name);
+            ok = mysh_arith_subst(shell, name.ptr, out);
+
+            if (!ok || *p == '\0') {
+                break;
+            }
+            continue;
+        }
+
+        if (*p == MYSH_CTL_ESC && p[1] != '\0') {
+            if (as_pattern) {
+                ms_push(out, *p);
+            }
+            ms_push(out, *++p);
+            continue;
+        }
+
+        if (*p != MYSH_CTL_VAR) {
+            // the plain text up to the next reference at once
+            const char* end = p + 1;
+            while (*end != '\0' && *end != MYSH_CTL_VAR && *end != MYSH_CTL_ESC
+                && *end != MYSH_CTL_CMDSUB && *end != MYSH_CTL_PROCSUB && *end != MYSH_CTL_ARITH) {
+                ++end;
+            }
+            ms_append_n(out, p, end - p);
+            p = end - 1;
+            continue;
+        }
+
+        p = mysh_copy_until(p + 1, MYSH_CTL_VAR, &name);
+
+        size_t from = out->length;
+        mysh_expand_var(shell, name.ptr, out);
+        if (as_pattern) {
+            mysh_escape_glob(out, from);
+        }
+
+        if (*p == '\0') {
+            break;
+        }
+    }
+
+    ms_relase(&name);
+
+    return ok;
+}
+
+static bool mysh_expand_word(mysh_resource* shell, const char* word, mysh_string* out) {
+    return mysh_expand_word_as(shell, word, out, false);
+}
+
+// "$@" expands to one word per positional parameter
+static bool mysh_is_splice_word(const char* word) {
+    return word[0] == MYSH_CTL_VAR && word[1] == '@' && word[2] == MYSH_CTL_VAR && word[3] == '\0';
+}
+
+// returns NULL if a word could not be expanded
+static char** mysh_expand_words(mysh_resource* shell, char** words, int num, int* expanded_num) {
+    int capacity = num + 1;
+    int size = 0;
+    char** ret = (char**)malloc(sizeof(char*) * capacity);
+    if (ret == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mysh_string buf = { NULL, 0, 0, { 0 } };
+    for (int i = 0; i < num; ++i) {
+        if (mysh_is_splice_word(words[i])) {
+            mysh_scope* pos = mysh_positional_scope(shell->scope);
+            int n = (pos != NULL ? pos->argc - 1 : 0);
+
+            capacity += n;
+            ret = (char**)realloc(ret, sizeof(char*) * capacity);
+            if (ret == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+
+            for (int j = 1; j <= n; ++j) {
+                ret[size++] = strdup(pos->argv[j]);
+            }
+            continue;
+        }
+
+        if (!mysh_expand_word_as(shell, words[i], &buf, true)) {
+            for (int j = 0; j < size; ++j) {
+                free(ret[j]);
+            }
+            free(ret);
+            ms_relase(&buf);
+            return NULL;
+        }
+
+        int num_paths = 0;
+        char** paths = (mysh_has_glob(buf.ptr) ? mysh_glob(buf.ptr, &num_paths) : NULL);
+        if (paths == NULL) {
+            // a pattern without matches is left as it is
+            mysh_unescape_glob(buf.ptr);
+            buf.length = strlen(buf.ptr);
+            ret[size++] = ms_into_chars(&buf);
+            continue;
+        }
+
+        capacity += num_paths - 1;
+        ret = (char**)realloc(ret, sizeof(char*) * capacity);
+        if (ret == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(ret + size, paths, sizeof(char*) * num_paths);
+        size += num_paths;
+        free(paths);
+    }
+
+    ms_relase(&buf);
+
+    ret[size] = NULL;
+    *expanded_num = size;
+
+    return ret;
+}
+
+static int mysh_count_assignments(char** words, int num) {
+    int i = 0;
+    for (; i < num; ++i) {
+        const char* eq = strchr(words[i], '=');
+        if (eq == NULL || !mysh_is_var_name(words[i], eq - words[i])) {
+            break;
+        }
+    }
+
+    return i;
+}
+
+// creates a runnable copy of `tmpl` (without its successors) with all words expanded.
+// returns NULL if an expansion failed
+static mysh_process* mysh_expand_process(mysh_resource* shell, mysh_process* tmpl) {
+    mysh_process* proc = mysh_new_process();
+    proc->kind = tmpl->kind;
+
+    if (tmpl->name != NULL) {
+        proc->name = strdup(tmpl->name);
+    }
+    if (tmpl->body != NULL) {
+        proc->body = mysh_retain_list(tmpl->body);
+    }
+
+    int first_subst = shell->num_subst_fds;
+    bool ok = true;
+
+    if (tmpl->argv != NULL) {
+        int num_assigns = mysh_count_assignments(tmpl->argv, tmpl->argc);
+        int num_rest = 0;
+        char** rest = mysh_expand_words(shell, tmpl->argv + num_assigns, tmpl->argc - num_assigns, &num_rest);
+        ok = (rest != NULL);
+
+        proc->argv = (char**)malloc(sizeof(char*) * (num_assigns + num_rest + 1));
+        if (proc->argv == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // nothing is expanded after a failed word
+        mysh_string buf = { NULL, 0, 0, { 0 } };
+        for (int i = 0; i < num_assigns; ++i) {
+            ok = ok && mysh_expand_word(shell, tmpl->argv[i], &buf);
+            proc->argv[i] = (ok ? ms_into_chars(&buf) : NULL);
+        }
+        ms_relase(&buf);
+
+        proc->argv[num_assigns] = NULL;
+        if (rest != NULL) {
+            memcpy(proc->argv + num_assigns, rest, sizeof(char*) * (num_rest + 1));
+            free(rest);
+        }
+
+        proc->argc = num_assigns + num_rest;
+        proc->num_assigns = num_assigns;
+    }
+
+    if (tmpl->num_redirects > 0) {
+        proc->redirects = (mysh_redirect_data*)malloc(sizeof(mysh_redirect_data) * tmpl->num_redirects);
+        if (proc->redirects == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < tmpl->num_redirects; ++i) {
+            proc->redirects[i] = tmpl->redirects[i];
+            proc->redirects[i].filename = ms_new();
+            if (ok && !ms_is_empty(tmpl->redirects[i].filename)) {
+                ok = mysh_expand_word(shell, tmpl->redirects[i].filename->ptr, proc->redirects[i].filename);
+            }
+        }
+        proc->num_redirects = tmpl->num_redirects;
+    }
+
+    // process substitutions started while expanding this process
+    if (shell->num_subst_fds > first_subst) {
+        proc->num_subst_fds = shell->num_subst_fds - first_subst;
+        proc->subst_fds = (int*)malloc(sizeof(int) * proc->num_subst_fds);
+        if (proc->subst_fds == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(proc->subst_fds, shell->subst_fds + first_subst, sizeof(int) * proc->num_subst_fds);
+    }
+
+    if (!ok) {
+        mysh_release_subst_fds(shell, proc);
+        mysh_release_process(proc);
+        return NULL;
+    }
+
+    return proc;
+}
+
+// returns NULL if an expansion failed, and none of the pipeline runs
+static mysh_process* mysh_expand_pipeline(mysh_resource* shell, mysh_process* tmpl) {
+    mysh_process* top = NULL;
+    mysh_process* tail = NULL;
+    for (; tmpl != NULL; tmpl = tmpl->next) {
+        mysh_process* proc = mysh_expand_process(shell, tmpl);
+        if (proc == NULL) {
+            for (mysh_process* done = top; done != NULL; done = done->next) {
+                mysh_release_subst_fds(shell, done);
+            }
+            if (top != NULL) {
+                mysh_release_process(top);
+            }
+            return NULL;
+        }
+
+        if (top == NULL) {
+            top = proc;
+        }
+        else {
+            tail->next = proc;
+        }
+        tail = proc;
+    }
+
+    return top;
+}
+
+#endif // MYSH_EXPAND_H
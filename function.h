@@ -0,0 +1,94 @@
+#ifndef MYSH_FUNCTION_H
+#define MYSH_FUNCTION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "variable.h"
+#include "process.h"
+#include "shell_resource.h"
+
+#define MYSH_FUNCTION_BUCKETS (64)
+
+typedef struct mysh_function_tag {
+    struct mysh_function_tag* next;
+    char* name;
+    mysh_command_list* body;
+} mysh_function;
+
+typedef struct {
+    mysh_function* buckets[MYSH_FUNCTION_BUCKETS];
+} mysh_function_table;
+
+static mysh_function* mysh_find_function(mysh_resource* shell, const char* name) {
+    mysh_function_table* table = (mysh_function_table*)shell->functions;
+    if (table == NULL) {
+        return NULL;
+    }
+
+    uint32_t h = mysh_hash_name(name) % MYSH_FUNCTION_BUCKETS;
+    for (mysh_function* fn = table->buckets[h]; fn != NULL; fn = fn->next) {
+        if (strcmp(fn->name, name) == 0) {
+            return fn;
+        }
+    }
+
+    return NULL;
+}
+
+// the table shares `body` with the parsed command
+static void mysh_define_function(mysh_resource* shell, const char* name, mysh_command_list* body) {
+    if (shell->functions == NULL) {
+        shell->functions = calloc(1, sizeof(mysh_function_table));
+        if (shell->functions == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    mysh_retain_list(body);
+
+    mysh_function* fn = mysh_find_function(shell, name);
+    if (fn != NULL) {
+        mysh_release_list(fn->body);
+        fn->body = body;
+        return;
+    }
+
+    fn = (mysh_function*)malloc(sizeof(mysh_function));
+    if (fn == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mysh_function_table* table = (mysh_function_table*)shell->functions;
+    uint32_t h = mysh_hash_name(name) % MYSH_FUNCTION_BUCKETS;
+    fn->name = strdup(name);
+    fn->body = body;
+    fn->next = table->buckets[h];
+    table->buckets[h] = fn;
+}
+
+static void mysh_release_functions(mysh_resource* shell) {
+    mysh_function_table* table = (mysh_function_table*)shell->functions;
+    if (table == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < MYSH_FUNCTION_BUCKETS; ++i) {
+        mysh_function* fn = table->buckets[i];
+        while (fn != NULL) {
+            mysh_function* next = fn->next;
+            free(fn->name);
+            mysh_release_list(fn->body);
+            free(fn);
+            fn = next;
+        }
+    }
+
+    free(table);
+    shell->functions = NULL;
+}
+
+#endif // MYSH_FUNCTION_H
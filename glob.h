@@ -0,0 +1,803 @@
+#ifndef MYSH_GLOB_H
+#define MYSH_GLOB_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "mystring.h"
+#include "variable.h"
+#include "tokenizer.h"
+
+#define MYSH_GLOB_DIRENT_BUFFER (64 * 1024)
+#define MYSH_DIR_CACHE_BUCKETS (256)
+#define MYSH_DIR_CACHE_MAX (4096)
+#define MYSH_PATTERN_CACHE_SIZE (64)
+#define MYSH_GLOB_MAX_THREADS (4)
+
+// ---- compiled patterns ----
+
+typedef enum {
+    glob_literal,
+    glob_any,
+    glob_star,
+    glob_class
+} mysh_glob_op;
+
+typedef struct {
+    mysh_glob_op op;
+    char c;
+    uint32_t set[8];
+} mysh_glob_element;
+
+// one path component of a pattern
+typedef struct {
+    mysh_glob_element* elements;
+    int num_elements;
+    // the component without escapes if it has no wildcard
+    char* literal;
+    bool is_globstar;
+    bool matches_dot;
+} mysh_glob_segment;
+
+typedef struct {
+    char* source;
+    mysh_glob_segment* segments;
+    int num_segments;
+    bool is_absolute;
+    bool dirs_only;
+} mysh_glob_pattern;
+
+static void mysh_glob_set_bit(uint32_t* set, unsigned char c) {
+    set[c >> 5] |= (1u << (c & 31));
+}
+
+static bool mysh_glob_test_bit(const uint32_t* set, unsigned char c) {
+    return (set[c >> 5] >> (c & 31)) & 1;
+}
+
+// parses `[...]` starting at `p` (on '['). returns the position after ']' or NULL if unterminated
+static const char* mysh_compile_class(const char* p, const char* end, mysh_glob_element* el) {
+    memset(el->set, 0, sizeof(el->set));
+    el->op = glob_class;
+
+    const char* q = p + 1;
+    bool negate = (q < end && (*q == '!' || *q == '^'));
+    if (negate) {
+        ++q;
+    }
+
+    bool first = true;
+    while (q < end && (*q != ']' || first)) {
+        first = false;
+
+        unsigned char lo = (unsigned char)*q;
+        if (lo == (unsigned char)MYSH_CTL_ESC && q + 1 < end) {
+            lo = (unsigned char)*++q;
+        }
+        ++q;
+
+        if (q + 1 < end && *q == '-' && q[1] != ']') {
+            unsigned char hi = (unsigned char)q[1];
+            if (hi == (unsigned char)MYSH_CTL_ESC && q + 2 < end) {
+                hi = (unsigned char)q[2];
+                ++q;
+            }
+            q += 2;
+
+            for (unsigned c = lo; c <= hi; ++c) {
+                mysh_glob_set_bit(el->set, (unsigned char)c);
+            }
+        }
+        else {
+            mysh_glob_set_bit(el->set, lo);
+        }
+    }
+
+    if (q >= end) {
+        return NULL;
+    }
+
+    if (negate) {
+        for (int i = 0; i < 8; ++i) {
+            el->set[i] = ~el->set[i];
+        }
+        // never match '/'
+        el->set['/' >> 5] &= ~(1u << ('/' & 31));
+    }
+
+    return q + 1;
+}
+
+static void mysh_compile_segment(const char* begin, const char* end, mysh_glob_segment* seg) {
+    seg->elements = (mysh_glob_element*)malloc(sizeof(mysh_glob_element) * (end - begin + 1));
+    if (seg->elements == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    seg->num_elements = 0;
+    seg->literal = NULL;
+    seg->is_globstar = (end - begin == 2 && begin[0] == '*' && begin[1] == '*');
+    seg->matches_dot = false;
+
+    mysh_string literal = { NULL, 0, 0, { 0 } };
+    ms_init(&literal, "");
+    bool has_wildcard = false;
+
+    for (const char* p = begin; p < end;) {
+        mysh_glob_element* el = &seg->elements[seg->num_elements];
+
+        if (*p == MYSH_CTL_ESC && p + 1 < end) {
+            el->op = glob_literal;
+            el->c = p[1];
+            p += 2;
+        }
+        else if (*p == '*') {
+            // consecutive stars are the same as one
+            if (seg->num_elements > 0 && seg->elements[seg->num_elements - 1].op == glob_star) {
+                ++p;
+                continue;
+            }
+            el->op = glob_star;
+            ++p;
+        }
+        else if (*p == '?') {
+            el->op = glob_any;
+            ++p;
+        }
+        else if (*p == '[') {
+            const char* next = mysh_compile_class(p, end, el);
+            if (next != NULL) {
+                p = next;
+            }
+            else {
+                el->op = glob_literal;
+                el->c = '[';
+                ++p;
+            }
+        }
+        else {
+            el->op = glob_literal;
+            el->c = *p;
+            ++p;
+        }
+
+        if (el->op == glob_literal) {
+            ms_push(&literal, el->c);
+        }
+        else {
+            has_wildcard = true;
+        }
+        ++seg->num_elements;
+    }
+
+    // a leading '.' must be matched explicitly
+    seg->matches_dot = (seg->num_elements > 0 && seg->elements[0].op == glob_literal && seg->elements[0].c == '.');
+
+    if (!has_wildcard) {
+        seg->literal = ms_into_chars(&literal);
+    }
+    ms_relase(&literal);
+}
+
+static mysh_glob_pattern* mysh_compile_pattern(const char* source) {
+    mysh_glob_pattern* pat = (mysh_glob_pattern*)calloc(1, sizeof(mysh_glob_pattern));
+    if (pat == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pat->source = strdup(source);
+    pat->is_absolute = (source[0] == '/');
+
+    size_t len = strlen(source);
+    pat->dirs_only = (len > 0 && source[len - 1] == '/');
+
+    int capacity = 1;
+    for (const char* p = source; *p != '\0'; ++p) {
+        capacity += (*p == '/');
+    }
+    pat->segments = (mysh_glob_segment*)malloc(sizeof(mysh_glob_segment) * capacity);
+    if (pat->segments == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char* p = source;
+    while (*p != '\0') {
+        while (*p == '/') {
+            ++p;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        const char* end = p;
+        while (*end != '\0' && *end != '/') {
+            ++end;
+        }
+
+        mysh_compile_segment(p, end, &pat->segments[pat->num_segments++]);
+        p = end;
+    }
+
+    return pat;
+}
+
+static void mysh_release_pattern(mysh_glob_pattern* pat) {
+    for (int i = 0; i < pat->num_segments; ++i) {
+        free(pat->segments[i].elements);
+        free(pat->segments[i].literal);
+    }
+
+    free(pat->segments);
+    free(pat->source);
+    free(pat);
+}
+
+static bool mysh_match_element(const mysh_glob_element* el, char c) {
+    switch (el->op) {
+    case glob_literal:
+        return el->c == c;
+    case glob_any:
+        return true;
+    case glob_class:
+        return mysh_glob_test_bit(el->set, (unsigned char)c);
+    default:
+        return false;
+    }
+}
+
+static bool mysh_match_segment(const mysh_glob_segment* seg, const char* name) {
+    if (name[0] == '.' && !seg->matches_dot) {
+        return false;
+    }
+
+    // iterative matching which backtracks to the last star only
+    int e = 0;
+    const char* s = name;
+    int star_e = -1;
+    const char* star_s = NULL;
+
+    while (*s != '\0') {
+        if (e < seg->num_elements && seg->elements[e].op == glob_star) {
+            star_e = e++;
+            star_s = s;
+        }
+        else if (e < seg->num_elements && mysh_match_element(&seg->elements[e], *s)) {
+            ++e;
+            ++s;
+        }
+        else if (star_e >= 0) {
+            e = star_e + 1;
+            s = ++star_s;
+        }
+        else {
+            return false;
+        }
+    }
+
+    while (e < seg->num_elements && seg->elements[e].op == glob_star) {
+        ++e;
+    }
+
+    return e == seg->num_elements;
+}
+
+// patterns are compiled once and reused, e.g. by a loop or a function called many times
+static mysh_glob_pattern* mysh_pattern_cache[MYSH_PATTERN_CACHE_SIZE];
+
+static mysh_glob_pattern* mysh_get_pattern(const char* source) {
+    uint32_t h = mysh_hash_name(source) % MYSH_PATTERN_CACHE_SIZE;
+    mysh_glob_pattern* pat = mysh_pattern_cache[h];
+    if (pat != NULL && strcmp(pat->source, source) == 0) {
+        return pat;
+    }
+
+    if (pat != NULL) {
+        mysh_release_pattern(pat);
+    }
+
+    pat = mysh_compile_pattern(source);
+    mysh_pattern_cache[h] = pat;
+
+    return pat;
+}
+
+// ---- directory listings ----
+
+typedef struct {
+    const char* name;
+    unsigned char type;
+} mysh_dir_entry;
+
+typedef struct mysh_dir_listing_tag {
+    struct mysh_dir_listing_tag* next;
+    char* path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+
+    mysh_dir_entry* entries;
+    int num_entries;
+    char* names;
+
+    // the cache holds one reference while the listing is in it
+    int refcount;
+} mysh_dir_listing;
+
+static struct {
+    pthread_mutex_t lock;
+    mysh_dir_listing* buckets[MYSH_DIR_CACHE_BUCKETS];
+    int size;
+} mysh_dir_cache = { PTHREAD_MUTEX_INITIALIZER, { NULL }, 0 };
+
+static void mysh_release_listing(mysh_dir_listing* listing) {
+    pthread_mutex_lock(&mysh_dir_cache.lock);
+    int refcount = --listing->refcount;
+    pthread_mutex_unlock(&mysh_dir_cache.lock);
+
+    if (refcount == 0) {
+        free(listing->path);
+        free(listing->entries);
+        free(listing->names);
+        free(listing);
+    }
+}
+
+struct mysh_linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static mysh_dir_listing* mysh_read_listing(int fd, const char* path, const struct stat* st) {
+    mysh_dir_listing* listing = (mysh_dir_listing*)calloc(1, sizeof(mysh_dir_listing));
+    char* buf = (char*)malloc(MYSH_GLOB_DIRENT_BUFFER);
+    if (listing == NULL || buf == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    listing->path = strdup(path);
+    listing->dev = st->st_dev;
+    listing->ino = st->st_ino;
+    listing->mtime = st->st_mtim;
+    listing->refcount = 1;
+
+    size_t names_len = 0, names_cap = 0;
+    int entries_cap = 0;
+    size_t* offsets = NULL;
+
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buf, MYSH_GLOB_DIRENT_BUFFER);
+        if (n <= 0) {
+            break;
+        }
+
+        for (long pos = 0; pos < n;) {
+            struct mysh_linux_dirent64* d = (struct mysh_linux_dirent64*)(buf + pos);
+            pos += d->d_reclen;
+
+            if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+                continue;
+            }
+
+            size_t len = strlen(d->d_name) + 1;
+            if (names_len + len > names_cap) {
+                names_cap = (names_cap == 0 ? 4096 : names_cap * 2) + len;
+                listing->names = (char*)realloc(listing->names, names_cap);
+            }
+            if (listing->num_entries == entries_cap) {
+                entries_cap = (entries_cap == 0 ? 64 : entries_cap * 2);
+                listing->entries = (mysh_dir_entry*)realloc(listing->entries, sizeof(mysh_dir_entry) * entries_cap);
+                offsets = (size_t*)realloc(offsets, sizeof(size_t) * entries_cap);
+            }
+            if (listing->names == NULL || listing->entries == NULL || offsets == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+
+            memcpy(listing->names + names_len, d->d_name, len);
+            offsets[listing->num_entries] = names_len;
+            listing->entries[listing->num_entries].type = d->d_type;
+            ++listing->num_entries;
+            names_len += len;
+        }
+    }
+
+    // names may have moved while growing
+    for (int i = 0; i < listing->num_entries; ++i) {
+        listing->entries[i].name = listing->names + offsets[i];
+    }
+
+    free(offsets);
+    free(buf);
+
+    return listing;
+}
+
+// returns the entries of `path`, from the cache unless the directory changed since it was read.
+// the caller releases the listing with mysh_release_listing()
+static mysh_dir_listing* mysh_get_listing(const char* path) {
+    int fd = open(path[0] == '\0' ? "." : path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint32_t h = mysh_hash_name(path) % MYSH_DIR_CACHE_BUCKETS;
+
+    pthread_mutex_lock(&mysh_dir_cache.lock);
+    mysh_dir_listing** link = &mysh_dir_cache.buckets[h];
+    for (; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->path, path) == 0) {
+            break;
+        }
+    }
+
+    mysh_dir_listing* cached = *link;
+    if (cached != NULL) {
+        if (cached->dev == st.st_dev && cached->ino == st.st_ino
+            && cached->mtime.tv_sec == st.st_mtim.tv_sec && cached->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+            ++cached->refcount;
+            pthread_mutex_unlock(&mysh_dir_cache.lock);
+            close(fd);
+            return cached;
+        }
+
+        // stale
+        *link = cached->next;
+        --mysh_dir_cache.size;
+    }
+    pthread_mutex_unlock(&mysh_dir_cache.lock);
+
+    if (cached != NULL) {
+        mysh_release_listing(cached);
+    }
+
+    mysh_dir_listing* listing = mysh_read_listing(fd, path, &st);
+    close(fd);
+
+    pthread_mutex_lock(&mysh_dir_cache.lock);
+    if (mysh_dir_cache.size < MYSH_DIR_CACHE_MAX) {
+        ++listing->refcount;
+        listing->next = mysh_dir_cache.buckets[h];
+        mysh_dir_cache.buckets[h] = listing;
+        ++mysh_dir_cache.size;
+    }
+    pthread_mutex_unlock(&mysh_dir_cache.lock);
+
+    return listing;
+}
+
+// ---- matching ----
+
+typedef struct {
+    pthread_mutex_t lock;
+    char** paths;
+    int size;
+    int capacity;
+} mysh_glob_result;
+
+static void mysh_glob_add(mysh_glob_result* result, const char* path, bool add_slash) {
+    size_t len = strlen(path);
+    char* copy = (char*)malloc(len + 2);
+    if (copy == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(copy, path, len + 1);
+    if (add_slash) {
+        copy[len] = '/';
+        copy[len + 1] = '\0';
+    }
+
+    pthread_mutex_lock(&result->lock);
+    if (result->size == result->capacity) {
+        result->capacity = (result->capacity == 0 ? 16 : result->capacity * 2);
+        result->paths = (char**)realloc(result->paths, sizeof(char*) * result->capacity);
+        if (result->paths == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    result->paths[result->size++] = copy;
+    pthread_mutex_unlock(&result->lock);
+}
+
+static void mysh_join_path(mysh_string* out, const char* dir, const char* name) {
+    ms_assign_raw(out, dir);
+    if (out->length > 0 && out->ptr[out->length - 1] != '/') {
+        ms_push(out, '/');
+    }
+    ms_append_raw(out, name);
+}
+
+static bool mysh_is_dir_entry(const char* path, unsigned char type) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_UNKNOWN && type != DT_LNK) {
+        return false;
+    }
+
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void mysh_glob_walk(const mysh_glob_pattern* pat, int seg_idx, const char* dir, mysh_glob_result* result);
+
+// matches segments [seg_idx, end) of `pat` below `dir`
+static void mysh_glob_match_from(const mysh_glob_pattern* pat, int seg_idx, const char* dir, mysh_glob_result* result) {
+    if (seg_idx == pat->num_segments) {
+        if (dir[0] != '\0') {
+            mysh_glob_add(result, dir, pat->dirs_only && dir[strlen(dir) - 1] != '/');
+        }
+        return;
+    }
+
+    const mysh_glob_segment* seg = &pat->segments[seg_idx];
+    bool is_last = (seg_idx + 1 == pat->num_segments);
+
+    if (seg->is_globstar) {
+        mysh_glob_walk(pat, seg_idx, dir, result);
+        return;
+    }
+
+    mysh_string path = { NULL, 0, 0, { 0 } };
+
+    if (seg->literal != NULL) {
+        // no need to list the directory
+        mysh_join_path(&path, dir, seg->literal);
+
+        struct stat st;
+        if (is_last && !pat->dirs_only) {
+            if (lstat(path.ptr, &st) == 0) {
+                mysh_glob_add(result, path.ptr, false);
+            }
+        }
+        else if (stat(path.ptr, &st) == 0 && S_ISDIR(st.st_mode)) {
+            mysh_glob_match_from(pat, seg_idx + 1, path.ptr, result);
+        }
+
+        ms_relase(&path);
+        return;
+    }
+
+    mysh_dir_listing* listing = mysh_get_listing(dir);
+    if (listing == NULL) {
+        return;
+    }
+
+    for (int i = 0; i < listing->num_entries; ++i) {
+        const mysh_dir_entry* ent = &listing->entries[i];
+        if (!mysh_match_segment(seg, ent->name)) {
+            continue;
+        }
+
+        mysh_join_path(&path, dir, ent->name);
+        if (is_last && !pat->dirs_only) {
+            mysh_glob_add(result, path.ptr, false);
+        }
+        else if (mysh_is_dir_entry(path.ptr, ent->type)) {
+            mysh_glob_match_from(pat, seg_idx + 1, path.ptr, result);
+        }
+    }
+
+    mysh_release_listing(listing);
+    ms_relase(&path);
+}
+
+// ---- `**` walking ----
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char** dirs;
+    int size;
+    int capacity;
+    // directories popped but not finished yet
+    int busy;
+
+    const mysh_glob_pattern* pat;
+    int seg_idx;
+    mysh_glob_result* result;
+} mysh_glob_walker;
+
+static void mysh_walker_push(mysh_glob_walker* walker, char* dir) {
+    pthread_mutex_lock(&walker->lock);
+    if (walker->size == walker->capacity) {
+        walker->capacity = (walker->capacity == 0 ? 64 : walker->capacity * 2);
+        walker->dirs = (char**)realloc(walker->dirs, sizeof(char*) * walker->capacity);
+        if (walker->dirs == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    walker->dirs[walker->size++] = dir;
+    pthread_cond_signal(&walker->cond);
+    pthread_mutex_unlock(&walker->lock);
+}
+
+// one directory of a `**` walk: matches the rest of the pattern here and queues subdirectories
+static void mysh_walker_visit(mysh_glob_walker* walker, const char* dir) {
+    const mysh_glob_pattern* pat = walker->pat;
+    bool is_last = (walker->seg_idx + 1 == pat->num_segments);
+
+    if (!is_last) {
+        mysh_glob_match_from(pat, walker->seg_idx + 1, dir, walker->result);
+    }
+
+    mysh_dir_listing* listing = mysh_get_listing(dir);
+    if (listing == NULL) {
+        return;
+    }
+
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    for (int i = 0; i < listing->num_entries; ++i) {
+        const mysh_dir_entry* ent = &listing->entries[i];
+        if (ent->name[0] == '.') {
+            continue;
+        }
+
+        mysh_join_path(&path, dir, ent->name);
+
+        // symlinks are not followed to avoid cycles
+        bool is_dir = (ent->type == DT_DIR);
+        if (ent->type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = (lstat(path.ptr, &st) == 0 && S_ISDIR(st.st_mode));
+        }
+
+        if (is_last && (!pat->dirs_only || is_dir)) {
+            mysh_glob_add(walker->result, path.ptr, pat->dirs_only);
+        }
+        if (is_dir) {
+            mysh_walker_push(walker, strdup(path.ptr));
+        }
+    }
+
+    ms_relase(&path);
+    mysh_release_listing(listing);
+}
+
+static void* mysh_walker_main(void* arg) {
+    mysh_glob_walker* walker = (mysh_glob_walker*)arg;
+
+    pthread_mutex_lock(&walker->lock);
+    while (true) {
+        while (walker->size == 0 && walker->busy > 0) {
+            pthread_cond_wait(&walker->cond, &walker->lock);
+        }
+        if (walker->size == 0) {
+            break;
+        }
+
+        char* dir = walker->dirs[--walker->size];
+        ++walker->busy;
+        pthread_mutex_unlock(&walker->lock);
+
+        mysh_walker_visit(walker, dir);
+        free(dir);
+
+        pthread_mutex_lock(&walker->lock);
+        if (--walker->busy == 0 && walker->size == 0) {
+            pthread_cond_broadcast(&walker->cond);
+        }
+    }
+    pthread_mutex_unlock(&walker->lock);
+
+    return NULL;
+}
+
+// `**` matches `dir` and every directory below it; they are visited by a few threads
+static void mysh_glob_walk(const mysh_glob_pattern* pat, int seg_idx, const char* dir, mysh_glob_result* result) {
+    mysh_glob_walker walker;
+    pthread_mutex_init(&walker.lock, NULL);
+    pthread_cond_init(&walker.cond, NULL);
+    walker.dirs = NULL;
+    walker.size = 0;
+    walker.capacity = 0;
+    walker.busy = 0;
+    walker.pat = pat;
+    walker.seg_idx = seg_idx;
+    walker.result = result;
+
+    mysh_walker_push(&walker, strdup(dir));
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int num_threads = (num_cpus < 1 ? 1 : (num_cpus > MYSH_GLOB_MAX_THREADS ? MYSH_GLOB_MAX_THREADS : (int)num_cpus));
+
+    pthread_t threads[MYSH_GLOB_MAX_THREADS];
+    int started = 0;
+    for (int i = 1; i < num_threads; ++i) {
+        if (pthread_create(&threads[started], NULL, mysh_walker_main, &walker) == 0) {
+            ++started;
+        }
+    }
+
+    // the calling thread works as well
+    mysh_walker_main(&walker);
+
+    for (int i = 0; i < started; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(walker.dirs);
+    pthread_cond_destroy(&walker.cond);
+    pthread_mutex_destroy(&walker.lock);
+}
+
+static int mysh_compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// whether `word` (as produced by mysh_expand_word_as() with `as_pattern`, see mysh_escape_glob()) has an unquoted wildcard
+static bool mysh_has_glob(const char* word) {
+    for (const char* p = word; *p != '\0'; ++p) {
+        if (*p == MYSH_CTL_ESC) {
+            if (*++p == '\0') {
+                break;
+            }
+        }
+        else if (mysh_is_glob_char(*p)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// removes MYSH_CTL_ESC from `word` in place
+static void mysh_unescape_glob(char* word) {
+    char* dst = word;
+    for (char* p = word; *p != '\0'; ++p) {
+        if (*p == MYSH_CTL_ESC && p[1] != '\0') {
+            ++p;
+        }
+        *dst++ = *p;
+    }
+    *dst = '\0';
+}
+
+// returns the sorted paths matching `pattern`, or NULL if nothing matched
+static char** mysh_glob(const char* pattern, int* num_paths) {
+    mysh_glob_pattern* pat = mysh_get_pattern(pattern);
+
+    mysh_glob_result result;
+    pthread_mutex_init(&result.lock, NULL);
+    result.paths = NULL;
+    result.size = 0;
+    result.capacity = 0;
+
+    mysh_glob_match_from(pat, 0, pat->is_absolute ? "/" : "", &result);
+    pthread_mutex_destroy(&result.lock);
+
+    *num_paths = result.size;
+    if (result.size == 0) {
+        return NULL;
+    }
+
+    qsort(result.paths, result.size, sizeof(char*), mysh_compare_paths);
+    return result.paths;
+}
+
+#endif // MYSH_GLOB_H
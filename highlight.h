@@ -0,0 +1,413 @@
+#ifndef MYSH_HIGHLIGHT_H
+#define MYSH_HIGHLIGHT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "mystring.h"
+#include "tokenizer.h"
+#include "variable.h"
+#include "shell_resource.h"
+#include "builtins.h"
+#include "function.h"
+
+// syntax highlighting of the line being edited. the tokens of the line are kept as spans and
+// an edit only re-lexes from the token it touched up to the first old token which lexes the same,
+// so a keystroke in a long line costs about one token. command names are looked up in an index of
+// $PATH which is checked once per prompt, never per keystroke
+
+typedef enum {
+    highlight_plain,
+    highlight_command,
+    highlight_unknown,
+    highlight_string,
+    highlight_operator,
+    highlight_redirect
+} mysh_highlight_color;
+
+static const char* mysh_highlight_escapes[] = {
+    "",
+    "\x1b[1;32m",
+    "\x1b[1;31m",
+    "\x1b[33m",
+    "\x1b[36m",
+    "\x1b[36m"
+};
+
+typedef struct {
+    int begin;
+    int end;
+    // before the token, which is where re-lexing can start
+    mysh_lex_state state;
+    mysh_highlight_color color;
+} mysh_span;
+
+typedef struct {
+    bool is_enabled;
+    mysh_span* spans;
+    int num_spans;
+    int capacity;
+    // after the last span
+    mysh_lex_state end_state;
+
+    // text changed since the last update: [dirty_from, dirty_to) in the current line,
+    // `delta` is how much longer the line got
+    bool is_dirty;
+    int dirty_from;
+    int dirty_to;
+    int delta;
+} mysh_highlighter;
+
+// command names in the directories of $PATH, as an open addressing set
+static struct {
+    char** names;
+    size_t capacity;
+    size_t size;
+    // what the set was built from
+    char* path;
+    struct timespec* mtimes;
+    int num_dirs;
+} mysh_path_index = { NULL, 0, 0, NULL, NULL, 0 };
+
+static bool mysh_path_index_contains(const char* name) {
+    if (mysh_path_index.size == 0) {
+        return false;
+    }
+
+    size_t mask = mysh_path_index.capacity - 1;
+    for (size_t i = mysh_hash_name(name) & mask; mysh_path_index.names[i] != NULL; i = (i + 1) & mask) {
+        if (strcmp(mysh_path_index.names[i], name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void mysh_path_index_insert(const char* name) {
+    if ((mysh_path_index.size + 1) * 2 > mysh_path_index.capacity) {
+        size_t capacity = (mysh_path_index.capacity == 0 ? 1024 : mysh_path_index.capacity * 2);
+        char** names = (char**)calloc(capacity, sizeof(char*));
+        if (names == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t i = 0; i < mysh_path_index.capacity; ++i) {
+            char* old = mysh_path_index.names[i];
+            if (old == NULL) {
+                continue;
+            }
+
+            size_t j = mysh_hash_name(old) & (capacity - 1);
+            while (names[j] != NULL) {
+                j = (j + 1) & (capacity - 1);
+            }
+            names[j] = old;
+        }
+
+        free(mysh_path_index.names);
+        mysh_path_index.names = names;
+        mysh_path_index.capacity = capacity;
+    }
+
+    size_t mask = mysh_path_index.capacity - 1;
+    size_t i = mysh_hash_name(name) & mask;
+    for (; mysh_path_index.names[i] != NULL; i = (i + 1) & mask) {
+        if (strcmp(mysh_path_index.names[i], name) == 0) {
+            return;
+        }
+    }
+
+    mysh_path_index.names[i] = strdup(name);
+    ++mysh_path_index.size;
+}
+
+static void mysh_clear_path_index() {
+    for (size_t i = 0; i < mysh_path_index.capacity; ++i) {
+        free(mysh_path_index.names[i]);
+    }
+    free(mysh_path_index.names);
+    free(mysh_path_index.path);
+    free(mysh_path_index.mtimes);
+
+    mysh_path_index.names = NULL;
+    mysh_path_index.capacity = 0;
+    mysh_path_index.size = 0;
+    mysh_path_index.path = NULL;
+    mysh_path_index.mtimes = NULL;
+    mysh_path_index.num_dirs = 0;
+}
+
+// calls `fn` with each directory of `path`, which is modified while doing so
+static void mysh_for_each_path_dir(char* path, void (*fn)(const char* dir, int index, void* ctx), void* ctx) {
+    int index = 0;
+    for (char* dir = path; dir != NULL; ++index) {
+        char* colon = strchr(dir, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+        }
+
+        // an empty entry is the working directory, whose commands need a `./` anyway
+        if (dir[0] != '\0') {
+            fn(dir, index, ctx);
+        }
+
+        if (colon != NULL) {
+            *colon = ':';
+        }
+        dir = (colon != NULL ? colon + 1 : NULL);
+    }
+}
+
+static void mysh_check_path_dir(const char* dir, int index, void* ctx) {
+    struct stat st;
+    if (stat(dir, &st) < 0) {
+        st.st_mtim.tv_sec = 0;
+        st.st_mtim.tv_nsec = 0;
+    }
+
+    struct timespec* old = &mysh_path_index.mtimes[index];
+    if (old->tv_sec != st.st_mtim.tv_sec || old->tv_nsec != st.st_mtim.tv_nsec) {
+        *old = st.st_mtim;
+        *(bool*)ctx = true;
+    }
+}
+
+// files are not stat()ed one by one, so a non-executable file in $PATH counts as a command
+static void mysh_scan_path_dir(const char* dir, int index, void* ctx) {
+    DIR* d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        if (entry->d_name[0] != '.' && entry->d_type != DT_DIR) {
+            mysh_path_index_insert(entry->d_name);
+        }
+    }
+
+    closedir(d);
+}
+
+// rebuilds the index if $PATH or one of its directories changed. called once per prompt
+static void mysh_refresh_path_index(mysh_resource* shell) {
+    const char* path = mysh_lookup_var(shell->scope, "PATH");
+    if (path == NULL) {
+        path = "";
+    }
+
+    bool is_changed = (mysh_path_index.path == NULL || strcmp(mysh_path_index.path, path) != 0);
+    if (is_changed) {
+        mysh_clear_path_index();
+        mysh_path_index.path = strdup(path);
+
+        int num_dirs = 1;
+        for (const char* p = path; *p != '\0'; ++p) {
+            num_dirs += (*p == ':');
+        }
+        mysh_path_index.mtimes = (struct timespec*)calloc(num_dirs, sizeof(struct timespec));
+        if (mysh_path_index.path == NULL || mysh_path_index.mtimes == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+        mysh_path_index.num_dirs = num_dirs;
+    }
+
+    mysh_for_each_path_dir(mysh_path_index.path, mysh_check_path_dir, &is_changed);
+    if (!is_changed) {
+        return;
+    }
+
+    for (size_t i = 0; i < mysh_path_index.capacity; ++i) {
+        free(mysh_path_index.names[i]);
+        mysh_path_index.names[i] = NULL;
+    }
+    mysh_path_index.size = 0;
+    mysh_for_each_path_dir(mysh_path_index.path, mysh_scan_path_dir, NULL);
+}
+
+static bool mysh_is_known_command(mysh_resource* shell, const char* name) {
+    return mysh_find_builtin(name) != NULL || mysh_find_function(shell, name) != NULL
+        || mysh_path_index_contains(name);
+}
+
+static mysh_highlight_color mysh_lexeme_color(mysh_resource* shell, const char* line, const mysh_lexeme* lex) {
+    switch (lex->kind) {
+    case lexeme_operator:
+        return highlight_operator;
+    case lexeme_redirect:
+        return highlight_redirect;
+    case lexeme_command:
+        break;
+    default:
+        return (lex->is_quoted ? highlight_string : highlight_plain);
+    }
+
+    // a path is not checked, which would take a stat() per keystroke
+    char name[256];
+    int len = lex->end - lex->begin;
+    if (lex->is_dynamic || len >= (int)sizeof(name) || memchr(line + lex->begin, '/', len) != NULL) {
+        return highlight_command;
+    }
+
+    memcpy(name, line + lex->begin, len);
+    name[len] = '\0';
+
+    return (mysh_is_known_command(shell, name) ? highlight_command : highlight_unknown);
+}
+
+static void mysh_push_span(mysh_span** spans, int* size, int* capacity, const mysh_span* span) {
+    if (*size == *capacity) {
+        *capacity = (*capacity == 0 ? 16 : *capacity * 2);
+        *spans = (mysh_span*)realloc(*spans, sizeof(mysh_span) * *capacity);
+        if (*spans == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    (*spans)[(*size)++] = *span;
+}
+
+static void mysh_init_highlighter(mysh_highlighter* hl, mysh_resource* shell) {
+    const char* enabled = mysh_lookup_var(shell->scope, "MYSH_HIGHLIGHT");
+    hl->is_enabled = (getenv("NO_COLOR") == NULL && (enabled == NULL || strcmp(enabled, "0") != 0));
+    hl->spans = NULL;
+    hl->num_spans = 0;
+    hl->capacity = 0;
+    hl->end_state.is_command = true;
+    hl->end_state.is_target = false;
+    hl->is_dirty = false;
+
+    if (hl->is_enabled) {
+        mysh_refresh_path_index(shell);
+    }
+}
+
+static void mysh_release_highlighter(mysh_highlighter* hl) {
+    free(hl->spans);
+    hl->spans = NULL;
+}
+
+// `removed` bytes at `from` were replaced with `inserted` bytes
+static void mysh_highlight_edit(mysh_highlighter* hl, int from, int removed, int inserted) {
+    if (!hl->is_dirty) {
+        hl->is_dirty = true;
+        hl->dirty_from = from;
+        hl->dirty_to = from + inserted;
+        hl->delta = inserted - removed;
+        return;
+    }
+
+    // the union of both changes, in positions of the current line
+    hl->dirty_to = (hl->dirty_to > from + removed ? hl->dirty_to + inserted - removed : from + inserted);
+    hl->dirty_from = (from < hl->dirty_from ? from : hl->dirty_from);
+    hl->delta += inserted - removed;
+}
+
+// brings the spans up to date with `line`
+static void mysh_highlight_update(mysh_resource* shell, mysh_highlighter* hl, const char* line, int len) {
+    if (!hl->is_enabled || !hl->is_dirty) {
+        return;
+    }
+    hl->is_dirty = false;
+
+    // the first token the edit may have changed. a word looks one byte past its end for `<(`,
+    // the ones before it end before that
+    int first = 0;
+    while (first < hl->num_spans && hl->spans[first].end + 1 < hl->dirty_from) {
+        ++first;
+    }
+
+    int pos = hl->dirty_from;
+    mysh_lex_state state = hl->end_state;
+    if (first < hl->num_spans) {
+        pos = (hl->spans[first].begin < pos ? hl->spans[first].begin : pos);
+        state = hl->spans[first].state;
+    }
+
+    mysh_span* spans = NULL;
+    int num_spans = 0;
+    int capacity = 0;
+    for (int i = 0; i < first; ++i) {
+        mysh_push_span(&spans, &num_spans, &capacity, &hl->spans[i]);
+    }
+
+    // past the edit, an old token which begins where a new one does in the same state lexes
+    // the same, and so does everything after it
+    int old = first;
+    bool is_stable = false;
+    mysh_lexeme lex;
+    mysh_lex_state before = state;
+    while (mysh_lex_next(line, len, &pos, &state, &lex)) {
+        if (lex.begin >= hl->dirty_to) {
+            while (old < hl->num_spans && hl->spans[old].begin + hl->delta < lex.begin) {
+                ++old;
+            }
+            if (old < hl->num_spans && hl->spans[old].begin + hl->delta == lex.begin
+                && mysh_lex_state_equal(hl->spans[old].state, before)) {
+                is_stable = true;
+                break;
+            }
+        }
+
+        mysh_span span = { lex.begin, lex.end, before, mysh_lexeme_color(shell, line, &lex) };
+        mysh_push_span(&spans, &num_spans, &capacity, &span);
+        before = state;
+    }
+
+    if (is_stable) {
+        for (int i = old; i < hl->num_spans; ++i) {
+            mysh_span span = hl->spans[i];
+            span.begin += hl->delta;
+            span.end += hl->delta;
+            mysh_push_span(&spans, &num_spans, &capacity, &span);
+        }
+    }
+    else {
+        hl->end_state = state;
+    }
+
+    free(hl->spans);
+    hl->spans = spans;
+    hl->num_spans = num_spans;
+    hl->capacity = capacity;
+}
+
+// appends line[from, to) to `out` with the colors of its tokens
+static void mysh_highlight_append(const mysh_highlighter* hl, mysh_string* out, const char* line, int from, int to) {
+    if (!hl->is_enabled) {
+        ms_append_n(out, line + from, to - from);
+        return;
+    }
+
+    int pos = from;
+    for (int i = 0; i < hl->num_spans && pos < to; ++i) {
+        const mysh_span* span = &hl->spans[i];
+        if (span->end <= pos || span->color == highlight_plain) {
+            continue;
+        }
+
+        int begin = (span->begin > pos ? span->begin : pos);
+        int end = (span->end < to ? span->end : to);
+        if (begin >= end) {
+            continue;
+        }
+
+        ms_append_n(out, line + pos, begin - pos);
+        ms_append_raw(out, mysh_highlight_escapes[span->color]);
+        ms_append_n(out, line + begin, end - begin);
+        ms_append_raw(out, "\x1b[0m");
+        pos = end;
+    }
+
+    ms_append_n(out, line + pos, to - pos);
+}
+
+#endif // MYSH_HIGHLIGHT_H
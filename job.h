@@ -7,17 +7,41 @@
 #include "shell_resource.h"
 #include "process.h"
 
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
 #include <termios.h>
 
+typedef struct mysh_ring_tag mysh_ring;
+typedef struct mysh_timer_tag mysh_timer;
+
 struct mysh_job_tag {
     struct mysh_job_tag* next;
     mysh_string command;
     mysh_process* first_proc;
     pid_t group_id;
     bool is_notified;
+    // a background job waiting for admission.h to start it
+    bool is_queued;
+    // running in the foreground, which the admission limit does not count
+    bool is_foreground;
+    // a process substitution, removed once it has exited, see subst.h
+    bool is_subst;
+    // runs in the process group of the shell without job control, like `$(...)`. it can read
+    // the terminal and ^C reaches it, while the shell waits for its output
+    bool is_in_shell_group;
+    // the cgroup leaf of the job, see cgroup.h. -1 without one
+    int cgroup_fd;
+    unsigned int cgroup_id;
+    // stdout and stderr of a background job under `capture on`, see joboutput.h
+    mysh_ring* output;
+    // of `timeout` and `every`, see timer.h
+    mysh_timer* timer;
     struct termios termios;
     int in_fd, out_fd, err_fd;
 };
@@ -32,10 +56,19 @@ static mysh_job* mysh_new_job() {
     }
 
     job->next = NULL;
+    job->command.ptr = NULL;
     ms_init(&job->command, "");
     job->first_proc = NULL;
     job->group_id = 0;
     job->is_notified = false;
+    job->is_queued = false;
+    job->is_foreground = false;
+    job->is_subst = false;
+    job->is_in_shell_group = false;
+    job->cgroup_fd = -1;
+    job->cgroup_id = 0;
+    job->output = NULL;
+    job->timer = NULL;
     job->in_fd = -1;
     job->out_fd = -1;
     job->err_fd = -1;
@@ -43,13 +76,85 @@ static mysh_job* mysh_new_job() {
     return job;
 }
 
+// defined in cgroup.h
+static void mysh_cgroup_prepare(mysh_job* job);
+static void mysh_cgroup_attach(mysh_job* job, pid_t pid);
+static void mysh_cgroup_release(mysh_job* job);
+static bool mysh_cgroup_freeze(mysh_job* job, bool is_frozen);
+static bool mysh_cgroup_kill(mysh_job* job);
+static bool mysh_cgroup_usage(mysh_job* job, char* buf, size_t size);
+
+// defined in joboutput.h
+static void mysh_start_job_output(mysh_resource* shell, mysh_job* job);
+static void mysh_job_output_launched(mysh_job* job);
+static void mysh_release_job_output(mysh_job* job);
+static int mysh_job_output_fds(mysh_resource* shell, struct pollfd* fds);
+static void mysh_service_job_output(mysh_resource* shell, struct pollfd* fds, int n);
+
+// defined in timer.h
+static void mysh_release_job_timer(mysh_job* job);
+static int mysh_job_timer_fds(mysh_resource* shell, struct pollfd* fds);
+static void mysh_service_job_timers(mysh_resource* shell, struct pollfd* fds, int n);
+static bool mysh_cancel_periodic(mysh_job* job);
+
+// defined in admission.h
+static int mysh_sched_fds(mysh_resource* shell, struct pollfd* fds);
+static bool mysh_service_sched(mysh_resource* shell, struct pollfd* fds, int n);
+
 static void mysh_release_job(mysh_job* job) {
-    mysh_release_process(job->first_proc);
+    mysh_cgroup_release(job);
+    mysh_release_job_output(job);
+    mysh_release_job_timer(job);
+    if (job->first_proc != NULL) {
+        mysh_release_process(job->first_proc);
+    }
+    ms_relase(&job->command);
     free(job);
 }
 
+// appends a new job to the job list of `shell`
+static mysh_job* mysh_add_job(mysh_resource* shell) {
+    mysh_job* job = mysh_new_job();
+
+    if (shell->first_job == NULL) {
+        shell->first_job = job;
+    }
+    else {
+        mysh_job* last = shell->first_job;
+        while (last->next != NULL) {
+            last = last->next;
+        }
+
+        last->next = job;
+    }
+
+    return job;
+}
+
+static void mysh_remove_job(mysh_resource* shell, mysh_job* job) {
+    if (shell->first_job == job) {
+        shell->first_job = job->next;
+    }
+    else {
+        for (mysh_job* prev = shell->first_job; prev != NULL; prev = prev->next) {
+            if (prev->next == job) {
+                prev->next = job->next;
+                break;
+            }
+        }
+    }
+
+    mysh_release_job(job);
+}
+
 static void mysh_fprint_job(FILE* file, mysh_job* job, const char* status, int idx) {
-    fprintf(file, "[%d] %d (%s): %s\n", idx, job->group_id, status, job->command.ptr);
+    char usage[64];
+    if (mysh_cgroup_usage(job, usage, sizeof(usage))) {
+        fprintf(file, "[%d] %d (%s): %s [%s]\n", idx, job->group_id, status, job->command.ptr, usage);
+    }
+    else {
+        fprintf(file, "[%d] %d (%s): %s\n", idx, job->group_id, status, job->command.ptr);
+    }
 }
 
 static bool mysh_is_job_stopped(mysh_job* job) {
@@ -75,7 +180,8 @@ static bool mysh_is_job_completed(mysh_job* job) {
 static bool mysh_set_status(mysh_job* first_job, pid_t pid, int status) {
     assert(pid >= 0);
 
-    if (pid == 0 || errno == ECHILD) {
+    // errno may be left from an older call, so only the pid tells whether waitpid() succeeded
+    if (pid == 0) {
         return false;
     }
 
@@ -99,20 +205,163 @@ static bool mysh_set_status(mysh_job* first_job, pid_t pid, int status) {
     return false;
 }
 
+// exit status of the job as `$?` shows it
+static int mysh_job_status(mysh_job* job) {
+    mysh_process* last = job->first_proc;
+    while (last->next != NULL) {
+        last = last->next;
+    }
+
+    if (WIFEXITED(last->status)) {
+        return WEXITSTATUS(last->status);
+    }
+    if (WIFSIGNALED(last->status)) {
+        return 128 + WTERMSIG(last->status);
+    }
+    if (WIFSTOPPED(last->status)) {
+        return 128 + WSTOPSIG(last->status);
+    }
+
+    return 0;
+}
+
 static void mysh_update_status(mysh_job* first_job) {
     int status;
     pid_t pid;
-    do {
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG);
-    } while(pid >= 0 && mysh_set_status(first_job, pid, status));
+    // a pid of no job, such as a helper process, is skipped
+    while ((pid = waitpid(WAIT_ANY, &status, WUNTRACED | WNOHANG)) > 0) {
+        mysh_set_status(first_job, pid, status);
+    }
+}
+
+// a byte is written to `read_fd` on each SIGCHLD while mysh_wait_any() polls, so that it can
+// sleep on exiting children and the fds of jobs at once
+static struct {
+    int read_fd;
+    int write_fd;
+    // the process that made the pipe. a forked subshell makes its own
+    pid_t owner;
+} mysh_child_pipe = { -1, -1, 0 };
+
+static void mysh_child_signaled(int sig) {
+    int saved = errno;
+    if (write(mysh_child_pipe.write_fd, "", 1) < 0) {
+        // the pipe is full, so a wakeup is pending anyway
+    }
+    errno = saved;
+}
+
+static bool mysh_open_child_pipe() {
+    if (mysh_child_pipe.owner == getpid()) {
+        return mysh_child_pipe.read_fd >= 0;
+    }
+
+    if (mysh_child_pipe.read_fd >= 0) {
+        close(mysh_child_pipe.read_fd);
+        close(mysh_child_pipe.write_fd);
+    }
+
+    int fds[2] = { -1, -1 };
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        fds[0] = fds[1] = -1;
+    }
+    mysh_child_pipe.read_fd = fds[0];
+    mysh_child_pipe.write_fd = fds[1];
+    mysh_child_pipe.owner = getpid();
+    return fds[0] >= 0;
+}
+
+static void mysh_drain_child_pipe() {
+    char buf[64];
+    while (read(mysh_child_pipe.read_fd, buf, sizeof(buf)) > 0) {}
+}
+
+// waitpid(WAIT_ANY) which keeps draining captured output and servicing job timers and admission
+// meanwhile, so that a background job never blocks on a full pipe, `timeout` fires and queued
+// jobs start while the shell waits. it sleeps in one poll() on all of them and on SIGCHLD, and
+// blocks in waitpid() alone if there is nothing else to watch.
+// returns 0 if admission may have reaped what was waited for
+static pid_t mysh_wait_any(mysh_resource* shell, int* status) {
+    struct pollfd* fds = NULL;
+    int capacity = 0;
+
+    // the handler is installed only while waiting, and a pending exit is always checked with
+    // WNOHANG after it is, so no SIGCHLD can be missed
+    struct sigaction old_action;
+    bool is_watching = false;
+    pid_t pid = 0;
+    while (true) {
+        // a fired timer may have started another job, so this is sized on every round
+        int max = 2;
+        for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+            max += 2;
+        }
+        if (max > capacity) {
+            capacity = max * 2;
+            fds = realloc(fds, sizeof(struct pollfd) * capacity);
+            if (fds == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        int num_output = mysh_job_output_fds(shell, fds + 1);
+        int num_timers = mysh_job_timer_fds(shell, fds + 1 + num_output);
+        int num_sched = mysh_sched_fds(shell, fds + 1 + num_output + num_timers);
+        int n = num_output + num_timers + num_sched;
+        if (n == 0 || (!is_watching && !mysh_open_child_pipe())) {
+            pid = waitpid(WAIT_ANY, status, WUNTRACED);
+            break;
+        }
+
+        if (!is_watching) {
+            struct sigaction action;
+            memset(&action, 0, sizeof(action));
+            action.sa_handler = mysh_child_signaled;
+            sigemptyset(&action.sa_mask);
+            action.sa_flags = SA_RESTART;
+            sigaction(SIGCHLD, &action, &old_action);
+            is_watching = true;
+        }
+        mysh_drain_child_pipe();
+
+        pid = waitpid(WAIT_ANY, status, WUNTRACED | WNOHANG);
+        if (pid != 0) {
+            break;
+        }
+
+        fds[0].fd = mysh_child_pipe.read_fd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        if (poll(fds, n + 1, -1) <= 0) {
+            // interrupted by SIGCHLD or another signal
+            continue;
+        }
+
+        mysh_service_job_output(shell, fds + 1, num_output);
+        mysh_service_job_timers(shell, fds + 1 + num_output, num_timers);
+        if (mysh_service_sched(shell, fds + 1 + num_output + num_timers, num_sched)) {
+            break;
+        }
+    }
+
+    if (is_watching) {
+        sigaction(SIGCHLD, &old_action, NULL);
+    }
+    free(fds);
+    return pid;
 }
 
 static void mysh_wait_job(mysh_resource* shell, mysh_job* job) {
     int status;
     pid_t pid;
     do {
-        pid = waitpid(WAIT_ANY, &status, WUNTRACED);
-    } while (pid >= 0 && mysh_set_status(shell->first_job, pid, status) && !mysh_is_job_stopped(job) && !mysh_is_job_completed(job));
+        pid = mysh_wait_any(shell, &status);
+        // a pid of no job, such as a helper process, is not the end of the wait
+        if (pid > 0) {
+            mysh_set_status(shell->first_job, pid, status);
+        }
+    } while (pid >= 0 && !mysh_is_job_stopped(job) && !mysh_is_job_completed(job));
 }
 
 static void mysh_put_job_foreground(mysh_resource* shell, mysh_job* job, bool do_continue) {
@@ -131,6 +380,10 @@ static void mysh_put_job_foreground(mysh_resource* shell, mysh_job* job, bool do
     if (mysh_is_job_completed(job)) {
         job->is_notified = true;
     }
+    else if (mysh_is_job_stopped(job)) {
+        // processes outside the process group stop too
+        mysh_cgroup_freeze(job, true);
+    }
 
     tcsetpgrp(shell->terminal_fd, shell->group_id);
 
@@ -138,18 +391,27 @@ static void mysh_put_job_foreground(mysh_resource* shell, mysh_job* job, bool do
     tcsetattr(shell->terminal_fd, TCSADRAIN, &shell->original_termios);
 }
 
+// defined in zygote.h. returns -1 if the caller has to fork by itself
+static pid_t mysh_zygote_spawn(mysh_resource* shell, mysh_process* proc, pid_t group_id, int cgroup_fd, int in_fd, int out_fd, int err_fd, bool is_foreground);
+
 static bool mysh_launch_job(mysh_resource* shell, mysh_job* job, bool is_foreground) {
     assert(job != NULL);
 
+    job->is_foreground = is_foreground;
+    mysh_cgroup_prepare(job);
+
+    bool has_own_group = (shell->is_interactive && !job->is_in_shell_group);
+
     int in_fd = job->in_fd;
     for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
         int out_fd;
-        int cur_pipe[2];
+        int cur_pipe[2] = { -1, -1 };
         if (proc->next == NULL) {
             out_fd = job->out_fd;
         }
         else {
-            if (pipe(cur_pipe) < 0) {
+            // the read end must not stay open in the writer, or it never sees the reader go away
+            if (pipe2(cur_pipe, O_CLOEXEC) < 0) {
                 perror("mysh: failed to create pipe");
                 exit(EXIT_FAILURE);
             }
@@ -163,19 +425,32 @@ static bool mysh_launch_job(mysh_resource* shell, mysh_job* job, bool is_foregro
             }
         }
 
-        pid_t pid = fork();
+        // children may run builtins, which flush what we have buffered on exit
+        fflush(stdout);
+
+        pid_t group_id = (has_own_group ? job->group_id : shell->group_id);
+        pid_t pid = mysh_zygote_spawn(shell, proc, group_id, job->cgroup_fd, in_fd, out_fd, job->err_fd, is_foreground);
+        if (pid < 0) {
+            pid = fork();
+        }
+
         if (pid < 0) {
             perror("mysh: failed to fork");
             exit(EXIT_FAILURE);
         }
         else if (pid == 0) {
-            // child
-            mysh_exec_process(shell, proc, job->group_id, in_fd, out_fd, job->err_fd, is_foreground);
+            // child. builtins do not exec, so close-on-exec is not enough
+            if (proc->next != NULL) {
+                close(cur_pipe[0]);
+            }
+            mysh_cgroup_attach(job, 0);
+            mysh_exec_process(shell, proc, group_id, in_fd, out_fd, job->err_fd, is_foreground);
         }
         else {
             // parent
             proc->pid = pid;
-            if (shell->is_interactive) {
+            mysh_cgroup_attach(job, pid);
+            if (has_own_group) {
                 if (job->group_id == 0) {
                     job->group_id = pid;
                 }
@@ -199,16 +474,190 @@ static bool mysh_launch_job(mysh_resource* shell, mysh_job* job, bool is_foregro
         in_fd = cur_pipe[0];
     }
 
-    if (!shell->is_interactive) {
+    mysh_job_output_launched(job);
+
+    if (!is_foreground) {
+        // nothing to wait for
+    } else if (!shell->is_interactive) {
         mysh_wait_job(shell, job);
-    } else if (is_foreground) {
+    } else {
         mysh_put_job_foreground(shell, job, false);
     }
 
     return true;
 }
 
+static mysh_process* mysh_new_argv_process(char** argv) {
+    int argc = 0;
+    while (argv[argc] != NULL) {
+        ++argc;
+    }
+
+    mysh_process* proc = mysh_new_process();
+    proc->argc = argc;
+    proc->argv = (char**)malloc(sizeof(char*) * (argc + 1));
+    if (proc->argv == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < argc; ++i) {
+        proc->argv[i] = strdup(argv[i]);
+    }
+    proc->argv[argc] = NULL;
+
+    return proc;
+}
+
+static mysh_job* mysh_new_argv_job(mysh_resource* shell, char** argv, char** command_argv) {
+    mysh_job* job = mysh_add_job(shell);
+    job->first_proc = mysh_new_argv_process(command_argv);
+    job->in_fd = STDIN_FILENO;
+    job->out_fd = STDOUT_FILENO;
+    job->err_fd = STDERR_FILENO;
+    job->group_id = 0;
+    job->termios = shell->original_termios;
+
+    ms_assign_raw(&job->command, "");
+    for (int i = 0; argv[i] != NULL; ++i) {
+        if (i != 0) {
+            ms_push(&job->command, ' ');
+        }
+        ms_append_raw(&job->command, argv[i]);
+    }
+
+    return job;
+}
+
+// runs `argv` as an external command in the foreground even if a builtin or function has its name,
+// for builtins which implement only a part of the command they stand in for. returns its status
+static int mysh_run_external(mysh_resource* shell, char** argv) {
+    mysh_job* job = mysh_new_argv_job(shell, argv, argv);
+    job->first_proc->is_external = true;
+
+    // inside `$(...)` a builtin writes into memory, see mysh_capture_inline()
+    bool is_captured = (fileno(stdout) != STDOUT_FILENO);
+    if (is_captured) {
+        job->out_fd = memfd_create("mysh-external", MFD_CLOEXEC);
+        if (job->out_fd < 0) {
+            perror("mysh: failed to capture output");
+            mysh_remove_job(shell, job);
+            return 1;
+        }
+    }
+    int out_fd = job->out_fd;
+
+    int status = 1;
+    if (mysh_launch_job(shell, job, true)) {
+        status = mysh_job_status(job);
+        if (mysh_is_job_completed(job)) {
+            mysh_remove_job(shell, job);
+        }
+    }
+    else if (job->group_id == 0) {
+        mysh_remove_job(shell, job);
+    }
+
+    if (is_captured) {
+        char buf[4096];
+        ssize_t n;
+        lseek(out_fd, 0, SEEK_SET);
+        while ((n = read(out_fd, buf, sizeof(buf))) > 0) {
+            fwrite(buf, 1, n, stdout);
+        }
+        close(out_fd);
+    }
+
+    return status;
+}
+
+// ms between checks of the load while jobs are queued
+#define MYSH_SCHED_INTERVAL (250)
+
+// sends `sig` to every process of `job`. the cgroup of the job, if any, also reaches
+// processes which left the process group
+static bool mysh_signal_job(mysh_job* job, int sig) {
+    // an `every` job between two runs has nothing left to signal
+    bool is_ending = (sig != 0 && sig != SIGCONT && sig != SIGSTOP && sig != SIGTSTP);
+    if (is_ending && mysh_cancel_periodic(job) && mysh_is_job_completed(job)) {
+        return true;
+    }
+
+    if (job->is_queued) {
+        // never started, so it is done unless the signal would have been ignored
+        if (sig == SIGCONT || sig == SIGSTOP || sig == SIGTSTP || sig == 0) {
+            return true;
+        }
+
+        job->is_queued = false;
+        for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+            proc->is_completed = proc->is_stopped = true;
+            proc->status = sig;
+        }
+        return true;
+    }
+
+    if (sig == SIGKILL && mysh_cgroup_kill(job)) {
+        return true;
+    }
+    if ((sig == SIGSTOP || sig == SIGTSTP) && mysh_cgroup_freeze(job, true)) {
+        // waitpid() does not report frozen processes
+        for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+            proc->is_stopped = true;
+        }
+        return true;
+    }
+    if (sig == SIGCONT) {
+        mysh_cgroup_freeze(job, false);
+        for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+            proc->is_stopped = proc->is_completed;
+        }
+    }
+
+    if (job->group_id > 0) {
+        return kill(-job->group_id, sig) == 0;
+    }
+
+    // without job control the processes share our group
+    bool ok = true;
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        if (proc->pid > 0 && !proc->is_completed) {
+            ok &= (kill(proc->pid, sig) == 0);
+        }
+    }
+
+    return ok;
+}
+
+// defined in admission.h. whether a new background job has to wait, and starting the queued
+// jobs the policy allows now
+static bool mysh_should_queue(mysh_resource* shell);
+static void mysh_admit_jobs(mysh_resource* shell);
+
+// starts a queued job regardless of the policy, e.g. for `fg`
+static bool mysh_start_queued_job(mysh_resource* shell, mysh_job* job, bool is_foreground) {
+    job->is_queued = false;
+    if (mysh_launch_job(shell, job, is_foreground)) {
+        return true;
+    }
+
+    // processes after the failed one never start
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        if (proc->pid == 0) {
+            proc->is_completed = true;
+            proc->is_stopped = true;
+            proc->status = 1 << 8;
+        }
+    }
+
+    return false;
+}
+
 static bool mysh_resume_job(mysh_resource* shell, mysh_job* job, bool is_foreground) {
+    if (job->is_queued) {
+        return mysh_start_queued_job(shell, job, is_foreground);
+    }
+
     if (mysh_is_job_completed(job) || !mysh_is_job_stopped(job)) {
         return true;
     }
@@ -220,6 +669,8 @@ static bool mysh_resume_job(mysh_resource* shell, mysh_job* job, bool is_foregro
     }
 
     job->is_notified = false;
+    job->is_foreground = is_foreground;
+    mysh_cgroup_freeze(job, false);
 
     if (is_foreground) {
         mysh_put_job_foreground(shell, job, true);
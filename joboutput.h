@@ -0,0 +1,293 @@
+#ifndef MYSH_JOBOUTPUT_H
+#define MYSH_JOBOUTPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "shell_resource.h"
+#include "event.h"
+#include "job.h"
+
+// with `capture on`, stdout and stderr of background jobs go to a pipe which the shell drains
+// into a fixed-size ring per job instead of to the terminal. `jobs -o %N` prints the tail.
+// a finished job is kept in the job list until its output has been looked at
+
+// ring size unless `capture on SIZE` says otherwise
+#define MYSH_OUTPUT_SIZE (64 * 1024)
+#define MYSH_OUTPUT_MAX_SIZE (64 * 1024 * 1024)
+// kernel buffer in front of the ring, so that a job rarely blocks while a foreground job runs
+#define MYSH_OUTPUT_PIPE_SIZE (1024 * 1024)
+// at most this many finished jobs are kept for their output
+#define MYSH_OUTPUT_KEEP (16)
+// reads per event, so that a chatty job cannot starve the shell
+#define MYSH_OUTPUT_READS (16)
+
+struct mysh_ring_tag {
+    char* data;
+    size_t size;
+    // the oldest byte
+    size_t start;
+    size_t length;
+    // bytes overwritten by newer ones
+    size_t dropped;
+    // -1 once the job closed it
+    int read_fd;
+    // held until the job is launched, which may be later for queued jobs
+    int write_fd;
+    bool is_seen;
+};
+
+static struct {
+    bool is_enabled;
+    size_t size;
+} mysh_output_config = { false, MYSH_OUTPUT_SIZE };
+
+static void mysh_ring_push(mysh_ring* ring, const char* data, size_t len) {
+    if (len >= ring->size) {
+        ring->dropped += ring->length + len - ring->size;
+        memcpy(ring->data, data + len - ring->size, ring->size);
+        ring->start = 0;
+        ring->length = ring->size;
+        return;
+    }
+
+    size_t excess = (ring->length + len > ring->size ? ring->length + len - ring->size : 0);
+    ring->start = (ring->start + excess) % ring->size;
+    ring->length -= excess;
+    ring->dropped += excess;
+
+    size_t end = (ring->start + ring->length) % ring->size;
+    size_t first = (len < ring->size - end ? len : ring->size - end);
+    memcpy(ring->data + end, data, first);
+    memcpy(ring->data, data + first, len - first);
+    ring->length += len;
+}
+
+static void mysh_close_output_reader(mysh_ring* ring) {
+    if (ring->read_fd >= 0) {
+        mysh_unwatch_fd(ring->read_fd);
+        close(ring->read_fd);
+        ring->read_fd = -1;
+    }
+}
+
+// reads what is there without blocking
+static void mysh_drain_output(mysh_ring* ring) {
+    char buf[16 * 1024];
+    for (int i = 0; i < MYSH_OUTPUT_READS && ring->read_fd >= 0; ++i) {
+        ssize_t n = read(ring->read_fd, buf, sizeof(buf));
+        if (n > 0) {
+            mysh_ring_push(ring, buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) {
+            break;
+        }
+
+        // every process of the job closed it
+        mysh_close_output_reader(ring);
+    }
+}
+
+static void mysh_job_output_ready(mysh_resource* shell, int fd, void* ctx) {
+    mysh_drain_output(((mysh_job*)ctx)->output);
+}
+
+// drops the oldest finished jobs which are only kept for their output
+static void mysh_limit_kept_outputs(mysh_resource* shell) {
+    int num_kept = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        num_kept += (job->output != NULL && mysh_is_job_completed(job));
+    }
+
+    mysh_job* job = shell->first_job;
+    while (num_kept >= MYSH_OUTPUT_KEEP && job != NULL) {
+        mysh_job* next = job->next;
+        if (job->output != NULL && mysh_is_job_completed(job)) {
+            mysh_remove_job(shell, job);
+            --num_kept;
+        }
+        job = next;
+    }
+}
+
+// called for a background job before it is launched
+void mysh_start_job_output(mysh_resource* shell, mysh_job* job) {
+    if (!mysh_output_config.is_enabled || job->output != NULL) {
+        return;
+    }
+
+    mysh_update_status(shell->first_job);
+    mysh_limit_kept_outputs(shell);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("mysh: failed to capture output");
+        return;
+    }
+
+    mysh_ring* ring = (mysh_ring*)calloc(1, sizeof(mysh_ring));
+    char* data = (char*)malloc(mysh_output_config.size);
+    if (ring == NULL || data == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[0], F_SETPIPE_SZ, MYSH_OUTPUT_PIPE_SIZE);
+
+    ring->data = data;
+    ring->size = mysh_output_config.size;
+    ring->read_fd = fds[0];
+    ring->write_fd = fds[1];
+
+    job->output = ring;
+    job->out_fd = fds[1];
+    job->err_fd = fds[1];
+
+    mysh_watch_fd(fds[0], POLLIN, mysh_job_output_ready, job);
+}
+
+// the children have the write end now
+void mysh_job_output_launched(mysh_job* job) {
+    if (job->output != NULL && job->output->write_fd >= 0) {
+        close(job->output->write_fd);
+        job->output->write_fd = -1;
+    }
+}
+
+void mysh_release_job_output(mysh_job* job) {
+    mysh_ring* ring = job->output;
+    if (ring == NULL) {
+        return;
+    }
+
+    mysh_close_output_reader(ring);
+    mysh_job_output_launched(job);
+    free(ring->data);
+    free(ring);
+    job->output = NULL;
+}
+
+// adds the fds of captured output to `fds` for mysh_wait_any(). returns how many
+int mysh_job_output_fds(mysh_resource* shell, struct pollfd* fds) {
+    int n = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        if (job->output != NULL && job->output->read_fd >= 0) {
+            fds[n].fd = job->output->read_fd;
+            fds[n].events = POLLIN;
+            fds[n++].revents = 0;
+        }
+    }
+
+    return n;
+}
+
+// drains the captured output that poll() found ready among `fds`
+void mysh_service_job_output(mysh_resource* shell, struct pollfd* fds, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+
+        for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+            if (job->output != NULL && job->output->read_fd == fds[i].fd) {
+                mysh_drain_output(job->output);
+                break;
+            }
+        }
+    }
+}
+
+bool mysh_has_unseen_output(mysh_job* job) {
+    return job->output != NULL && !job->output->is_seen;
+}
+
+// prints the last `num_lines` lines of what `job` wrote
+static void mysh_print_job_output(mysh_job* job, int num_lines) {
+    mysh_ring* ring = job->output;
+    mysh_drain_output(ring);
+    ring->is_seen = true;
+
+    char* text = (char*)malloc(ring->length + 1);
+    if (text == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t first = (ring->length < ring->size - ring->start ? ring->length : ring->size - ring->start);
+    memcpy(text, ring->data + ring->start, first);
+    memcpy(text + first, ring->data, ring->length - first);
+
+    // a trailing newline does not start another line
+    size_t begin = ring->length;
+    if (begin > 0 && text[begin - 1] == '\n') {
+        --begin;
+    }
+    for (int lines = 0; begin > 0; --begin) {
+        if (text[begin - 1] == '\n' && ++lines == num_lines) {
+            break;
+        }
+    }
+
+    if (begin == 0 && ring->dropped > 0) {
+        fprintf(stdout, "[%zu earlier bytes dropped]\n", ring->dropped);
+    }
+    fwrite(text + begin, 1, ring->length - begin, stdout);
+    free(text);
+}
+
+// capture [on [SIZE[k|m]] | off]
+int mysh_capture_builtin(mysh_resource* shell, char** argv) {
+    if (argv[1] == NULL) {
+        if (mysh_output_config.is_enabled) {
+            printf("capture: on (%zu bytes per job)\n", mysh_output_config.size);
+        }
+        else {
+            printf("capture: off\n");
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "off") == 0) {
+        mysh_output_config.is_enabled = false;
+        return 0;
+    }
+    if (strcmp(argv[1], "on") != 0) {
+        fprintf(stderr, "usage: capture [on [SIZE[k|m]] | off]\n");
+        return 2;
+    }
+
+    if (argv[2] != NULL) {
+        char* end;
+        unsigned long long size = strtoull(argv[2], &end, 10);
+        if (*end == 'k' || *end == 'K') {
+            size *= 1024;
+            ++end;
+        }
+        else if (*end == 'm' || *end == 'M') {
+            size *= 1024 * 1024;
+            ++end;
+        }
+
+        if (*end != '\0' || size == 0 || size > MYSH_OUTPUT_MAX_SIZE) {
+            fprintf(stderr, "mysh: capture: %s: invalid size\n", argv[2]);
+            return 1;
+        }
+        mysh_output_config.size = (size_t)size;
+    }
+
+    mysh_output_config.is_enabled = true;
+    return 0;
+}
+
+#endif // MYSH_JOBOUTPUT_H
@@ -0,0 +1,344 @@
+#ifndef MYSH_LIBMYSH_H
+#define MYSH_LIBMYSH_H
+
+// embedding API. a program includes this header in one of its sources, before any system header,
+// and runs command lines without starting /bin/sh for each of them:
+//
+//     mysh_resource* shell = mysh_open_shell();
+//     mysh_script* script = mysh_compile("grep -c x \"$FILE\"");  // parsed once
+//     mysh_set_var(shell->scope, "FILE", "a.txt");
+//     int status = mysh_run_script(shell, script);                // run any number of times
+//     status = mysh_capture_script(shell, script, &out);          // stdout into a string
+//     mysh_spawn_script(shell, script, on_done, ctx);             // on_done is called from mysh_poll_scripts()
+//
+// the shell reaps children with waitpid(WAIT_ANY), so the program should not wait for its own
+// children while scripts are running
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "process.h"
+#include "parser.h"
+#include "job.h"
+#include "builtins.h"
+#include "function.h"
+#include "exec.h"
+#include "cache.h"
+#include "event.h"
+#include "zygote.h"
+#include "admission.h"
+#include "cgroup.h"
+#include "plugin.h"
+#include "copy.h"
+#include "joboutput.h"
+#include "timer.h"
+#include "dirjump.h"
+#include "session.h"
+
+// a parsed command line. immutable, so it can be run many times and by several shells
+typedef struct {
+    mysh_command_list* list;
+    mysh_string source;
+} mysh_script;
+
+// called once an asynchronous run finished. `output` is its stdout and is freed afterwards
+typedef void (*mysh_script_done_fn)(void* ctx, int status, const char* output, size_t length);
+
+typedef struct {
+    mysh_resource* shell;
+    mysh_job* job;
+    int fd;
+    mysh_string output;
+    mysh_script_done_fn done;
+    void* ctx;
+} mysh_script_run;
+
+static mysh_resource* mysh_open_shell() {
+    mysh_resource* shell = (mysh_resource*)malloc(sizeof(mysh_resource));
+    if (shell == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mysh_init_resource(shell);
+    return shell;
+}
+
+static void mysh_script_output(mysh_resource* shell, int fd, void* ctx);
+static void mysh_script_exited(mysh_resource* shell, int fd, void* ctx);
+
+// kills what is still running, like exiting the shell does. pending callbacks are not called
+static void mysh_close_shell(mysh_resource* shell) {
+    for (int i = 0; i < mysh_watch_list.size; ++i) {
+        mysh_watch* w = &mysh_watch_list.watches[i];
+        bool is_run = (w->handler == mysh_script_output || w->handler == mysh_script_exited);
+        if (is_run && ((mysh_script_run*)w->ctx)->shell == shell) {
+            mysh_script_run* run = (mysh_script_run*)w->ctx;
+            close(w->fd);
+            mysh_unwatch_fd(w->fd);
+            ms_relase(&run->output);
+            free(run);
+            --i;
+        }
+    }
+
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+            if (proc->pid > 0 && !proc->is_completed) {
+                kill(proc->pid, SIGTERM);
+            }
+        }
+    }
+    while (shell->first_job != NULL) {
+        mysh_job* job = shell->first_job;
+        if (!mysh_is_job_completed(job)) {
+            mysh_wait_job(shell, job);
+        }
+        mysh_remove_job(shell, job);
+    }
+
+    mysh_release_functions(shell);
+    mysh_release_resource(shell);
+    free(shell);
+}
+
+// returns NULL on a syntax error, which has been reported to stderr
+static mysh_script* mysh_compile(const char* source) {
+    mysh_script* script = (mysh_script*)malloc(sizeof(mysh_script));
+    if (script == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the parser works in place
+    mysh_string line = { NULL, 0, 0, { 0 } };
+    ms_init(&line, source);
+    script->list = mysh_parse_input(line.ptr, NULL, NULL);
+    ms_relase(&line);
+
+    if (script->list == NULL) {
+        free(script);
+        return NULL;
+    }
+
+    script->source.ptr = NULL;
+    ms_init(&script->source, source);
+
+    return script;
+}
+
+static void mysh_free_script(mysh_script* script) {
+    if (script == NULL) {
+        return;
+    }
+
+    mysh_release_list(script->list);
+    ms_relase(&script->source);
+    free(script);
+}
+
+// runs `script` in the shell itself, so variables, functions and `cd` persist between runs.
+// `exit` and `return` only end the script
+static int mysh_run_script(mysh_resource* shell, const mysh_script* script) {
+    int status = mysh_run_list(shell, script->list);
+    fflush(stdout);
+
+    shell->is_exiting = false;
+    shell->is_returning = false;
+
+    return status;
+}
+
+// like mysh_run_script() with stdout going into `out`
+static int mysh_capture_script(mysh_resource* shell, const mysh_script* script, mysh_string* out) {
+    if (out->ptr == NULL) {
+        ms_init(out, "");
+    }
+
+    int fd = memfd_create("mysh-capture", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("mysh: failed to capture output");
+        return 1;
+    }
+
+    fflush(stdout);
+    int saved = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(fd, STDOUT_FILENO);
+
+    int status = mysh_run_script(shell, script);
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+
+    lseek(fd, 0, SEEK_SET);
+    mysh_read_all(fd, out);
+    close(fd);
+
+    return status;
+}
+
+static void mysh_finish_script_run(mysh_resource* shell, mysh_script_run* run) {
+    int status = mysh_job_status(run->job);
+    mysh_remove_job(shell, run->job);
+
+    run->done(run->ctx, status, run->output.ptr, run->output.length);
+
+    ms_relase(&run->output);
+    free(run);
+}
+
+// EOF on stdout does not mean the job exited, so the run waits for each of its processes in
+// turn through a pidfd, and its callback is called once the last one is gone
+static void mysh_await_script_exit(mysh_resource* shell, mysh_script_run* run) {
+    mysh_update_status(shell->first_job);
+
+    for (mysh_process* proc = run->job->first_proc; proc != NULL; proc = proc->next) {
+        if (proc->is_completed || proc->pid <= 0) {
+            continue;
+        }
+
+        int fd = (int)syscall(SYS_pidfd_open, proc->pid, 0);
+        if (fd < 0) {
+            // a kernel without pidfds
+            mysh_wait_job(shell, run->job);
+            break;
+        }
+
+        run->fd = fd;
+        mysh_watch_fd(fd, POLLIN, mysh_script_exited, run);
+        return;
+    }
+
+    mysh_finish_script_run(shell, run);
+}
+
+static void mysh_script_exited(mysh_resource* shell, int fd, void* ctx) {
+    mysh_unwatch_fd(fd);
+    close(fd);
+    mysh_await_script_exit(shell, (mysh_script_run*)ctx);
+}
+
+static void mysh_script_output(mysh_resource* shell, int fd, void* ctx) {
+    mysh_script_run* run = (mysh_script_run*)ctx;
+
+    char buf[MYSH_CAPTURE_CHUNK];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        ms_append_n(&run->output, buf, n);
+    }
+
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+        return;
+    }
+
+    // EOF, so every process of the job has exited or closed its stdout
+    mysh_unwatch_fd(fd);
+    close(fd);
+    mysh_await_script_exit(shell, run);
+}
+
+// starts `script` in the background with its stdout captured. a single pipeline is launched
+// as it is, anything longer runs in a forked subshell. returns false if nothing was started
+static bool mysh_spawn_script(mysh_resource* shell, const mysh_script* script, mysh_script_done_fn done, void* ctx) {
+    mysh_process* first_proc;
+    if (script->list->next == NULL && script->list->is_foreground) {
+        first_proc = mysh_expand_pipeline(shell, script->list->pipeline);
+        if (first_proc == NULL) {
+            return false;
+        }
+    }
+    else {
+        first_proc = mysh_new_process();
+        first_proc->kind = process_subshell;
+        first_proc->body = mysh_retain_list(script->list);
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("mysh: failed to create pipe");
+        mysh_release_process(first_proc);
+        return false;
+    }
+
+    mysh_job* job = mysh_add_job(shell);
+    job->first_proc = first_proc;
+    job->in_fd = STDIN_FILENO;
+    job->out_fd = fds[1];
+    job->err_fd = STDERR_FILENO;
+    job->group_id = 0;
+    job->termios = shell->original_termios;
+    ms_assign_raw(&job->command, script->source.ptr);
+
+    bool ok = mysh_launch_job(shell, job, false);
+    for (mysh_process* proc = first_proc; proc != NULL; proc = proc->next) {
+        mysh_release_subst_fds(shell, proc);
+    }
+    close(fds[1]);
+
+    if (!ok) {
+        close(fds[0]);
+        // processes after the failed one were never started
+        for (mysh_process* proc = first_proc; proc != NULL; proc = proc->next) {
+            proc->is_completed |= (proc->pid == 0);
+        }
+        if (!mysh_is_job_completed(job)) {
+            mysh_wait_job(shell, job);
+        }
+        mysh_remove_job(shell, job);
+        return false;
+    }
+
+    mysh_script_run* run = (mysh_script_run*)malloc(sizeof(mysh_script_run));
+    if (run == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    run->shell = shell;
+    run->job = job;
+    run->fd = fds[0];
+    run->output.ptr = NULL;
+    ms_init(&run->output, "");
+    run->done = done;
+    run->ctx = ctx;
+
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    mysh_watch_fd(fds[0], POLLIN, mysh_script_output, run);
+
+    return true;
+}
+
+// collects output of running scripts and calls the callbacks of finished ones.
+// waits up to `timeout` ms, or forever if it is negative, for something to happen
+static void mysh_poll_scripts(mysh_resource* shell, int timeout) {
+    // poll() ignores the negative fd
+    mysh_wait_input(shell, -1, timeout);
+}
+
+// fds to add to the program's own event loop; call mysh_poll_scripts(shell, 0) when one is readable
+static int mysh_script_fds(int* fds, int max_fds) {
+    int n = 0;
+    for (int i = 0; i < mysh_watch_list.size && n < max_fds; ++i) {
+        mysh_event_handler handler = mysh_watch_list.watches[i].handler;
+        if (handler == mysh_script_output || handler == mysh_script_exited) {
+            fds[n++] = mysh_watch_list.watches[i].fd;
+        }
+    }
+
+    return n;
+}
+
+#endif // MYSH_LIBMYSH_H
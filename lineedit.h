@@ -0,0 +1,374 @@
+#ifndef MYSH_LINEEDIT_H
+#define MYSH_LINEEDIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#include "mystring.h"
+#include "redirect.h"
+#include "shell_resource.h"
+#include "event.h"
+#include "highlight.h"
+
+// renders the prompt. called again whenever a repaint is requested
+typedef void (*mysh_prompt_fn)(mysh_resource* shell, mysh_string* out);
+
+typedef struct {
+    mysh_resource* shell;
+    mysh_prompt_fn prompt_fn;
+    mysh_string prompt;
+    mysh_string line;
+    // byte offset of the cursor in `line`
+    size_t pos;
+    mysh_highlighter hl;
+} mysh_editor;
+
+// set by event handlers, e.g. when a prompt segment has been computed
+static bool mysh_repaint_requested = false;
+
+static void mysh_request_repaint() {
+    mysh_repaint_requested = true;
+}
+
+static bool mysh_is_utf8_cont(char c) {
+    return ((unsigned char)c & 0xC0) == 0x80;
+}
+
+// columns `s[0, len)` takes, not counting escape sequences
+static size_t mysh_display_width(const char* s, size_t len) {
+    size_t width = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (s[i] == '\x1b' && i + 1 < len && s[i + 1] == '[') {
+            for (i += 2; i < len && !(s[i] >= '@' && s[i] <= '~'); ++i) {
+            }
+            continue;
+        }
+
+        width += !mysh_is_utf8_cont(s[i]);
+    }
+
+    return width;
+}
+
+static size_t mysh_terminal_columns(int fd) {
+    struct winsize ws;
+    if (ioctl(fd, TIOCGWINSZ, &ws) < 0 || ws.ws_col == 0) {
+        return 80;
+    }
+
+    return ws.ws_col;
+}
+
+static size_t mysh_next_char(const mysh_string* s, size_t pos) {
+    if (pos >= s->length) {
+        return s->length;
+    }
+
+    do {
+        ++pos;
+    } while (pos < s->length && mysh_is_utf8_cont(s->ptr[pos]));
+
+    return pos;
+}
+
+static size_t mysh_prev_char(const mysh_string* s, size_t pos) {
+    while (pos > 0 && mysh_is_utf8_cont(s->ptr[--pos])) {
+    }
+
+    return pos;
+}
+
+// redraws the prompt and the line in one write. a line wider than the terminal scrolls horizontally
+static void mysh_editor_refresh(mysh_editor* ed) {
+    int fd = ed->shell->terminal_fd;
+    size_t cols = mysh_terminal_columns(fd);
+    size_t prompt_width = mysh_display_width(ed->prompt.ptr, ed->prompt.length);
+
+    mysh_highlight_update(ed->shell, &ed->hl, ed->line.ptr, ed->line.length);
+
+    const char* buf = ed->line.ptr;
+    size_t len = ed->line.length;
+    size_t pos = ed->pos;
+
+    while (pos > 0 && prompt_width + mysh_display_width(buf, pos) >= cols) {
+        size_t skip = 1;
+        while (skip < pos && mysh_is_utf8_cont(buf[skip])) {
+            ++skip;
+        }
+        buf += skip;
+        len -= skip;
+        pos -= skip;
+    }
+    while (len > pos && prompt_width + mysh_display_width(buf, len) > cols) {
+        do {
+            --len;
+        } while (len > pos && mysh_is_utf8_cont(buf[len]));
+    }
+
+    mysh_string out = { NULL, 0, 0, { 0 } };
+    char seq[32];
+    ms_init(&out, "\r");
+    ms_append_raw(&out, ed->prompt.ptr);
+    mysh_highlight_append(&ed->hl, &out, ed->line.ptr, buf - ed->line.ptr, buf - ed->line.ptr + len);
+
+    // `ESC [ 0 C` still moves one column
+    size_t col = prompt_width + mysh_display_width(buf, pos);
+    ms_append_raw(&out, "\x1b[0K\r");
+    if (col > 0) {
+        snprintf(seq, sizeof(seq), "\x1b[%zuC", col);
+        ms_append_raw(&out, seq);
+    }
+
+    mysh_write_all(fd, out.ptr, out.length);
+    ms_relase(&out);
+}
+
+static void mysh_editor_render_prompt(mysh_editor* ed) {
+    if (ed->prompt_fn != NULL) {
+        ed->prompt_fn(ed->shell, &ed->prompt);
+    }
+}
+
+// next key, waiting for it if needed. returns false on EOF or error.
+// keys are read one by one so that typeahead after the line is left to the command
+static bool mysh_editor_getc(mysh_editor* ed, char* c) {
+    ssize_t n;
+    do {
+        n = read(ed->shell->terminal_fd, c, 1);
+    } while (n < 0 && errno == EINTR);
+
+    return n == 1;
+}
+
+static bool mysh_editor_has_input(mysh_editor* ed) {
+    struct pollfd pfd = { ed->shell->terminal_fd, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+static void mysh_editor_insert(mysh_editor* ed, char c) {
+    ms_push(&ed->line, '\0');
+    memmove(ed->line.ptr + ed->pos + 1, ed->line.ptr + ed->pos, ed->line.length - ed->pos - 1);
+    ed->line.ptr[ed->pos++] = c;
+    mysh_highlight_edit(&ed->hl, ed->pos - 1, 0, 1);
+}
+
+static void mysh_editor_erase(mysh_editor* ed, size_t from, size_t to) {
+    if (from == to) {
+        return;
+    }
+
+    mysh_highlight_edit(&ed->hl, from, to - from, 0);
+    memmove(ed->line.ptr + from, ed->line.ptr + to, ed->line.length - to + 1);
+    ed->line.length -= to - from;
+    if (ed->pos > to) {
+        ed->pos -= to - from;
+    }
+    else if (ed->pos > from) {
+        ed->pos = from;
+    }
+}
+
+typedef enum {
+    edit_continue,
+    edit_done,
+    edit_cancel,
+    edit_eof
+} mysh_edit_result;
+
+// `ESC [` or `ESC O` sequences of cursor keys
+static void mysh_editor_escape(mysh_editor* ed) {
+    char seq[3];
+    if (!mysh_editor_getc(ed, &seq[0]) || !mysh_editor_getc(ed, &seq[1])) {
+        return;
+    }
+
+    if (seq[0] == '[' && seq[1] >= '0' && seq[1] <= '9') {
+        if (!mysh_editor_getc(ed, &seq[2]) || seq[2] != '~') {
+            return;
+        }
+
+        if (seq[1] == '3') {
+            mysh_editor_erase(ed, ed->pos, mysh_next_char(&ed->line, ed->pos));
+        }
+        else if (seq[1] == '1' || seq[1] == '7') {
+            ed->pos = 0;
+        }
+        else if (seq[1] == '4' || seq[1] == '8') {
+            ed->pos = ed->line.length;
+        }
+        return;
+    }
+
+    if (seq[0] != '[' && seq[0] != 'O') {
+        return;
+    }
+
+    switch (seq[1]) {
+    case 'C':
+        ed->pos = mysh_next_char(&ed->line, ed->pos);
+        break;
+    case 'D':
+        ed->pos = mysh_prev_char(&ed->line, ed->pos);
+        break;
+    case 'H':
+        ed->pos = 0;
+        break;
+    case 'F':
+        ed->pos = ed->line.length;
+        break;
+    default:
+        break;
+    }
+}
+
+static mysh_edit_result mysh_editor_key(mysh_editor* ed, char c) {
+    switch (c) {
+    case '\r':
+    case '\n':
+        return edit_done;
+    case 3: // ctrl-c
+        return edit_cancel;
+    case 4: // ctrl-d
+        if (ed->line.length == 0) {
+            return edit_eof;
+        }
+        mysh_editor_erase(ed, ed->pos, mysh_next_char(&ed->line, ed->pos));
+        break;
+    case 127:
+    case 8: // ctrl-h
+        mysh_editor_erase(ed, mysh_prev_char(&ed->line, ed->pos), ed->pos);
+        break;
+    case 1: // ctrl-a
+        ed->pos = 0;
+        break;
+    case 5: // ctrl-e
+        ed->pos = ed->line.length;
+        break;
+    case 2: // ctrl-b
+        ed->pos = mysh_prev_char(&ed->line, ed->pos);
+        break;
+    case 6: // ctrl-f
+        ed->pos = mysh_next_char(&ed->line, ed->pos);
+        break;
+    case 11: // ctrl-k
+        mysh_editor_erase(ed, ed->pos, ed->line.length);
+        break;
+    case 21: // ctrl-u
+        mysh_editor_erase(ed, 0, ed->pos);
+        break;
+    case 23: { // ctrl-w
+        size_t from = ed->pos;
+        while (from > 0 && ed->line.ptr[from - 1] == ' ') {
+            --from;
+        }
+        while (from > 0 && ed->line.ptr[from - 1] != ' ') {
+            --from;
+        }
+        mysh_editor_erase(ed, from, ed->pos);
+        break;
+    }
+    case 12: // ctrl-l
+        mysh_write_all(ed->shell->terminal_fd, "\x1b[H\x1b[2J", 7);
+        break;
+    case 27:
+        mysh_editor_escape(ed);
+        break;
+    default:
+        if ((unsigned char)c >= 32 || c == '\t') {
+            mysh_editor_insert(ed, c);
+        }
+        break;
+    }
+
+    return edit_continue;
+}
+
+// reads a line from the terminal with editing keys. the prompt is painted at once and
+// repainted whenever a handler in event.h calls mysh_request_repaint().
+// the result follows mysh_read_line(): EOF is returned as a line of EOF only
+static bool mysh_edit_line(mysh_resource* shell, mysh_prompt_fn prompt_fn, char* buf, size_t buf_size) {
+    struct termios raw = shell->original_termios;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(shell->terminal_fd, TCSADRAIN, &raw);
+
+    mysh_editor ed;
+    ed.shell = shell;
+    ed.prompt_fn = prompt_fn;
+    ed.prompt.ptr = NULL;
+    ed.line.ptr = NULL;
+    ms_init(&ed.prompt, "");
+    ms_init(&ed.line, "");
+    ed.pos = 0;
+    mysh_init_highlighter(&ed.hl, shell);
+
+    mysh_repaint_requested = false;
+    mysh_editor_render_prompt(&ed);
+    mysh_editor_refresh(&ed);
+
+    mysh_edit_result result = edit_continue;
+    while (result == edit_continue) {
+        if (!mysh_wait_input(shell, shell->terminal_fd, -1)) {
+            if (mysh_repaint_requested) {
+                mysh_repaint_requested = false;
+                mysh_editor_render_prompt(&ed);
+                mysh_editor_refresh(&ed);
+            }
+            continue;
+        }
+
+        char c;
+        if (!mysh_editor_getc(&ed, &c)) {
+            result = edit_eof;
+            break;
+        }
+        result = mysh_editor_key(&ed, c);
+
+        // keys which arrived together, e.g. pasted text, are painted once
+        while (result == edit_continue && mysh_editor_has_input(&ed) && mysh_editor_getc(&ed, &c)) {
+            result = mysh_editor_key(&ed, c);
+        }
+
+        if (mysh_repaint_requested) {
+            mysh_repaint_requested = false;
+            mysh_editor_render_prompt(&ed);
+        }
+        mysh_editor_refresh(&ed);
+    }
+
+    mysh_write_all(shell->terminal_fd, (result == edit_cancel ? "^C\r\n" : "\r\n"), (result == edit_cancel ? 4 : 2));
+    tcsetattr(shell->terminal_fd, TCSADRAIN, &shell->original_termios);
+
+    bool ok = true;
+    if (result == edit_eof) {
+        buf[0] = EOF;
+        buf[1] = '\0';
+    }
+    else if (result == edit_cancel) {
+        buf[0] = '\0';
+    }
+    else if (ed.line.length + 2 > buf_size) {
+        fprintf(stderr, "mysh: input must be less than %zu bytes.\n", buf_size);
+        ok = false;
+    }
+    else {
+        memcpy(buf, ed.line.ptr, ed.line.length + 1);
+    }
+
+    ms_relase(&ed.line);
+    ms_relase(&ed.prompt);
+    mysh_release_highlighter(&ed.hl);
+
+    return ok;
+}
+
+#endif // MYSH_LINEEDIT_H
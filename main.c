@@ -1,3 +1,6 @@
+// memfd_create(), pipe2()
+#define _GNU_SOURCE
+
 // standard library
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,19 +17,38 @@
 #include "parser.h"
 #include "shell_resource.h"
 #include "builtins.h"
-
-bool mysh_init(mysh_resource* shell) {
-    ms_init(&shell->home_dir, getenv("HOME"));
-	mysh_set_curdir_name(shell);
+#include "function.h"
+#include "exec.h"
+#include "cache.h"
+#include "highlight.h"
+#include "lineedit.h"
+#include "prompt.h"
+#include "admission.h"
+#include "cgroup.h"
+#include "plugin.h"
+#include "copy.h"
+#include "joboutput.h"
+#include "timer.h"
+#include "dirjump.h"
+#include "session.h"
+#include "zygote.h"
+#include "parallel.h"
+
+bool mysh_init(mysh_resource* shell, bool is_interactive) {
+	mysh_init_resource(shell);
 
     if (errno < 0) {
         perror("mysh: couldn't get $HOME");
         return false;
     }
     
-	shell->first_job = NULL;
-    shell->terminal_fd = STDIN_FILENO;
-    shell->is_interactive = isatty(shell->terminal_fd);
+    shell->is_interactive = is_interactive && isatty(shell->terminal_fd);
+
+	// every job gets a cgroup of its own if the hierarchy is delegated to us
+	const char* cgroup = getenv("MYSH_CGROUP");
+	if (cgroup != NULL && cgroup[0] != '\0' && strcmp(cgroup, "0") != 0) {
+		mysh_enable_cgroups();
+	}
 
     if (shell->is_interactive) {
 		while(true) {
@@ -59,25 +81,35 @@ bool mysh_init(mysh_resource* shell) {
 			return false;
         }
 
+		// commands are launched by a small helper process instead of forking the shell
+		const char* zygote = getenv("MYSH_ZYGOTE");
+		if (zygote != NULL && zygote[0] != '\0' && strcmp(zygote, "0") != 0) {
+			mysh_start_zygote();
+		}
+
 		return true;
     }
 
-	return false;
+	return true;
 }
 
 int is_terminal_char(char c) {
 	return c == '\n' || c == EOF;
 }
 
-bool mysh_read_line(char* buf, size_t buf_size) {
+bool mysh_read_line(mysh_resource* shell, mysh_prompt_fn prompt, char* buf, size_t buf_size) {
+	if (shell->is_interactive) {
+		return mysh_edit_line(shell, prompt, buf, buf_size);
+	}
+
 	size_t cur = 0;
 	while (1) {
-		char c = getchar();
+		char c = getc(mysh_session_input());
 
-		if (cur + 1 == buf_size && !is_terminal_char(c)) {
+		if (cur + 2 >= buf_size && !is_terminal_char(c)) {
 			fprintf(stderr, "mysh: input must be less than 8096 bytes.");
 			while (!is_terminal_char(c)) {
-				c = getchar();
+				c = getc(mysh_session_input());
 			}
 			
 			return false;
@@ -90,6 +122,7 @@ bool mysh_read_line(char* buf, size_t buf_size) {
 
 		if (c == EOF) {
 			buf[cur] = EOF;
+			buf[cur + 1] = '\0';
 			break;
 		}
 
@@ -102,99 +135,156 @@ bool mysh_read_line(char* buf, size_t buf_size) {
 
 #define MYSH_MAX_INPUT_BYTES (8096)
 
+typedef struct {
+	mysh_resource* shell;
+	char* buf;
+} mysh_more_reader;
+
+// reads continuation lines such as here-document bodies
+static bool mysh_read_more(void* ctx, mysh_string* line) {
+	mysh_more_reader* reader = (mysh_more_reader*)ctx;
+	char* buf = reader->buf;
+
+	if (!mysh_read_line(reader->shell, mysh_render_continuation, buf, MYSH_MAX_INPUT_BYTES) || buf[0] == EOF) {
+		return false;
+	}
+
+	char* eof = strchr(buf, EOF);
+	if (eof != NULL) {
+		*eof = '\0';
+	}
+
+	ms_assign_raw(line, buf);
+	mysh_session_more_line(buf);
+	return true;
+}
+
 int mysh_loop(mysh_resource* shell) {
 	char* input_buf = malloc(sizeof(char) * MYSH_MAX_INPUT_BYTES);
-	if (input_buf == NULL) {
+	char* more_buf = malloc(sizeof(char) * MYSH_MAX_INPUT_BYTES);
+	if (input_buf == NULL || more_buf == NULL) {
 		fprintf(stderr, "mysh: error occurred in allocation.\n");
 		exit(EXIT_FAILURE);
 	}
 
-	int status = 0;
+	mysh_more_reader more = { shell, more_buf };
+
 	do {
-		printf("%s$ ", shell->current_dir.ptr);
-		if (!mysh_read_line(input_buf, MYSH_MAX_INPUT_BYTES)) {
+		fflush(stdout);
+		if (!mysh_read_line(shell, mysh_render_prompt, input_buf, MYSH_MAX_INPUT_BYTES)) {
 			fprintf(stderr, "mysh: error occurred while reading input (input ignored).\n");
 			continue;
 		}
 
 		if (input_buf[0] == EOF) {
-			exit(EXIT_SUCCESS);
+			break;
 		}
 
-		mysh_process* proc = mysh_new_process();
-		bool is_foreground;
-		if (!mysh_parse_input(input_buf, proc, &is_foreground)) {
+		mysh_session_begin_line(input_buf);
+		mysh_command_list* list = mysh_parse_input(input_buf, mysh_read_more, &more);
+		if (list == NULL) {
 			continue;
 		}
 
-		bool is_builtin = false;
-		for (int i = 0; i < mysh_num_builtins(); ++i) {
-			assert(proc->argv != NULL);
-			if (strcmp(proc->argv[0], builtin_str[i]) == 0) {
-				if (proc->next != NULL) {
-					fprintf(stderr, "mysh: builtin functions cannot call with other command\n");
-				}
-				else {
-					status = (builtin_func[i])(shell, proc->argv);
-				}
-
-				mysh_release_process(proc);
-				is_builtin = true;
-				i = mysh_num_builtins();
-			}
-		}
-
-		if (is_builtin) {
-			continue;
-		}
-		
-		mysh_job* job = shell->first_job;
-		if (shell->first_job == NULL) {
-			shell->first_job = mysh_new_job();
-			job = shell->first_job;
-		}
-		else {
-			while (job->next != NULL) {
-				job = job->next;
-			}
+		int status = mysh_run_list(shell, list);
+		mysh_release_list(list);
+		mysh_session_end_line(status);
 
-			job->next = mysh_new_job();
-			job = job->next;
-		}
+		// jobs which finished meanwhile may let queued ones start
+		mysh_admit_jobs(shell);
 
-		job->first_proc = proc;
-		job->in_fd = STDIN_FILENO;
-		job->out_fd = STDOUT_FILENO;
-		job->err_fd = STDERR_FILENO;
-		job->group_id = 0;
-		job->termios = shell->original_termios;
-		
-		ms_assign_raw(&job->command, input_buf);
+		// the command may have changed what the prompt shows
+		++shell->prompt_generation;
 
-		mysh_launch_job(shell, job, is_foreground);
-	} while(status == 0);
+		shell->is_returning = false;
+	} while (!shell->is_exiting);
 
 	free(input_buf);
+	free(more_buf);
 	return 0;
 }
 
 bool mysh_terminate(mysh_resource* shell) {
 	for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
-		kill(-job->group_id, SIGTERM);
+		if (job->group_id > 0) {
+			kill(-job->group_id, SIGTERM);
+		}
+	}
+
+	while (shell->first_job != NULL) {
+		mysh_remove_job(shell, shell->first_job);
 	}
 
+	mysh_stop_zygote();
+	mysh_disable_cgroups();
+	mysh_release_functions(shell);
 	mysh_release_resource(shell);
 	return true;
 }
 
-int main(void) {
+static void mysh_usage() {
+	fprintf(stderr, "usage: mysh [-j N] [script]\n");
+	fprintf(stderr, "       mysh --replay FILE [--stub]\n");
+}
+
+int main(int argc, char** argv) {
+	if (argc == 3 && strcmp(argv[1], "--zygote") == 0) {
+		return mysh_zygote_main(atoi(argv[2]));
+	}
+
+	const char* script_path = NULL;
+	const char* replay_path = NULL;
+	bool is_stubbing = false;
+	int num_parallel = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			num_parallel = atoi(argv[++i]);
+			if (num_parallel <= 0) {
+				mysh_usage();
+				return 2;
+			}
+		}
+		else if (argv[i][0] != '-' && script_path == NULL) {
+			script_path = argv[i];
+		}
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replay_path = argv[++i];
+		}
+		else if (strcmp(argv[i], "--stub") == 0) {
+			is_stubbing = true;
+		}
+		else {
+			mysh_usage();
+			return 2;
+		}
+	}
+
 	mysh_resource shell;
-	memset(&shell, 0, sizeof(shell));
-	if (!mysh_init(&shell)) {
+	if (!mysh_init(&shell, script_path == NULL && replay_path == NULL)) {
 		fprintf(stderr, "mysh: error occurred in initialization process.\n");
 		return EXIT_FAILURE;
 	}
-	
+
+	// the recorded lines go through the same loop as typed ones
+	if (replay_path != NULL) {
+		if (!mysh_start_replay(replay_path, is_stubbing)) {
+			mysh_terminate(&shell);
+			return EXIT_FAILURE;
+		}
+
+		mysh_loop(&shell);
+		mysh_report_replay();
+		mysh_terminate(&shell);
+		return shell.last_status;
+	}
+
+	if (script_path != NULL) {
+		int status = mysh_run_file(&shell, script_path, num_parallel);
+		mysh_terminate(&shell);
+		return status;
+	}
+
+	mysh_start_recording(getenv("MYSH_RECORD"));
 	int loop_err = mysh_loop(&shell);
 	if (loop_err) {
 		fprintf(stderr, "mysh: error occurred in loop process.\n");
@@ -207,7 +297,9 @@ int main(void) {
 		return EXIT_FAILURE;
 	}
 
-	printf("mysh: byebye 👋\n");
+	if (shell.is_interactive) {
+		printf("mysh: byebye 👋\n");
+	}
 
-	return EXIT_SUCCESS;
-}
\ No newline at end of file
+	return shell.last_status;
+}
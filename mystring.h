@@ -7,12 +7,21 @@
 #include <assert.h>
 #include <stdbool.h>
 
+// strings up to MYSH_STRING_INLINE - 1 bytes live in `small` and `ptr` points there,
+// so a mysh_string must not be copied by value once it is initialized
+#define MYSH_STRING_INLINE (24)
+
 typedef struct mysh_string_tag {
     char* ptr;
     size_t length;
     size_t capacity;
+    char small[MYSH_STRING_INLINE];
 } mysh_string;
 
+static bool ms_is_inline(const mysh_string* s) {
+    return s->ptr == s->small;
+}
+
 static bool ms_is_empty(mysh_string* s) {
     return s->ptr == NULL || s->ptr[0] == '\0';
 }
@@ -21,18 +30,29 @@ static size_t ms_reserve(mysh_string* s, size_t len) {
     assert(s != NULL);
 
     if (s->ptr == NULL) {
-        s->capacity = 8;
+        s->ptr = s->small;
+        s->ptr[0] = '\0';
+        s->capacity = MYSH_STRING_INLINE;
     }
-    
-    while (s->capacity < len + 1) {
-        s->capacity *= 2;
+
+    if (s->capacity >= len + 1) {
+        return s->capacity;
     }
 
-    if (s->ptr == NULL) {
-        s->ptr = malloc(s->capacity * sizeof(char));
+    size_t cap = s->capacity;
+    while (cap < len + 1) {
+        cap *= 2;
+    }
+
+    if (ms_is_inline(s)) {
+        char* ptr = (char*)malloc(cap * sizeof(char));
+        if (ptr != NULL) {
+            memcpy(ptr, s->small, s->length + 1);
+        }
+        s->ptr = ptr;
     }
     else {
-        s->ptr = realloc(s->ptr, s->capacity * sizeof(char));
+        s->ptr = (char*)realloc(s->ptr, cap * sizeof(char));
     }
 
     if (s->ptr == NULL) {
@@ -40,30 +60,27 @@ static size_t ms_reserve(mysh_string* s, size_t len) {
         exit(EXIT_FAILURE);
     }
 
+    s->capacity = cap;
     return s->capacity;
 }
 
-static void ms_init(mysh_string* str, const char* src) {
+static void ms_init_n(mysh_string* str, const char* src, size_t len) {
     if (str == NULL || src == NULL || str->ptr != NULL)
         return;
 
-    size_t len = strlen(src);
-
-    size_t cap = 8;
-    while (cap < len + 1) {
-        cap *= 2;
-    }
-    
-    str->ptr = (char*)malloc(cap * sizeof(char));
-    if (str->ptr == NULL) {
-        fprintf(stderr, "mysh: error occurred in allocation.\n");
-        exit(EXIT_FAILURE);
-    }
+    str->length = 0;
+    ms_reserve(str, len);
 
+    memcpy(str->ptr, src, len);
+    str->ptr[len] = '\0';
     str->length = len;
-    str->capacity = cap;
+}
+
+static void ms_init(mysh_string* str, const char* src) {
+    if (str == NULL || src == NULL || str->ptr != NULL)
+        return;
 
-    strcpy(str->ptr, src);
+    ms_init_n(str, src, strlen(src));
 }
 
 static mysh_string* ms_new() {
@@ -80,33 +97,36 @@ static mysh_string* ms_new() {
     return s;
 }
 
-static void ms_assign(mysh_string* s1, const mysh_string* s2) {
-    assert(s1 != NULL);
+static void ms_assign_n(mysh_string* str, const char* src, size_t len) {
+    assert(str != NULL);
 
-    if (s1->ptr == NULL) {
-        ms_init(s1, s2->ptr);
+    if (str->ptr == NULL) {
+        ms_init_n(str, src, len);
         return;
     }
 
-    ms_reserve(s1, s2->length);
-    s1->length = s2->length;
-
-    strcpy(s1->ptr, s2->ptr);
+    ms_reserve(str, len);
+    // `src` may point into `str` itself
+    memmove(str->ptr, src, len);
+    str->ptr[len] = '\0';
+    str->length = len;
 }
 
-static void ms_assign_raw(mysh_string* str, const char* src) {
-    assert(str != NULL);
+static void ms_assign(mysh_string* s1, const mysh_string* s2) {
+    assert(s1 != NULL);
 
-    if (str->ptr == NULL) {
-        ms_init(str, src);
+    if (s2->ptr == NULL) {
+        ms_assign_n(s1, "", 0);
         return;
     }
 
-    size_t len = strlen(src);
-    ms_reserve(str, len);
-    str->length = len;
+    ms_assign_n(s1, s2->ptr, s2->length);
+}
+
+static void ms_assign_raw(mysh_string* str, const char* src) {
+    assert(str != NULL);
 
-    strcpy(str->ptr, src);
+    ms_assign_n(str, src, strlen(src));
 }
 
 // static void ms_shrink(mysh_string* s) {
@@ -139,7 +159,7 @@ static void ms_assign_raw(mysh_string* str, const char* src) {
 static void ms_relase(mysh_string* s) {
     assert(s != NULL);
 
-    if (s->ptr != NULL) {
+    if (s->ptr != NULL && !ms_is_inline(s)) {
         free(s->ptr);
     }
 
@@ -156,10 +176,6 @@ static void ms_free(mysh_string* s) {
 static void ms_push(mysh_string* s, char c) {
     assert(s != NULL);
 
-    if (s->ptr == NULL) {
-        ms_init(s, "");
-    }
-
     ms_reserve(s, s->length + 1);
 
     s->ptr[s->length] = c;
@@ -168,40 +184,34 @@ static void ms_push(mysh_string* s, char c) {
     ++s->length;
 }
 
-// static void ms_append(mysh_string* s1, const mysh_string* s2) {
-//     assert(s1 != NULL && s2 != NULL);
-
-//     if (s2->ptr == NULL) {
-//         return;
-//     }
-//     if (s1->ptr == NULL) {
-//         ms_init(s1, s2->ptr);
-//         return;
-//     }
-
-//     ms_reserve(s1, s1->length + s2->length);
+// appends `len` bytes of `src`, which need not be terminated
+static void ms_append_n(mysh_string* str, const char* src, size_t len) {
+    assert(str != NULL && src != NULL);
 
-//     strcpy(s1->ptr + s1->length, s2->ptr);
+    ms_reserve(str, str->length + len);
 
-//     s1->length += s2->length;
-// }
+    memcpy(str->ptr + str->length, src, len);
+    str->length += len;
+    str->ptr[str->length] = '\0';
+}
 
-static void ms_append_raw(mysh_string* str, const char* src) {
-    assert(str != NULL && src != NULL);
+static void ms_append(mysh_string* s1, const mysh_string* s2) {
+    assert(s1 != NULL && s2 != NULL);
 
-    if (str->ptr == NULL) {
-        ms_init(str, src);
+    if (s2->ptr == NULL) {
         return;
     }
 
-    size_t len = strlen(src);
-    ms_reserve(str, str->length + len);
+    ms_append_n(s1, s2->ptr, s2->length);
+}
 
-    strcpy(str->ptr + str->length, src);
+static void ms_append_raw(mysh_string* str, const char* src) {
+    assert(str != NULL && src != NULL);
 
-    str->length += len;
+    ms_append_n(str, src, strlen(src));
 }
 
+// hands the buffer over to the caller, who frees it
 static char* ms_into_chars(mysh_string* str) {
     assert(str != NULL);
 
@@ -210,6 +220,15 @@ static char* ms_into_chars(mysh_string* str) {
     }
 
     char* ptr = str->ptr;
+    if (ms_is_inline(str)) {
+        ptr = (char*)malloc(str->length + 1);
+        if (ptr == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(ptr, str->small, str->length + 1);
+    }
+
     str->ptr = NULL;
     str->length = 0;
     str->capacity = 0;
@@ -0,0 +1,414 @@
+#ifndef MYSH_PARALLEL_H
+#define MYSH_PARALLEL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "tokenizer.h"
+#include "process.h"
+#include "parser.h"
+#include "job.h"
+#include "builtins.h"
+#include "function.h"
+#include "exec.h"
+#include "copy.h"
+
+// `mysh [-j N] script` runs a script file line by line. with -j, consecutive lines run concurrently
+// unless one of them writes a file another one reads or writes, judged by their redirect targets.
+// lines which may change the shell itself (builtins such as cd, assignments, functions, `&`) and
+// `wait` lines are barriers: everything before them finishes first and they run in the shell.
+// output of every line is buffered and written in the order of the lines
+
+typedef struct {
+    char* data;
+    size_t length;
+    size_t pos;
+} mysh_file_reader;
+
+typedef enum {
+    line_waiting,
+    line_running,
+    line_done
+} mysh_line_state;
+
+typedef struct {
+    mysh_command_list* list;
+    // absolute paths of redirect targets
+    char** reads;
+    int num_reads;
+    char** writes;
+    int num_writes;
+
+    mysh_line_state state;
+    pid_t pid;
+    int out_fd;
+    int err_fd;
+    int status;
+} mysh_script_line;
+
+// mysh_line_reader over the lines of a file
+static bool mysh_next_file_line(void* ctx, mysh_string* line) {
+    mysh_file_reader* reader = (mysh_file_reader*)ctx;
+    if (reader->pos >= reader->length) {
+        return false;
+    }
+
+    char* begin = reader->data + reader->pos;
+    char* nl = memchr(begin, '\n', reader->length - reader->pos);
+    size_t len = (nl != NULL ? (size_t)(nl - begin) : reader->length - reader->pos);
+    reader->pos += len + (nl != NULL);
+
+    ms_assign_n(line, begin, len);
+
+    return true;
+}
+
+static bool mysh_load_file(const char* path, mysh_file_reader* reader) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "mysh: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    mysh_string data = { NULL, 0, 0, { 0 } };
+    mysh_read_all(fd, &data);
+    close(fd);
+
+    reader->length = data.length;
+    reader->data = ms_into_chars(&data);
+    reader->pos = 0;
+
+    return true;
+}
+
+// parses the next command of the script, NULL at the end. comments and lines with syntax errors are skipped
+static mysh_command_list* mysh_parse_file_line(mysh_file_reader* reader) {
+    mysh_string line = { NULL, 0, 0, { 0 } };
+    ms_init(&line, "");
+
+    mysh_command_list* list = NULL;
+    while (list == NULL && mysh_next_file_line(reader, &line)) {
+        const char* p = line.ptr;
+        while (*p == ' ' || *p == '\t') {
+            ++p;
+        }
+        if (*p == '#' || *p == '\0') {
+            continue;
+        }
+
+        list = mysh_parse_input(line.ptr, mysh_next_file_line, reader);
+    }
+    ms_relase(&line);
+
+    return list;
+}
+
+static void mysh_add_path(char*** paths, int* num, const char* word) {
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    if (word[0] == '/') {
+        ms_init(&path, "");
+    }
+    else {
+        char* cwd = getcwd(NULL, 0);
+        ms_init(&path, cwd != NULL ? cwd : ".");
+        ms_push(&path, '/');
+        free(cwd);
+
+        while (strncmp(word, "./", 2) == 0) {
+            word += 2;
+        }
+    }
+
+    for (const char* p = word; *p != '\0'; ++p) {
+        if (*p != MYSH_CTL_ESC) {
+            ms_push(&path, *p);
+        }
+    }
+
+    *paths = (char**)realloc(*paths, sizeof(char*) * (*num + 1));
+    if (*paths == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+    (*paths)[(*num)++] = ms_into_chars(&path);
+}
+
+// true if `word` is the same whatever the shell state is
+static bool mysh_is_static_word(const char* word) {
+    return strchr(word, MYSH_CTL_VAR) == NULL && strchr(word, MYSH_CTL_PROCSUB) == NULL && strchr(word, MYSH_CTL_CMDSUB) == NULL
+        && strchr(word, MYSH_CTL_ARITH) == NULL;
+}
+
+// builtins which do not touch the shell, so they may run in a child
+static bool mysh_is_pure_builtin(const char* name) {
+    return strcmp(name, "echo") == 0 || strcmp(name, "batch") == 0 || strcmp(name, "cache") == 0 || strcmp(name, "mug") == 0
+        || strcmp(name, "cat") == 0 || strcmp(name, "tee") == 0;
+}
+
+// collects redirect targets of `list`. returns false if the line has to be a barrier
+static bool mysh_collect_paths(mysh_resource* shell, mysh_command_list* list, mysh_script_line* line) {
+    for (mysh_command_list* entry = list; entry != NULL; entry = entry->next) {
+        if (!entry->is_foreground) {
+            return false;
+        }
+
+        for (mysh_process* proc = entry->pipeline; proc != NULL; proc = proc->next) {
+            if (proc->kind == process_function) {
+                return false;
+            }
+            if (proc->kind == process_simple) {
+                // the parsed template does not know its assignments yet
+                int num_assigns = mysh_count_assignments(proc->argv, proc->argc);
+                if (proc->argc == num_assigns) {
+                    return false;
+                }
+
+                const char* name = proc->argv[num_assigns];
+                if (!mysh_is_static_word(name) || mysh_find_function(shell, name) != NULL) {
+                    return false;
+                }
+                if (mysh_find_builtin(name) != NULL && !mysh_is_pure_builtin(name)) {
+                    return false;
+                }
+            }
+            else if (!mysh_collect_paths(shell, proc->body, line)) {
+                return false;
+            }
+
+            for (int i = 0; i < proc->num_redirects; ++i) {
+                mysh_redirect_data* r = &proc->redirects[i];
+                if (r->kind != redirect_in && r->kind != redirect_out && r->kind != redirect_out_append) {
+                    continue;
+                }
+                if (!mysh_is_static_word(r->filename->ptr)) {
+                    return false;
+                }
+                // devices do not order anything
+                if (strncmp(r->filename->ptr, "/dev/", 5) == 0) {
+                    continue;
+                }
+
+                if (r->kind == redirect_in) {
+                    mysh_add_path(&line->reads, &line->num_reads, r->filename->ptr);
+                }
+                else {
+                    mysh_add_path(&line->writes, &line->num_writes, r->filename->ptr);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+static bool mysh_paths_overlap(char** a, int num_a, char** b, int num_b) {
+    for (int i = 0; i < num_a; ++i) {
+        for (int j = 0; j < num_b; ++j) {
+            if (strcmp(a[i], b[j]) == 0) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// whether `later` has to wait for `earlier`
+static bool mysh_lines_conflict(const mysh_script_line* earlier, const mysh_script_line* later) {
+    return mysh_paths_overlap(earlier->writes, earlier->num_writes, later->writes, later->num_writes)
+        || mysh_paths_overlap(earlier->writes, earlier->num_writes, later->reads, later->num_reads)
+        || mysh_paths_overlap(earlier->reads, earlier->num_reads, later->writes, later->num_writes);
+}
+
+static void mysh_release_script_line(mysh_script_line* line) {
+    for (int i = 0; i < line->num_reads; ++i) {
+        free(line->reads[i]);
+    }
+    for (int i = 0; i < line->num_writes; ++i) {
+        free(line->writes[i]);
+    }
+    free(line->reads);
+    free(line->writes);
+    if (line->list != NULL) {
+        mysh_release_list(line->list);
+    }
+}
+
+// the buffered output of a line, which sendfile() moves without reading it in
+static void mysh_flush_line_output(int from, int to) {
+    lseek(from, 0, SEEK_SET);
+    mysh_copy_fd(from, to);
+}
+
+static bool mysh_start_script_line(mysh_resource* shell, mysh_script_line* line) {
+    line->out_fd = memfd_create("mysh-line-out", MFD_CLOEXEC);
+    line->err_fd = memfd_create("mysh-line-err", MFD_CLOEXEC);
+    if (line->out_fd < 0 || line->err_fd < 0) {
+        perror("mysh: failed to buffer output");
+        return false;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("mysh: failed to fork");
+        return false;
+    }
+
+    if (pid == 0) {
+        dup2(line->out_fd, STDOUT_FILENO);
+        dup2(line->err_fd, STDERR_FILENO);
+
+        int status = mysh_run_list(shell, line->list);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(status);
+    }
+
+    line->pid = pid;
+    line->state = line_running;
+
+    return true;
+}
+
+// runs lines[begin, end), none of which is a barrier, at most `num_parallel` at once
+static void mysh_run_script_lines(mysh_resource* shell, mysh_script_line* lines, int begin, int end, int num_parallel) {
+    int next_output = begin;
+    int num_running = 0;
+
+    while (next_output < end) {
+        for (int i = next_output; i < end && num_running < num_parallel; ++i) {
+            if (lines[i].state != line_waiting) {
+                continue;
+            }
+
+            bool is_ready = true;
+            for (int j = next_output; j < i && is_ready; ++j) {
+                is_ready = (lines[j].state == line_done || !mysh_lines_conflict(&lines[j], &lines[i]));
+            }
+
+            if (!is_ready) {
+                continue;
+            }
+            if (!mysh_start_script_line(shell, &lines[i])) {
+                lines[i].state = line_done;
+                lines[i].status = 1;
+                continue;
+            }
+            ++num_running;
+        }
+
+        if (num_running > 0) {
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0 && errno == EINTR) {
+                continue;
+            }
+            if (pid < 0) {
+                break;
+            }
+
+            bool is_line = false;
+            for (int i = next_output; i < end; ++i) {
+                if (lines[i].state == line_running && lines[i].pid == pid) {
+                    lines[i].state = line_done;
+                    lines[i].status = (WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+                    --num_running;
+                    is_line = true;
+                    break;
+                }
+            }
+
+            // a background job of an earlier barrier line
+            if (!is_line) {
+                mysh_set_status(shell->first_job, pid, status);
+            }
+        }
+
+        while (next_output < end && lines[next_output].state == line_done) {
+            mysh_script_line* line = &lines[next_output++];
+            if (line->out_fd >= 0) {
+                mysh_flush_line_output(line->out_fd, STDOUT_FILENO);
+                close(line->out_fd);
+            }
+            if (line->err_fd >= 0) {
+                mysh_flush_line_output(line->err_fd, STDERR_FILENO);
+                close(line->err_fd);
+            }
+
+            shell->last_status = line->status;
+        }
+    }
+}
+
+// runs the script at `path`, with up to `num_parallel` lines at once. returns the last status
+static int mysh_run_file(mysh_resource* shell, const char* path, int num_parallel) {
+    mysh_file_reader reader;
+    if (!mysh_load_file(path, &reader)) {
+        return 127;
+    }
+
+    // parsing is independent of the shell state, expansion happens when a line runs
+    mysh_script_line* lines = NULL;
+    int num_lines = 0;
+    int capacity = 0;
+    mysh_command_list* list;
+    while ((list = mysh_parse_file_line(&reader)) != NULL) {
+        if (num_lines == capacity) {
+            capacity = (capacity == 0 ? 64 : capacity * 2);
+            lines = (mysh_script_line*)realloc(lines, sizeof(mysh_script_line) * capacity);
+            if (lines == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        mysh_script_line* line = &lines[num_lines++];
+        memset(line, 0, sizeof(*line));
+        line->list = list;
+        line->out_fd = -1;
+        line->err_fd = -1;
+    }
+    free(reader.data);
+
+    int begin = 0;
+    while (begin < num_lines && !shell->is_exiting) {
+        // which lines are barriers depends on what the previous barrier defined
+        int end = begin;
+        if (num_parallel > 1) {
+            while (end < num_lines && mysh_collect_paths(shell, lines[end].list, &lines[end])) {
+                ++end;
+            }
+            mysh_run_script_lines(shell, lines, begin, end, num_parallel);
+        }
+
+        if (end < num_lines) {
+            shell->last_status = mysh_run_list(shell, lines[end].list);
+            shell->is_returning = false;
+            fflush(stdout);
+        }
+
+        begin = end + 1;
+    }
+
+    for (int i = 0; i < num_lines; ++i) {
+        mysh_release_script_line(&lines[i]);
+    }
+    free(lines);
+
+    return shell->last_status;
+}
+
+#endif // MYSH_PARALLEL_H
@@ -8,123 +8,557 @@
 #include <assert.h>
 #include <stdio.h>
 
-static bool mysh_parse_tokens(mysh_tokenized_component** coms, int size, mysh_process* top, bool* is_foreground) {
-	assert(coms != NULL);
-	assert(size > 0);
-	assert(top != NULL);
+// reads one more line of input (e.g. a here-document body) into `line`. returns false at EOF
+typedef bool (*mysh_line_reader)(void* ctx, mysh_string* line);
 
-	*is_foreground = true;
+typedef struct {
+	mysh_tokenized_component** coms;
+	int size;
+	int capacity;
+	int pos;
+	const char* line;
 
-	mysh_process* cur = top;
+	mysh_line_reader read_line;
+	void* reader_ctx;
+	// the input line and the continuation lines read after it, once there are any.
+	// `line` then points into it
+	mysh_string text;
+} mysh_parser;
+
+static mysh_command_list* mysh_parse_list(mysh_parser* parser, int end_token);
+
+static bool mysh_parser_isend(mysh_parser* parser) {
+	return parser->pos >= parser->size;
+}
+
+static bool mysh_parser_peek(mysh_parser* parser, mysh_token token) {
+	return !mysh_parser_isend(parser) && parser->coms[parser->pos]->token == token;
+}
+
+static bool mysh_parser_peek_word(mysh_parser* parser) {
+	return mysh_parser_peek(parser, token_string) || mysh_parser_peek(parser, token_lbrace) || mysh_parser_peek(parser, token_rbrace);
+}
+
+// appends the tokens of the next non-empty line of input, for a `{` or `(` which is not
+// closed on its line. returns false at EOF
+static bool mysh_parser_read_more(mysh_parser* parser) {
+	if (parser->read_line == NULL) {
+		return false;
+	}
+
+	if (parser->text.ptr == NULL) {
+		const char* eof = strchr(parser->line, EOF);
+		ms_init_n(&parser->text, parser->line, (eof != NULL ? (size_t)(eof - parser->line) : strlen(parser->line)));
+	}
+
+	mysh_string line = { NULL, 0, 0, { 0 } };
+	int size = 0;
+	mysh_tokenized_component** coms = NULL;
+	while (size == 0) {
+		if (coms != NULL) {
+			free(coms);
+			coms = NULL;
+		}
+		if (!parser->read_line(parser->reader_ctx, &line)) {
+			ms_relase(&line);
+			return false;
+		}
+
+		const char* p = line.ptr;
+		while (*p == ' ' || *p == '\t') {
+			++p;
+		}
+		if (*p == '#') {
+			continue;
+		}
+
+		coms = mysh_tokenize(line.ptr, &size);
+		if (coms == NULL) {
+			ms_relase(&line);
+			return false;
+		}
+	}
+
+	// the newline separates commands like `;`
+	ms_push(&parser->text, '\n');
+	int offset = (int)parser->text.length;
+	ms_append(&parser->text, &line);
+	parser->line = parser->text.ptr;
+	ms_relase(&line);
+
+	if (parser->capacity < parser->size + size) {
+		parser->capacity = parser->size + size;
+		parser->coms = (mysh_tokenized_component**)realloc(parser->coms, sizeof(void*) * parser->capacity);
+		if (parser->coms == NULL) {
+			fprintf(stderr, "mysh: error occurred in allocation.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
 	for (int i = 0; i < size; ++i) {
-		if (coms[i]->token == token_background) {
-			if (i + 1 != size) {
-				mysh_release_process(top);
-				fprintf(stderr, "mysh: '&' must be placed in the end of line\n");
-				return false;
-			}
-			else {
-				*is_foreground = false;
-			}
+		coms[i]->begin += offset;
+		coms[i]->end += offset;
+		parser->coms[parser->size++] = coms[i];
+	}
+	free(coms);
+
+	return true;
+}
+
+static void mysh_parser_error(mysh_parser* parser) {
+	if (mysh_parser_isend(parser)) {
+		fprintf(stderr, "mysh: syntax error: unexpected end of line\n");
+		return;
+	}
+
+	mysh_tokenized_component* com = parser->coms[parser->pos];
+	fprintf(stderr, "mysh: syntax error near unexpected token `%.*s'\n", com->end - com->begin, parser->line + com->begin);
+}
+
+// takes the word out of the current token
+static char* mysh_parser_take_word(mysh_parser* parser) {
+	assert(mysh_parser_peek_word(parser));
+
+	char* word = ms_into_chars((mysh_string*)parser->coms[parser->pos]->data);
+	++parser->pos;
+
+	return word;
+}
+
+static void mysh_push_arg(mysh_process* cur, char* word) {
+	++cur->argc;
+	if (cur->argv == NULL) {
+		cur->argv = (char**)malloc(sizeof(char*) * 2);
+	}
+	else {
+		cur->argv = (char**)realloc(cur->argv, sizeof(char*) * (cur->argc + 1));
+	}
+
+	if (cur->argv == NULL) {
+		fprintf(stderr, "mysh: error occurred in allocation.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	cur->argv[cur->argc - 1] = word;
+	cur->argv[cur->argc] = NULL;
+}
+
+// reads the here-document body which follows the current line. `content` holds the delimiter
+// on entry and the body on return; the body is expanded on every run unless the delimiter is quoted
+static bool mysh_parse_heredoc(mysh_parser* parser, mysh_string* content, bool is_quoted) {
+	if (parser->read_line == NULL) {
+		fprintf(stderr, "mysh: here-document is not available here\n");
+		return false;
+	}
+
+	char* delim = ms_into_chars(content);
+	mysh_string body = { NULL, 0, 0, { 0 } };
+	mysh_string line = { NULL, 0, 0, { 0 } };
+	ms_init(&body, "");
+
+	bool found = false;
+	while (parser->read_line(parser->reader_ctx, &line)) {
+		if (strcmp(line.ptr, delim) == 0) {
+			found = true;
+			break;
 		}
-		if (coms[i]->token == token_string) {
-			if (cur->num_redirects != 0) {
-				mysh_release_process(top);
+
+		ms_append_raw(&body, line.ptr);
+		ms_push(&body, '\n');
+	}
+
+	if (!found) {
+		fprintf(stderr, "mysh: warning: here-document delimited by end-of-file (wanted `%s')\n", delim);
+	}
+
+	if (is_quoted) {
+		ms_assign(content, &body);
+	}
+	else {
+		mysh_tokenize_heredoc(body.ptr, content);
+	}
+
+	free(delim);
+	ms_relase(&body);
+	ms_relase(&line);
+
+	return true;
+}
+
+static bool mysh_parse_redirect(mysh_parser* parser, mysh_process* cur) {
+	mysh_redirect_data* red = (mysh_redirect_data*)parser->coms[parser->pos]->data;
+	++parser->pos;
+
+	++cur->num_redirects;
+	cur->redirects = (mysh_redirect_data*)realloc(cur->redirects, sizeof(mysh_redirect_data) * cur->num_redirects);
+	if (cur->redirects == NULL) {
+		fprintf(stderr, "mysh: error occurred in allocation.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	mysh_redirect_data* dst = &cur->redirects[cur->num_redirects - 1];
+	dst->kind = red->kind;
+	dst->ffd = red->ffd;
+	dst->tfd = red->tfd;
+	dst->filename = ms_new();
+
+	if (red->kind != redirect_fd) {
+		if (!mysh_parser_peek_word(parser)) {
+			fprintf(stderr, "mysh: please specify output file of redirection\n");
+			return false;
+		}
+
+		bool is_quoted = (parser->line[parser->coms[parser->pos]->begin] == '"' || parser->line[parser->coms[parser->pos]->begin] == '\'');
+		char* name = mysh_parser_take_word(parser);
+		ms_init(dst->filename, name);
+		free(name);
+
+		if (red->kind == redirect_heredoc && !mysh_parse_heredoc(parser, dst->filename, is_quoted)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static mysh_process* mysh_parse_simple_command(mysh_parser* parser) {
+	mysh_process* proc = mysh_new_process();
+
+	while (!mysh_parser_isend(parser)) {
+		if (mysh_parser_peek_word(parser)) {
+			if (proc->num_redirects != 0) {
+				mysh_release_process(proc);
 				fprintf(stderr, "mysh: program arguments must appear before redirects\n");
-				return false;
+				return NULL;
 			}
 
-			++cur->argc;
-			if (cur->argv == NULL) {
-				cur->argv = (char**)malloc(sizeof(char*));
-			}
-			else {
-				cur->argv = (char**)realloc(cur->argv, sizeof(char*) * (cur->argc + 1));
+			mysh_push_arg(proc, mysh_parser_take_word(parser));
+		}
+		else if (mysh_parser_peek(parser, token_redirect)) {
+			if (proc->argc == 0) {
+				mysh_release_process(proc);
+				fprintf(stderr, "mysh: please specify program name\n");
+				return NULL;
 			}
 
-			if (cur->argv == NULL) {
-				fprintf(stderr, "mysh: error occurred in allocation.\n");
-        		exit(EXIT_FAILURE);
+			if (!mysh_parse_redirect(parser, proc)) {
+				mysh_release_process(proc);
+				return NULL;
 			}
+		}
+		else {
+			break;
+		}
+	}
 
-			cur->argv[cur->argc - 1] = (char*)malloc(sizeof(char) * (((mysh_string*)coms[i]->data)->length + 1));
-			if (cur->argv[cur->argc - 1] == NULL) {
-				fprintf(stderr, "mysh: error occurred in allocation.\n");
-        		exit(EXIT_FAILURE);
-			}
+	if (proc->argc == 0) {
+		mysh_release_process(proc);
+		mysh_parser_error(parser);
+		return NULL;
+	}
 
-			cur->argv[cur->argc - 1] = ms_into_chars((mysh_string*)coms[i]->data);
+	return proc;
+}
 
-			cur->argv[cur->argc] = NULL;
+// `{ list; }`
+static mysh_process* mysh_parse_group(mysh_parser* parser) {
+	assert(mysh_parser_peek(parser, token_lbrace));
+	++parser->pos;
+
+	mysh_command_list* body = mysh_parse_list(parser, token_rbrace);
+	if (body == NULL) {
+		return NULL;
+	}
+
+	if (!mysh_parser_peek(parser, token_rbrace)) {
+		mysh_release_list(body);
+		mysh_parser_error(parser);
+		return NULL;
+	}
+	++parser->pos;
+
+	mysh_process* proc = mysh_new_process();
+	proc->kind = process_group;
+	proc->body = body;
+
+	return proc;
+}
+
+// `( list )`
+static mysh_process* mysh_parse_subshell(mysh_parser* parser) {
+	assert(mysh_parser_peek(parser, token_lparen));
+	++parser->pos;
+
+	mysh_command_list* body = mysh_parse_list(parser, token_rparen);
+	if (body == NULL) {
+		return NULL;
+	}
+
+	if (!mysh_parser_peek(parser, token_rparen)) {
+		mysh_release_list(body);
+		mysh_parser_error(parser);
+		return NULL;
+	}
+	++parser->pos;
+
+	mysh_process* proc = mysh_new_process();
+	proc->kind = process_subshell;
+	proc->body = body;
+
+	return proc;
+}
+
+// `{ list; }` or `( list )` followed by redirects
+static mysh_process* mysh_parse_compound(mysh_parser* parser) {
+	mysh_process* proc = (mysh_parser_peek(parser, token_lbrace) ? mysh_parse_group(parser) : mysh_parse_subshell(parser));
+	if (proc == NULL) {
+		return NULL;
+	}
+
+	while (mysh_parser_peek(parser, token_redirect)) {
+		if (!mysh_parse_redirect(parser, proc)) {
+			mysh_release_process(proc);
+			return NULL;
 		}
-		if (coms[i]->token == token_pipe) {
-			cur->next = mysh_new_process();
-			cur = cur->next;
+	}
+
+	return proc;
+}
+
+// `name() { list; }` or `name() ( list )`
+static mysh_process* mysh_parse_function(mysh_parser* parser) {
+	char* name = mysh_parser_take_word(parser);
+	if (!mysh_is_var_name(name, strlen(name))) {
+		fprintf(stderr, "mysh: `%s': not a valid function name\n", name);
+		free(name);
+		return NULL;
+	}
+
+	// `(` `)`, and the body may start on the next line
+	parser->pos += 2;
+	if (mysh_parser_isend(parser)) {
+		mysh_parser_read_more(parser);
+	}
+	if (!mysh_parser_peek(parser, token_lbrace) && !mysh_parser_peek(parser, token_lparen)) {
+		free(name);
+		mysh_parser_error(parser);
+		return NULL;
+	}
+
+	mysh_process* group = mysh_parse_compound(parser);
+	if (group == NULL) {
+		free(name);
+		return NULL;
+	}
+
+	mysh_process* proc = mysh_new_process();
+	proc->kind = process_function;
+	proc->name = name;
+	proc->body = mysh_new_command_list();
+	proc->body->pipeline = group;
+
+	return proc;
+}
+
+static mysh_process* mysh_parse_command(mysh_parser* parser) {
+	if (mysh_parser_peek(parser, token_string)
+		&& parser->pos + 2 < parser->size
+		&& parser->coms[parser->pos + 1]->token == token_lparen
+		&& parser->coms[parser->pos + 2]->token == token_rparen) {
+		return mysh_parse_function(parser);
+	}
+
+	if (mysh_parser_peek(parser, token_lbrace) || mysh_parser_peek(parser, token_lparen)) {
+		return mysh_parse_compound(parser);
+	}
+
+	if (mysh_parser_peek(parser, token_string) || mysh_parser_peek(parser, token_redirect)) {
+		return mysh_parse_simple_command(parser);
+	}
+
+	mysh_parser_error(parser);
+	return NULL;
+}
+
+static mysh_process* mysh_parse_pipeline(mysh_parser* parser) {
+	mysh_process* top = mysh_parse_command(parser);
+	if (top == NULL) {
+		return NULL;
+	}
+
+	mysh_process* cur = top;
+	while (mysh_parser_peek(parser, token_pipe)) {
+		++parser->pos;
+
+		cur->next = mysh_parse_command(parser);
+		if (cur->next == NULL) {
+			mysh_release_process(top);
+			return NULL;
 		}
-		if (coms[i]->token == token_redirect) {
-			if (cur->argc == 0) {
-				mysh_release_process(top);
-				fprintf(stderr, "mysh: please specify program name\n");
-				return false;
-			}
+		cur = cur->next;
+	}
 
-			++cur->num_redirects;
-			if (cur->redirects == NULL) {
-				cur->redirects = (mysh_redirect_data*)malloc(sizeof(mysh_redirect_data));
-			}
-			else {
-				cur->redirects = (mysh_redirect_data*)realloc(cur->redirects, sizeof(mysh_redirect_data*) * cur->num_redirects);
-			}
+	return top;
+}
 
-			if (cur->redirects == NULL) {
-				fprintf(stderr, "mysh: error occurred in allocation.\n");
-        		exit(EXIT_FAILURE);
-			}
+// copies the source text of tokens [first, last] into the job name of `entry`
+static void mysh_parser_set_command(mysh_parser* parser, mysh_command_list* entry, int first, int last) {
+	int begin = parser->coms[first]->begin;
+	int end = parser->coms[last]->end;
+	ms_assign_n(&entry->command, parser->line + begin, end - begin);
+}
 
-			mysh_redirect_data* red = (mysh_redirect_data*)coms[i]->data;
+// `pipeline && pipeline || pipeline ...`
+static mysh_command_list* mysh_parse_and_or(mysh_parser* parser) {
+	mysh_command_list* head = NULL;
+	mysh_command_list* tail = NULL;
+	mysh_connector connector = connect_always;
 
-			cur->redirects[cur->num_redirects - 1].kind = red->kind;
-			cur->redirects[cur->num_redirects - 1].ffd = red->ffd;
-			cur->redirects[cur->num_redirects - 1].tfd = red->tfd;
-			if (red->kind != redirect_fd) {
-				if (i + 1 == size || coms[i + 1]->token != token_string) {
-					fprintf(stderr, "mysh: please specify output file of redirection\n");
-					return false;
-				}
-				ms_assign(red->filename, (mysh_string*)coms[i + 1]->data);
+	while (true) {
+		int first = parser->pos;
 
-				++i;
+		mysh_process* pipeline = mysh_parse_pipeline(parser);
+		if (pipeline == NULL) {
+			if (head != NULL) {
+				mysh_release_list(head);
 			}
-			if (red->kind == redirect_out && red->tfd == -1) {
-				red->tfd = 0;
+			return NULL;
+		}
+
+		mysh_command_list* entry = mysh_new_command_list();
+		entry->pipeline = pipeline;
+		entry->connector = connector;
+		mysh_parser_set_command(parser, entry, first, parser->pos - 1);
+
+		if (head == NULL) {
+			head = entry;
+		}
+		else {
+			tail->next = entry;
+		}
+		tail = entry;
+
+		if (mysh_parser_peek(parser, token_and)) {
+			connector = connect_and;
+		}
+		else if (mysh_parser_peek(parser, token_or)) {
+			connector = connect_or;
+		}
+		else {
+			break;
+		}
+		++parser->pos;
+	}
+
+	return head;
+}
+
+// parses until `end_token` (not consumed) or the end of line if it is -1
+// lists inside `{ }` and `( )` continue on the following lines until the closing token
+static mysh_command_list* mysh_parse_list(mysh_parser* parser, int end_token) {
+	mysh_command_list* head = NULL;
+	mysh_command_list* tail = NULL;
+
+	while (true) {
+		if (mysh_parser_isend(parser) && (end_token == -1 || !mysh_parser_read_more(parser))) {
+			break;
+		}
+		if ((int)parser->coms[parser->pos]->token == end_token) {
+			break;
+		}
+
+		int first = parser->pos;
+
+		mysh_command_list* chain = mysh_parse_and_or(parser);
+		if (chain == NULL) {
+			if (head != NULL) {
+				mysh_release_list(head);
 			}
-			
-			if (!ms_is_empty(red->filename)) {
-				cur->redirects[cur->num_redirects - 1].filename = ms_new();
-				ms_assign(cur->redirects[cur->num_redirects - 1].filename, red->filename);
+			return NULL;
+		}
+
+		if (mysh_parser_peek(parser, token_background)) {
+			// `a && b &` runs the whole chain in the background
+			if (chain->next != NULL) {
+				mysh_process* proc = mysh_new_process();
+				proc->kind = process_subshell;
+				proc->body = chain;
+
+				chain = mysh_new_command_list();
+				chain->pipeline = proc;
 			}
-			else {
-				cur->redirects[cur->num_redirects - 1].filename = red->filename;
+
+			chain->is_foreground = false;
+			// the job name keeps a trailing '&'
+			mysh_parser_set_command(parser, chain, first, parser->pos);
+			++parser->pos;
+		}
+		else if (mysh_parser_peek(parser, token_semicolon)) {
+			++parser->pos;
+		}
+		else if (!mysh_parser_isend(parser) && (int)parser->coms[parser->pos]->token != end_token) {
+			mysh_parser_error(parser);
+			mysh_release_list(chain);
+			if (head != NULL) {
+				mysh_release_list(head);
 			}
+			return NULL;
+		}
+
+		if (head == NULL) {
+			head = chain;
+		}
+		else {
+			tail->next = chain;
+		}
+
+		tail = chain;
+		while (tail->next != NULL) {
+			tail = tail->next;
 		}
 	}
 
-	return true;
+	if (head == NULL) {
+		mysh_parser_error(parser);
+	}
+
+	return head;
 }
 
-static bool mysh_parse_input(char* line, mysh_process* proc, bool* is_foreground) {
+// `read_line` may be NULL if no more input follows `line`
+static mysh_command_list* mysh_parse_input(char* line, mysh_line_reader read_line, void* reader_ctx) {
 	assert(line != NULL);
-	assert(proc != NULL);
-	assert(is_foreground != NULL);
 
-	int size = 0;
-	mysh_tokenized_component** components = mysh_tokenize(line, &size);
+	mysh_parser parser;
+	parser.size = 0;
+	parser.coms = mysh_tokenize(line, &parser.size);
+	if (parser.coms == NULL) {
+		return NULL;
+	}
 
-	if (components == NULL || size <= 0) {
-		return false;
+	parser.capacity = parser.size;
+	parser.pos = 0;
+	parser.line = line;
+	parser.read_line = read_line;
+	parser.reader_ctx = reader_ctx;
+	parser.text = (mysh_string){ NULL, 0, 0, { 0 } };
+
+	mysh_command_list* list = NULL;
+	if (parser.size > 0) {
+		list = mysh_parse_list(&parser, -1);
+		if (list != NULL && !mysh_parser_isend(&parser)) {
+			mysh_parser_error(&parser);
+			mysh_release_list(list);
+			list = NULL;
+		}
+	}
+
+	for (int i = 0; i < parser.size; ++i) {
+		free_tokenized_component(parser.coms[i]);
 	}
+	free(parser.coms);
+	ms_relase(&parser.text);
 
-	return mysh_parse_tokens(components, size, proc, is_foreground);
+	return list;
 }
 
 #endif // MYSH_PARSER_H
\ No newline at end of file
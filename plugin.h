@@ -0,0 +1,197 @@
+#ifndef MYSH_PLUGIN_H
+#define MYSH_PLUGIN_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <dlfcn.h>
+
+#include "shell_resource.h"
+#include "variable.h"
+#include "builtins.h"
+#include "plugin_api.h"
+
+// `enable -f plugin.so name...` dlopen()s a shared object and calls its mysh_plugin_init(),
+// which adds builtins to the builtin table through the api below. see plugin_api.h
+
+typedef struct mysh_plugin_tag {
+    struct mysh_plugin_tag* next;
+    char* path;
+    void* handle;
+} mysh_plugin;
+
+static mysh_plugin* mysh_plugins = NULL;
+
+static const char* mysh_plugin_get_var(void* shell, const char* name) {
+    return mysh_lookup_var(((mysh_resource*)shell)->scope, name);
+}
+
+static void mysh_plugin_set_var(void* shell, const char* name, const char* value) {
+    mysh_set_var(((mysh_resource*)shell)->scope, name, value);
+}
+
+static void mysh_plugin_set_local_var(void* shell, const char* name, const char* value) {
+    mysh_set_local_var(((mysh_resource*)shell)->scope, name, value);
+}
+
+static int mysh_plugin_register(const char* name, mysh_plugin_fn fn, void* ctx) {
+    mysh_builtin* b = mysh_find_builtin(name);
+    if (b != NULL && b->func != NULL) {
+        return -1;
+    }
+
+    if (b == NULL) {
+        b = (mysh_builtin*)calloc(1, sizeof(mysh_builtin));
+        if (b == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        mysh_builtin** bucket = mysh_builtin_bucket(name);
+        b->name = strdup(name);
+        b->next = *bucket;
+        *bucket = b;
+    }
+
+    b->plugin_fn = fn;
+    b->plugin_ctx = ctx;
+
+    return 0;
+}
+
+static const mysh_plugin_api mysh_plugin_api_v1 = {
+    MYSH_PLUGIN_API_VERSION,
+    sizeof(mysh_plugin_api),
+    mysh_plugin_register,
+    mysh_plugin_get_var,
+    mysh_plugin_set_var,
+    mysh_plugin_set_local_var
+};
+
+int mysh_call_plugin(mysh_resource* shell, mysh_builtin* builtin, char** argv) {
+    mysh_plugin_call call;
+    call.argc = 0;
+    while (argv[call.argc] != NULL) {
+        ++call.argc;
+    }
+    call.argv = argv;
+    call.in = stdin;
+    call.out = stdout;
+    call.err = stderr;
+    call.ctx = builtin->plugin_ctx;
+    call.shell = shell;
+
+    return builtin->plugin_fn(&mysh_plugin_api_v1, &call);
+}
+
+// loading the same object twice does nothing
+static bool mysh_load_plugin(const char* path) {
+    for (mysh_plugin* p = mysh_plugins; p != NULL; p = p->next) {
+        if (strcmp(p->path, path) == 0) {
+            return true;
+        }
+    }
+
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "mysh: enable: %s\n", dlerror());
+        return false;
+    }
+
+    mysh_plugin_init_fn init = (mysh_plugin_init_fn)dlsym(handle, MYSH_PLUGIN_INIT_SYMBOL);
+    if (init == NULL) {
+        fprintf(stderr, "mysh: enable: %s: no %s()\n", path, MYSH_PLUGIN_INIT_SYMBOL);
+        dlclose(handle);
+        return false;
+    }
+
+    // builtins registered before a failure still point into the object, so it stays loaded
+    bool ok = (init(&mysh_plugin_api_v1) == 0);
+    if (!ok) {
+        fprintf(stderr, "mysh: enable: %s: failed to initialize\n", path);
+    }
+
+    mysh_plugin* plugin = (mysh_plugin*)malloc(sizeof(mysh_plugin));
+    if (plugin == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    plugin->path = strdup(path);
+    plugin->handle = handle;
+    plugin->next = mysh_plugins;
+    mysh_plugins = plugin;
+
+    return ok;
+}
+
+// removes a builtin loaded by a plugin. the object itself stays loaded
+static bool mysh_delete_builtin(const char* name) {
+    for (mysh_builtin** link = mysh_builtin_bucket(name); *link != NULL; link = &(*link)->next) {
+        mysh_builtin* b = *link;
+        if (strcmp(b->name, name) != 0) {
+            continue;
+        }
+        if (b->func != NULL) {
+            return false;
+        }
+
+        *link = b->next;
+        free((char*)b->name);
+        free(b);
+        return true;
+    }
+
+    return false;
+}
+
+// enable [-f plugin.so [name...] | -d name...]
+int mysh_enable(mysh_resource* shell, char** argv) {
+    if (argv[1] == NULL) {
+        for (size_t i = 0; i < MYSH_NUM_BUILTINS; ++i) {
+            printf("enable %s\n", builtin_str[i]);
+        }
+        for (int i = 0; i < MYSH_BUILTIN_BUCKETS; ++i) {
+            for (mysh_builtin* b = mysh_builtin_table.buckets[i]; b != NULL; b = b->next) {
+                if (b->func == NULL) {
+                    printf("enable %s (plugin)\n", b->name);
+                }
+            }
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "-f") == 0 && argv[2] != NULL) {
+        if (!mysh_load_plugin(argv[2])) {
+            return 1;
+        }
+
+        // the names only make sure the plugin provides what the caller expects
+        int status = 0;
+        for (int i = 3; argv[i] != NULL; ++i) {
+            mysh_builtin* b = mysh_find_builtin(argv[i]);
+            if (b == NULL || b->func != NULL) {
+                fprintf(stderr, "mysh: enable: %s: not provided by %s\n", argv[i], argv[2]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    if (strcmp(argv[1], "-d") == 0 && argv[2] != NULL) {
+        int status = 0;
+        for (int i = 2; argv[i] != NULL; ++i) {
+            if (!mysh_delete_builtin(argv[i])) {
+                fprintf(stderr, "mysh: enable: %s: not a loaded builtin\n", argv[i]);
+                status = 1;
+            }
+        }
+        return status;
+    }
+
+    fprintf(stderr, "usage: enable [-f plugin.so [name...] | -d name...]\n");
+    return 2;
+}
+
+#endif // MYSH_PLUGIN_H
@@ -0,0 +1,74 @@
+#ifndef MYSH_PLUGIN_API_H
+#define MYSH_PLUGIN_API_H
+
+// the interface between mysh and builtins loaded by `enable -f plugin.so name...`.
+// this header stands alone, so a plugin is built with nothing but it:
+//
+//     #include "plugin_api.h"
+//
+//     static int hello(const mysh_plugin_api* api, mysh_plugin_call* call) {
+//         fprintf(call->out, "hello, %s\n", call->argc > 1 ? call->argv[1] : api->get_var(call->shell, "USER"));
+//         return 0;
+//     }
+//
+//     int mysh_plugin_init(const mysh_plugin_api* api) {
+//         if (api->version < 1) {
+//             return -1;
+//         }
+//         return api->register_builtin("hello", hello, NULL);
+//     }
+//
+//     $ cc -shared -fPIC -o hello.so hello.c
+//
+// members are only ever appended to the structs below. a plugin built against version N
+// runs on any shell whose api->version is N or later
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define MYSH_PLUGIN_API_VERSION (1)
+
+// the symbol `enable -f` looks up
+#define MYSH_PLUGIN_INIT_SYMBOL "mysh_plugin_init"
+
+// one invocation of a builtin. the redirects of the command are already applied,
+// so `in`, `out` and `err` are where they point. output has to go through `out`,
+// which is not fd 1 while the builtin runs inside `$(...)`
+typedef struct {
+    int argc;
+    char** argv;
+    FILE* in;
+    FILE* out;
+    FILE* err;
+    // as passed to register_builtin()
+    void* ctx;
+    // the shell running the builtin, for the variable functions
+    void* shell;
+} mysh_plugin_call;
+
+struct mysh_plugin_api_tag;
+
+// returns the exit status of the builtin
+typedef int (*mysh_plugin_fn)(const struct mysh_plugin_api_tag* api, mysh_plugin_call* call);
+
+typedef struct mysh_plugin_api_tag {
+    unsigned int version;
+    // sizeof(mysh_plugin_api) of the shell
+    size_t size;
+
+    // returns 0, or -1 if `name` is taken by a builtin of the shell itself.
+    // a builtin of another plugin with the same name is replaced
+    int (*register_builtin)(const char* name, mysh_plugin_fn fn, void* ctx);
+
+    // NULL if unset. the string is valid until the variable is assigned again
+    const char* (*get_var)(void* shell, const char* name);
+    // assigns like `name=value` does
+    void (*set_var)(void* shell, const char* name, const char* value);
+    // assigns like `local name=value` does
+    void (*set_local_var)(void* shell, const char* name, const char* value);
+} mysh_plugin_api;
+
+// returns 0 on success. the shell keeps the object loaded once it is initialized
+typedef int (*mysh_plugin_init_fn)(const mysh_plugin_api* api);
+
+#endif // MYSH_PLUGIN_API_H
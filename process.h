@@ -8,6 +8,7 @@
 
 #include <unistd.h>
 #include <signal.h>
+#include <fcntl.h>
 
 #include "mystring.h"
 #include "redirect.h"
@@ -15,13 +16,46 @@
 #include "shell_resource.h"
 
 struct mysh_process_tag;
+struct mysh_command_list_tag;
+
+typedef enum {
+    process_simple,
+    // `name() body`, defines a function
+    process_function,
+    // `{ list; }`, runs in the current shell
+    process_group,
+    // `( list )`, always runs in a child
+    process_subshell
+} mysh_process_kind;
+
+// how an entry of a command list depends on the previous one
+typedef enum {
+    connect_always,
+    // `&&`
+    connect_and,
+    // `||`
+    connect_or
+} mysh_connector;
 
 struct mysh_process_tag {
     struct mysh_process_tag* next;
+    mysh_process_kind kind;
     char** argv;
     int argc;
     mysh_redirect_data* redirects;
     int num_redirects;
+
+    // leading `NAME=value` words of argv
+    int num_assigns;
+    // function name of process_function
+    char* name;
+    // shared, see mysh_retain_list()
+    struct mysh_command_list_tag* body;
+    // process substitutions in argv, see mysh_resource::subst_fds
+    int* subst_fds;
+    int num_subst_fds;
+    // runs argv from PATH even if a function or builtin has the name, see mysh_run_external()
+    bool is_external;
     
     bool is_completed;
     bool is_stopped;
@@ -31,6 +65,65 @@ struct mysh_process_tag {
 
 typedef struct mysh_process_tag mysh_process;
 
+// `pipeline ; pipeline && pipeline || pipeline & ...`
+// a parsed list is immutable so that function bodies can be run many times
+typedef struct mysh_command_list_tag {
+    struct mysh_command_list_tag* next;
+    mysh_connector connector;
+    mysh_process* pipeline;
+    // source text of the entry, used as the job name
+    mysh_string command;
+    bool is_foreground;
+
+    // only used on the head of a list
+    int refcount;
+} mysh_command_list;
+
+static void mysh_release_process(mysh_process* proc);
+
+static mysh_command_list* mysh_new_command_list() {
+    mysh_command_list* list = (mysh_command_list*)malloc(sizeof(mysh_command_list));
+    if (list == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    list->next = NULL;
+    list->connector = connect_always;
+    list->pipeline = NULL;
+    list->command.ptr = NULL;
+    ms_init(&list->command, "");
+    list->is_foreground = true;
+    list->refcount = 1;
+
+    return list;
+}
+
+static mysh_command_list* mysh_retain_list(mysh_command_list* list) {
+    assert(list != NULL);
+
+    ++list->refcount;
+    return list;
+}
+
+static void mysh_release_list(mysh_command_list* list) {
+    assert(list != NULL);
+
+    if (--list->refcount > 0) {
+        return;
+    }
+
+    while (list != NULL) {
+        mysh_command_list* next = list->next;
+        if (list->pipeline != NULL) {
+            mysh_release_process(list->pipeline);
+        }
+        ms_relase(&list->command);
+        free(list);
+        list = next;
+    }
+}
+
 static mysh_process* mysh_new_process() {
     mysh_process* proc = (mysh_process*)malloc(sizeof(mysh_process));
     if (proc == NULL) {
@@ -38,14 +131,22 @@ static mysh_process* mysh_new_process() {
         exit(EXIT_FAILURE);
     }
 
+    proc->kind = process_simple;
     proc->argv = NULL;
     proc->argc = 0;
+    proc->num_assigns = 0;
+    proc->name = NULL;
+    proc->body = NULL;
+    proc->subst_fds = NULL;
+    proc->num_subst_fds = 0;
+    proc->is_external = false;
     proc->redirects = NULL;
     proc->num_redirects = 0;
     proc->next = NULL;
     proc->is_completed = false;
     proc->is_stopped = false;
     proc->pid = 0;
+    proc->status = 0;
 
     return proc;
 }
@@ -65,11 +166,41 @@ static void mysh_release_process(mysh_process* proc) {
         free(proc->argv[i]);
     }
 
+    if (proc->body != NULL) {
+        mysh_release_list(proc->body);
+    }
+
     free(proc->redirects);
     free(proc->argv);
+    free(proc->name);
+    free(proc->subst_fds);
     free(proc);
 }
 
+// defined in exec.h. runs `proc` in the current process, which doesn't return for external commands
+static int mysh_exec_command(mysh_resource* shell, mysh_process* proc);
+
+// defined in session.h
+static bool mysh_is_stubbing();
+
+static void mysh_exec_external(mysh_process* proc) {
+    // a replay with --stub measures the shell rather than the commands
+    if (mysh_is_stubbing()) {
+        exit(EXIT_SUCCESS);
+    }
+
+    for (int i = 0; i < proc->num_assigns; ++i) {
+        char* eq = strchr(proc->argv[i], '=');
+        *eq = '\0';
+        setenv(proc->argv[i], eq + 1, 1);
+        *eq = '=';
+    }
+
+    execvp(proc->argv[proc->num_assigns], proc->argv + proc->num_assigns);
+    perror("mysh: failed to call execvp()");
+    exit(EXIT_FAILURE);
+}
+
 static void mysh_exec_process(mysh_resource* shell, mysh_process* proc, pid_t group_id, int in_fd, int out_fd, int err_fd, bool is_foreground) {
     if (shell->is_interactive) {
         pid_t pid = getpid();
@@ -83,12 +214,18 @@ static void mysh_exec_process(mysh_resource* shell, mysh_process* proc, pid_t gr
             tcsetpgrp(shell->terminal_fd, group_id);
         }
 
+        // in the group of the shell nobody could continue a stopped process, so it keeps
+        // ignoring the stop signals
+        bool may_stop = (group_id != shell->group_id);
         signal(SIGINT, SIG_DFL);
         signal(SIGQUIT, SIG_DFL);
-        signal(SIGTSTP, SIG_DFL);
-        signal(SIGTTIN, SIG_DFL);
-        signal(SIGTTOU, SIG_DFL);
+        signal(SIGTSTP, (may_stop ? SIG_DFL : SIG_IGN));
+        signal(SIGTTIN, (may_stop ? SIG_DFL : SIG_IGN));
+        signal(SIGTTOU, (may_stop ? SIG_DFL : SIG_IGN));
         signal(SIGCHLD, SIG_DFL);
+
+        // commands run by this child (e.g. in a function) don't do job control
+        shell->is_interactive = false;
     }
 
     if (in_fd != STDIN_FILENO) {
@@ -132,9 +269,25 @@ static void mysh_exec_process(mysh_resource* shell, mysh_process* proc, pid_t gr
         }
     }
 
-    execvp(proc->argv[0], proc->argv);
-    perror("mysh: failed to call execvp()");
-    exit(EXIT_FAILURE);
+    // process substitution fds belong only to the process which has them in argv
+    for (int i = 0; i < shell->num_subst_fds; ++i) {
+        bool is_own = false;
+        for (int j = 0; j < proc->num_subst_fds; ++j) {
+            if (shell->subst_fds[i] == proc->subst_fds[j]) {
+                is_own = true;
+                break;
+            }
+        }
+
+        if (is_own) {
+            fcntl(shell->subst_fds[i], F_SETFD, 0);
+        }
+        else {
+            close(shell->subst_fds[i]);
+        }
+    }
+
+    exit(mysh_exec_command(shell, proc));
 }
 
 #endif // MYSH_PROCESS_H
\ No newline at end of file
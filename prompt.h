@@ -0,0 +1,353 @@
+#ifndef MYSH_PROMPT_H
+#define MYSH_PROMPT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "mystring.h"
+#include "variable.h"
+#include "shell_resource.h"
+#include "job.h"
+#include "event.h"
+#include "lineedit.h"
+
+#define MYSH_PROMPT_BUCKETS (64)
+#define MYSH_PROMPT_MAX_ENTRIES (256)
+
+// segments which may touch the filesystem are computed by a worker thread and cached per directory.
+// the prompt shows the cached value, which may be stale, and is repainted once the worker is done
+typedef struct mysh_prompt_entry_tag {
+    struct mysh_prompt_entry_tag* next;
+    char* dir;
+    // NULL if not computed yet, "" if not in a repository
+    char* vcs;
+    // shell->prompt_generation the value was requested for
+    unsigned int generation;
+    bool is_pending;
+} mysh_prompt_entry;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool is_started;
+    // the worker only serves the latest request
+    char* request;
+    unsigned int request_generation;
+    // written by the worker when a value changed
+    int notify_fds[2];
+
+    mysh_prompt_entry* buckets[MYSH_PROMPT_BUCKETS];
+    int num_entries;
+} mysh_prompt_engine = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, NULL, 0, { -1, -1 }, { NULL }, 0 };
+
+static char* mysh_read_small_file(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    char buf[512];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0) {
+        return NULL;
+    }
+
+    buf[n] = '\0';
+    char* nl = strchr(buf, '\n');
+    if (nl != NULL) {
+        *nl = '\0';
+    }
+
+    return strdup(buf);
+}
+
+static bool mysh_path_exists(const char* dir, const char* name) {
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    ms_init(&path, dir);
+    ms_push(&path, '/');
+    ms_append_raw(&path, name);
+
+    struct stat st;
+    bool exists = (stat(path.ptr, &st) == 0);
+    ms_relase(&path);
+
+    return exists;
+}
+
+// the git branch of `dir` found by reading .git/HEAD directly, so no git process is started.
+// returns "" outside of a repository
+static char* mysh_vcs_branch(const char* dir) {
+    mysh_string path = { NULL, 0, 0, { 0 } };
+    mysh_string git_dir = { NULL, 0, 0, { 0 } };
+    ms_init(&path, dir);
+    ms_init(&git_dir, "");
+
+    while (true) {
+        size_t len = path.length;
+        ms_append_raw(&path, "/.git");
+
+        struct stat st;
+        if (stat(path.ptr, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                ms_assign_raw(&git_dir, path.ptr);
+            }
+            else {
+                // worktrees and submodules have `gitdir: path` in a file
+                char* link = mysh_read_small_file(path.ptr);
+                if (link != NULL && strncmp(link, "gitdir: ", 8) == 0) {
+                    if (link[8] != '/') {
+                        path.ptr[len + 1] = '\0';
+                        path.length = len + 1;
+                        ms_assign_raw(&git_dir, path.ptr);
+                    }
+                    ms_append_raw(&git_dir, link + 8);
+                }
+                free(link);
+            }
+            break;
+        }
+
+        path.ptr[len] = '\0';
+        path.length = len;
+
+        char* slash = strrchr(path.ptr, '/');
+        if (slash == NULL || len == 0) {
+            break;
+        }
+        *slash = '\0';
+        path.length = slash - path.ptr;
+    }
+
+    char* branch = NULL;
+    if (git_dir.length > 0) {
+        ms_append_raw(&git_dir, "/HEAD");
+        char* head = mysh_read_small_file(git_dir.ptr);
+        git_dir.length -= 5;
+        git_dir.ptr[git_dir.length] = '\0';
+
+        mysh_string out = { NULL, 0, 0, { 0 } };
+        ms_init(&out, "");
+        if (head != NULL && strncmp(head, "ref: refs/heads/", 16) == 0) {
+            ms_append_raw(&out, head + 16);
+        }
+        else if (head != NULL && strncmp(head, "ref: ", 5) == 0) {
+            ms_append_raw(&out, head + 5);
+        }
+        else if (head != NULL) {
+            // detached
+            head[strlen(head) > 7 ? 7 : strlen(head)] = '\0';
+            ms_append_raw(&out, head);
+        }
+        free(head);
+
+        if (mysh_path_exists(git_dir.ptr, "rebase-merge") || mysh_path_exists(git_dir.ptr, "rebase-apply")) {
+            ms_append_raw(&out, "|REBASE");
+        }
+        else if (mysh_path_exists(git_dir.ptr, "MERGE_HEAD")) {
+            ms_append_raw(&out, "|MERGING");
+        }
+
+        branch = ms_into_chars(&out);
+    }
+
+    ms_relase(&path);
+    ms_relase(&git_dir);
+
+    return (branch != NULL ? branch : strdup(""));
+}
+
+// called with the lock held
+static mysh_prompt_entry* mysh_prompt_entry_for(const char* dir) {
+    uint32_t h = mysh_hash_name(dir) % MYSH_PROMPT_BUCKETS;
+    for (mysh_prompt_entry* e = mysh_prompt_engine.buckets[h]; e != NULL; e = e->next) {
+        if (strcmp(e->dir, dir) == 0) {
+            return e;
+        }
+    }
+
+    if (mysh_prompt_engine.num_entries >= MYSH_PROMPT_MAX_ENTRIES) {
+        // forget everything the worker is not about to fill in
+        for (int i = 0; i < MYSH_PROMPT_BUCKETS; ++i) {
+            mysh_prompt_entry** link = &mysh_prompt_engine.buckets[i];
+            while (*link != NULL) {
+                mysh_prompt_entry* e = *link;
+                if (e->is_pending) {
+                    link = &e->next;
+                    continue;
+                }
+
+                *link = e->next;
+                free(e->dir);
+                free(e->vcs);
+                free(e);
+                --mysh_prompt_engine.num_entries;
+            }
+        }
+    }
+
+    mysh_prompt_entry* e = (mysh_prompt_entry*)calloc(1, sizeof(mysh_prompt_entry));
+    if (e == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    e->dir = strdup(dir);
+    e->next = mysh_prompt_engine.buckets[h];
+    mysh_prompt_engine.buckets[h] = e;
+    ++mysh_prompt_engine.num_entries;
+
+    return e;
+}
+
+static void* mysh_prompt_worker(void* arg) {
+    pthread_mutex_lock(&mysh_prompt_engine.lock);
+    while (true) {
+        while (mysh_prompt_engine.request == NULL) {
+            pthread_cond_wait(&mysh_prompt_engine.cond, &mysh_prompt_engine.lock);
+        }
+
+        char* dir = mysh_prompt_engine.request;
+        unsigned int generation = mysh_prompt_engine.request_generation;
+        mysh_prompt_engine.request = NULL;
+        pthread_mutex_unlock(&mysh_prompt_engine.lock);
+
+        char* vcs = mysh_vcs_branch(dir);
+
+        pthread_mutex_lock(&mysh_prompt_engine.lock);
+        mysh_prompt_entry* e = mysh_prompt_entry_for(dir);
+        bool is_changed = (e->vcs == NULL || strcmp(e->vcs, vcs) != 0);
+        free(e->vcs);
+        e->vcs = vcs;
+        e->generation = generation;
+        e->is_pending = false;
+        free(dir);
+
+        if (is_changed) {
+            // the pipe is non-blocking; a full pipe already means "repaint"
+            ssize_t n = write(mysh_prompt_engine.notify_fds[1], "!", 1);
+            (void)n;
+        }
+    }
+
+    return NULL;
+}
+
+static void mysh_prompt_notified(mysh_resource* shell, int fd, void* ctx) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {
+    }
+
+    mysh_request_repaint();
+}
+
+static bool mysh_start_prompt_worker() {
+    if (pipe2(mysh_prompt_engine.notify_fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        return false;
+    }
+
+    // signals are for the main thread, which may be blocked in a builtin waiting for one
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+
+    pthread_t thread;
+    int err = pthread_create(&thread, NULL, mysh_prompt_worker, NULL);
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+    if (err != 0) {
+        close(mysh_prompt_engine.notify_fds[0]);
+        close(mysh_prompt_engine.notify_fds[1]);
+        return false;
+    }
+    pthread_detach(thread);
+
+    mysh_watch_fd(mysh_prompt_engine.notify_fds[0], POLLIN, mysh_prompt_notified, NULL);
+    mysh_prompt_engine.is_started = true;
+
+    return true;
+}
+
+// the cached VCS segment of the working directory. asks the worker for a fresh one
+// if the directory changed or a command ran since it was computed
+static char* mysh_prompt_vcs(mysh_resource* shell) {
+    if (!mysh_prompt_engine.is_started && !mysh_start_prompt_worker()) {
+        return strdup("");
+    }
+
+    char* dir = getcwd(NULL, 0);
+    if (dir == NULL) {
+        return strdup("");
+    }
+
+    pthread_mutex_lock(&mysh_prompt_engine.lock);
+    mysh_prompt_entry* e = mysh_prompt_entry_for(dir);
+    if ((e->vcs == NULL || e->generation != shell->prompt_generation) && !e->is_pending) {
+        if (mysh_prompt_engine.request != NULL) {
+            // superseded before the worker took it
+            mysh_prompt_entry_for(mysh_prompt_engine.request)->is_pending = false;
+            free(mysh_prompt_engine.request);
+        }
+
+        e->is_pending = true;
+        mysh_prompt_engine.request = strdup(dir);
+        mysh_prompt_engine.request_generation = shell->prompt_generation;
+        pthread_cond_signal(&mysh_prompt_engine.cond);
+    }
+    char* vcs = strdup(e->vcs != NULL ? e->vcs : "");
+    pthread_mutex_unlock(&mysh_prompt_engine.lock);
+
+    free(dir);
+    return vcs;
+}
+
+static int mysh_count_jobs(mysh_resource* shell) {
+    mysh_update_status(shell->first_job);
+
+    int n = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        n += !mysh_is_job_completed(job);
+    }
+
+    return n;
+}
+
+// `dir (branch) [status] &jobs$ `. nothing here blocks, so typing never waits for the prompt
+static void mysh_render_prompt(mysh_resource* shell, mysh_string* out) {
+    char buf[64];
+
+    ms_assign_raw(out, shell->current_dir.ptr);
+
+    char* vcs = mysh_prompt_vcs(shell);
+    if (vcs[0] != '\0') {
+        ms_append_raw(out, " \x1b[36m(");
+        ms_append_raw(out, vcs);
+        ms_append_raw(out, ")\x1b[0m");
+    }
+    free(vcs);
+
+    if (shell->last_status != 0) {
+        snprintf(buf, sizeof(buf), " \x1b[31m[%d]\x1b[0m", shell->last_status);
+        ms_append_raw(out, buf);
+    }
+
+    int num_jobs = mysh_count_jobs(shell);
+    if (num_jobs > 0) {
+        snprintf(buf, sizeof(buf), " \x1b[33m&%d\x1b[0m", num_jobs);
+        ms_append_raw(out, buf);
+    }
+
+    ms_append_raw(out, "$ ");
+}
+
+static void mysh_render_continuation(mysh_resource* shell, mysh_string* out) {
+    ms_assign_raw(out, "> ");
+}
+
+#endif // MYSH_PROMPT_H
@@ -2,9 +2,20 @@
 #define MYSH_REDIRECT_H
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
 #include <assert.h>
 
 #include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include "mystring.h"
 
@@ -12,16 +23,220 @@ typedef enum {
 	redirect_out,
 	redirect_in,
 	redirect_out_append,
-	redirect_fd
+	redirect_fd,
+	redirect_heredoc,
+	redirect_herestring
 } mysh_redirect;
 
 typedef struct {
 	int ffd;
 	int tfd;
+	// the content itself for redirect_heredoc and redirect_herestring
 	mysh_string* filename;
 	mysh_redirect kind;
 } mysh_redirect_data;
 
+static bool mysh_write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// returns a readable fd holding `data`. bodies which fit in a pipe are written to it directly,
+// larger ones go to an anonymous memfd so that nothing touches the filesystem and no writer process is needed
+static int mysh_open_content(const char* data, size_t len, bool add_newline) {
+    size_t total = len + (add_newline ? 1 : 0);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == 0) {
+        int capacity = fcntl(fds[1], F_GETPIPE_SZ);
+        if (capacity > 0 && total <= (size_t)capacity) {
+            bool ok = mysh_write_all(fds[1], data, len) && (!add_newline || mysh_write_all(fds[1], "\n", 1));
+            close(fds[1]);
+            if (!ok) {
+                close(fds[0]);
+                return -1;
+            }
+
+            return fds[0];
+        }
+
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    int fd = memfd_create("mysh-heredoc", MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (!mysh_write_all(fd, data, len) || (add_newline && !mysh_write_all(fd, "\n", 1)) || lseek(fd, 0, SEEK_SET) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// how long connecting a /dev/tcp or /dev/unix redirect may take
+#define MYSH_CONNECT_TIMEOUT (5000)
+
+// connects `fd` without blocking for more than `*timeout` ms, which is reduced by the time taken
+static bool mysh_connect(int fd, const struct sockaddr* addr, socklen_t len, int* timeout) {
+    if (connect(fd, addr, len) == 0) {
+        return true;
+    }
+    if (errno != EINPROGRESS) {
+        return false;
+    }
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct pollfd p = { fd, POLLOUT, 0 };
+    int ready;
+    while ((ready = poll(&p, 1, *timeout)) < 0 && errno == EINTR) {
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    *timeout = (elapsed < *timeout ? *timeout - (int)elapsed : 0);
+
+    if (ready <= 0) {
+        errno = (ready == 0 ? ETIMEDOUT : errno);
+        return false;
+    }
+
+    int err = 0;
+    socklen_t err_len = sizeof(err);
+    if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0) {
+        return false;
+    }
+    if (err != 0) {
+        errno = err;
+        return false;
+    }
+
+    return true;
+}
+
+// the socket is handed to commands, which expect it to block
+static int mysh_connected(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    return fd;
+}
+
+// `/dev/tcp/host/port`. the last slash separates the port, so `host` may be an IPv6 address
+static int mysh_open_tcp(const char* spec) {
+    const char* slash = strrchr(spec, '/');
+    if (slash == NULL || slash == spec || slash[1] == '\0') {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char* host = strndup(spec, slash - spec);
+    if (host == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* list;
+    int gai = getaddrinfo(host, slash + 1, &hints, &list);
+    free(host);
+    if (gai != 0) {
+        fprintf(stderr, "mysh: /dev/tcp/%s: %s\n", spec, gai_strerror(gai));
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    // the addresses share the timeout
+    int timeout = MYSH_CONNECT_TIMEOUT;
+    int fd = -1;
+    int err = ECONNREFUSED;
+    for (struct addrinfo* ai = list; ai != NULL && fd < 0 && timeout > 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK, ai->ai_protocol);
+        if (fd < 0) {
+            err = errno;
+            continue;
+        }
+        if (!mysh_connect(fd, ai->ai_addr, ai->ai_addrlen, &timeout)) {
+            err = errno;
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+
+    if (fd < 0) {
+        errno = err;
+        return -1;
+    }
+
+    return mysh_connected(fd);
+}
+
+// `/dev/unix/path/to/socket` is /path/to/socket. datagram sockets such as /dev/log work too
+static int mysh_open_unix(const char* path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int types[] = { SOCK_STREAM, SOCK_DGRAM };
+    for (int i = 0; i < 2; ++i) {
+        int fd = socket(AF_UNIX, types[i] | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            return -1;
+        }
+
+        int timeout = MYSH_CONNECT_TIMEOUT;
+        if (mysh_connect(fd, (struct sockaddr*)&addr, sizeof(addr), &timeout)) {
+            return mysh_connected(fd);
+        }
+
+        int err = errno;
+        close(fd);
+        errno = err;
+        if (err != EPROTOTYPE) {
+            break;
+        }
+    }
+
+    return -1;
+}
+
+// open(), except that /dev/tcp/host/port and /dev/unix/path connect a socket
+static int mysh_open_path(const char* path, int flags) {
+    if (strncmp(path, "/dev/tcp/", 9) == 0) {
+        return mysh_open_tcp(path + 9);
+    }
+    if (strncmp(path, "/dev/unix/", 10) == 0) {
+        return mysh_open_unix(path + 9);
+    }
+
+    return open(path, flags, 0666);
+}
+
 // open file if necessary
 static bool mysh_open_file(mysh_redirect_data* red) {
     switch (red->kind) {
@@ -29,7 +244,7 @@ static bool mysh_open_file(mysh_redirect_data* red) {
         assert(!ms_is_empty(red->filename));
 
         red->tfd = 0;
-        red->ffd = open(red->filename->ptr, O_RDONLY, 0666);
+        red->ffd = mysh_open_path(red->filename->ptr, O_RDONLY);
         if (red->ffd < 0) {
             perror("mysh: failed to open output file to redirect:");
             return false;
@@ -42,7 +257,7 @@ static bool mysh_open_file(mysh_redirect_data* red) {
         if (red->tfd == -1) {
             red->tfd = 1;
         }
-        red->ffd = open(red->filename->ptr, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        red->ffd = mysh_open_path(red->filename->ptr, O_WRONLY | O_CREAT | O_TRUNC);
         if (red->ffd < 0) {
             perror("mysh: failed to open output file to redirect:");
             return false;
@@ -55,7 +270,7 @@ static bool mysh_open_file(mysh_redirect_data* red) {
         if (red->tfd == -1) {
             red->tfd = 1;
         }
-        red->ffd = open(red->filename->ptr, O_WRONLY | O_CREAT | O_APPEND, 0666);
+        red->ffd = mysh_open_path(red->filename->ptr, O_WRONLY | O_CREAT | O_APPEND);
         if (red->ffd < 0) {
             perror("mysh: failed to open output file to redirect:");
             return false;
@@ -65,6 +280,18 @@ static bool mysh_open_file(mysh_redirect_data* red) {
     case redirect_fd:
         // do nothing
         return true;
+    case redirect_heredoc:
+    case redirect_herestring:
+        if (red->tfd == -1) {
+            red->tfd = 0;
+        }
+        red->ffd = mysh_open_content(red->filename->ptr != NULL ? red->filename->ptr : "", red->filename->length, red->kind == redirect_herestring);
+        if (red->ffd < 0) {
+            perror("mysh: failed to create here-document");
+            return false;
+        }
+
+        break;
     default:
         // unreachable
         exit(EXIT_FAILURE);
@@ -76,28 +303,24 @@ static bool mysh_open_file(mysh_redirect_data* red) {
 static bool mysh_close_file(mysh_redirect_data* red) {
     assert(red != NULL);
 
-    if (red->ffd > 2) {
+    // ffd of redirect_fd and tfd are fd numbers in the child, not ours
+    if (red->kind != redirect_fd && red->ffd > 2) {
         if (close(red->ffd) < 0) {
             perror("mysh: failed to close FD:");
             return false;
         }
     }
-    if (red->tfd > 2) {
-        if (close(red->tfd) < 0) {
-            perror("mysh: failed to close FD:");
-            return false;
-        }
-    }
 
     return true;
 }
 
+// releases what `red` owns; the redirect itself is a part of mysh_process::redirects
 static void mysh_release_redirect(mysh_redirect_data* red) {
     if (red->filename != NULL) {
         ms_free(red->filename);
     }
 
-    free(red);
+    red->filename = NULL;
 }
 
 #endif // MYSH_REDIRECT_H
\ No newline at end of file
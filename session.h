@@ -0,0 +1,290 @@
+#ifndef MYSH_SESSION_H
+#define MYSH_SESSION_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mystring.h"
+#include "exec.h"
+
+// with MYSH_RECORD=FILE, every line the shell runs is appended to FILE together with when it
+// started, how long it took and its status. `mysh --replay FILE` feeds the lines to the same
+// read/parse/launch loop again as fast as it can and reports throughput and latency
+// percentiles to stderr. with --stub, external commands exit at once instead of being
+// executed, which leaves the cost of the shell itself
+
+#define MYSH_SESSION_MAGIC ("myshr001")
+
+// a file is the magic followed by records of a kind byte and varints:
+//   'S' start: microseconds since the epoch
+//   'L' line: microseconds since the previous line started, duration, status, length, text
+#define MYSH_SESSION_START ('S')
+#define MYSH_SESSION_LINE ('L')
+
+static struct {
+    int record_fd;
+    uint64_t last_start;
+
+    // of the line which runs now, continuation lines included
+    uint64_t line_start;
+    mysh_string line;
+
+    bool is_replaying;
+    bool is_stubbing;
+    FILE* feed;
+    mysh_string feed_text;
+    uint64_t replay_start;
+    // in microseconds
+    uint64_t* latencies;
+    size_t num_latencies;
+    size_t latencies_capacity;
+    uint64_t* recorded;
+    size_t num_recorded;
+} mysh_session = { -1, 0, 0, { NULL, 0, 0, { 0 } }, false, false, NULL, { NULL, 0, 0, { 0 } }, 0, NULL, 0, 0, NULL, 0 };
+
+static uint64_t mysh_micros(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void mysh_put_varint(mysh_string* out, uint64_t value) {
+    while (value >= 0x80) {
+        ms_push(out, (char)(value | 0x80));
+        value >>= 7;
+    }
+    ms_push(out, (char)value);
+}
+
+static bool mysh_get_varint(const char** cur, const char* end, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; *cur < end && shift < 64; shift += 7) {
+        unsigned char c = (unsigned char)*(*cur)++;
+        *value |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void mysh_write_record(mysh_string* record) {
+    // one write per record, so that a crash never leaves half of one behind
+    if (write(mysh_session.record_fd, record->ptr, record->length) != (ssize_t)record->length) {
+        perror("mysh: stopped recording");
+        close(mysh_session.record_fd);
+        mysh_session.record_fd = -1;
+    }
+}
+
+// `path` may be NULL, which records nothing
+static void mysh_start_recording(const char* path) {
+    if (path == NULL || path[0] == '\0' || mysh_session.is_replaying) {
+        return;
+    }
+
+    mysh_session.record_fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (mysh_session.record_fd < 0) {
+        fprintf(stderr, "mysh: record: %s: %s\n", path, strerror(errno));
+        return;
+    }
+
+    mysh_string record = { NULL, 0, 0, { 0 } };
+    ms_init(&record, "");
+    if (lseek(mysh_session.record_fd, 0, SEEK_END) == 0) {
+        ms_append_raw(&record, MYSH_SESSION_MAGIC);
+    }
+    ms_push(&record, MYSH_SESSION_START);
+    mysh_put_varint(&record, mysh_micros(CLOCK_REALTIME));
+    mysh_write_record(&record);
+    ms_relase(&record);
+
+    mysh_session.last_start = mysh_micros(CLOCK_MONOTONIC);
+}
+
+// called with each line read, before the parser takes it apart
+static void mysh_session_begin_line(const char* input) {
+    if (mysh_session.record_fd < 0 && !mysh_session.is_replaying) {
+        return;
+    }
+
+    if (mysh_session.line.ptr == NULL) {
+        ms_init(&mysh_session.line, "");
+    }
+    const char* eof = strchr(input, EOF);
+    ms_assign_n(&mysh_session.line, input, (eof != NULL ? (size_t)(eof - input) : strlen(input)));
+
+    mysh_session.line_start = mysh_micros(CLOCK_MONOTONIC);
+}
+
+// and with each continuation line the parser asked for. the time spent typing it is not
+// part of the duration
+static void mysh_session_more_line(const char* line) {
+    if (mysh_session.record_fd >= 0) {
+        ms_push(&mysh_session.line, '\n');
+        ms_append_raw(&mysh_session.line, line);
+        mysh_session.line_start = mysh_micros(CLOCK_MONOTONIC);
+    }
+}
+
+// called once the line ran
+static void mysh_session_end_line(int status) {
+    if (mysh_session.record_fd < 0 && !mysh_session.is_replaying) {
+        return;
+    }
+
+    uint64_t duration = mysh_micros(CLOCK_MONOTONIC) - mysh_session.line_start;
+
+    if (mysh_session.is_replaying) {
+        if (mysh_session.num_latencies == mysh_session.latencies_capacity) {
+            mysh_session.latencies_capacity = (mysh_session.latencies_capacity == 0 ? 256 : mysh_session.latencies_capacity * 2);
+            mysh_session.latencies = (uint64_t*)realloc(mysh_session.latencies, sizeof(uint64_t) * mysh_session.latencies_capacity);
+            if (mysh_session.latencies == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        mysh_session.latencies[mysh_session.num_latencies++] = duration;
+        return;
+    }
+
+    mysh_string record = { NULL, 0, 0, { 0 } };
+    ms_init(&record, "");
+    ms_push(&record, MYSH_SESSION_LINE);
+    mysh_put_varint(&record, mysh_session.line_start - mysh_session.last_start);
+    mysh_put_varint(&record, duration);
+    mysh_put_varint(&record, (uint64_t)(uint32_t)status);
+    mysh_put_varint(&record, mysh_session.line.length);
+    ms_append(&record, &mysh_session.line);
+    mysh_write_record(&record);
+    ms_relase(&record);
+
+    mysh_session.last_start = mysh_session.line_start;
+}
+
+// where mysh_read_line() reads from when the shell is not interactive
+static FILE* mysh_session_input() {
+    return (mysh_session.feed != NULL ? mysh_session.feed : stdin);
+}
+
+bool mysh_is_stubbing() {
+    return mysh_session.is_stubbing;
+}
+
+// reads the lines of every session in `path` into the feed. returns false on a broken file
+static bool mysh_start_replay(const char* path, bool is_stubbing) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "mysh: replay: %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    mysh_string data = { NULL, 0, 0, { 0 } };
+    mysh_read_all(fd, &data);
+    close(fd);
+
+    size_t magic_length = strlen(MYSH_SESSION_MAGIC);
+    bool ok = (data.length >= magic_length && memcmp(data.ptr, MYSH_SESSION_MAGIC, magic_length) == 0);
+
+    ms_init(&mysh_session.feed_text, "");
+    const char* cur = data.ptr + magic_length;
+    const char* end = data.ptr + data.length;
+    size_t capacity = 0;
+    while (ok && cur < end) {
+        char kind = *cur++;
+        uint64_t gap, duration, status, length;
+        if (kind == MYSH_SESSION_START) {
+            ok = mysh_get_varint(&cur, end, &gap);
+            continue;
+        }
+
+        ok = (kind == MYSH_SESSION_LINE
+            && mysh_get_varint(&cur, end, &gap) && mysh_get_varint(&cur, end, &duration)
+            && mysh_get_varint(&cur, end, &status) && mysh_get_varint(&cur, end, &length)
+            && length <= (uint64_t)(end - cur));
+        if (!ok) {
+            break;
+        }
+
+        ms_append_n(&mysh_session.feed_text, cur, length);
+        ms_push(&mysh_session.feed_text, '\n');
+        cur += length;
+
+        if (mysh_session.num_recorded == capacity) {
+            capacity = (capacity == 0 ? 256 : capacity * 2);
+            mysh_session.recorded = (uint64_t*)realloc(mysh_session.recorded, sizeof(uint64_t) * capacity);
+            if (mysh_session.recorded == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        mysh_session.recorded[mysh_session.num_recorded++] = duration;
+    }
+    ms_relase(&data);
+
+    if (!ok) {
+        fprintf(stderr, "mysh: replay: %s: not a session recording\n", path);
+        return false;
+    }
+
+    mysh_session.feed = fmemopen(mysh_session.feed_text.ptr, mysh_session.feed_text.length, "r");
+    if (mysh_session.feed == NULL) {
+        perror("mysh: replay");
+        return false;
+    }
+
+    mysh_session.is_replaying = true;
+    mysh_session.is_stubbing = is_stubbing;
+    mysh_session.replay_start = mysh_micros(CLOCK_MONOTONIC);
+    return true;
+}
+
+static int mysh_compare_micros(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static void mysh_print_percentiles(const char* label, uint64_t* values, size_t n) {
+    if (n == 0) {
+        return;
+    }
+
+    qsort(values, n, sizeof(uint64_t), mysh_compare_micros);
+    static const int percents[] = { 50, 90, 99 };
+    fprintf(stderr, "%-9s", label);
+    for (size_t i = 0; i < sizeof(percents) / sizeof(int); ++i) {
+        // nearest rank
+        size_t rank = (percents[i] * n + 99) / 100;
+        fprintf(stderr, "  p%d %.3f ms", percents[i], values[rank - 1] / 1000.0);
+    }
+    fprintf(stderr, "  max %.3f ms\n", values[n - 1] / 1000.0);
+}
+
+static void mysh_report_replay() {
+    double seconds = (mysh_micros(CLOCK_MONOTONIC) - mysh_session.replay_start) / 1e6;
+    fprintf(stderr, "replayed %zu of %zu lines in %.3f s (%.1f lines/s)%s\n",
+        mysh_session.num_latencies, mysh_session.num_recorded, seconds,
+        (seconds > 0.0 ? mysh_session.num_latencies / seconds : 0.0),
+        (mysh_session.is_stubbing ? ", external commands stubbed" : ""));
+
+    mysh_print_percentiles("replayed", mysh_session.latencies, mysh_session.num_latencies);
+    mysh_print_percentiles("recorded", mysh_session.recorded, mysh_session.num_recorded);
+
+    fclose(mysh_session.feed);
+    ms_relase(&mysh_session.feed_text);
+    ms_relase(&mysh_session.line);
+    free(mysh_session.latencies);
+    free(mysh_session.recorded);
+}
+
+#endif // MYSH_SESSION_H
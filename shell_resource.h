@@ -10,6 +10,7 @@
 #include <sys/types.h>
 
 #include "mystring.h"
+#include "variable.h"
 
 typedef struct mysh_resource_tag {
     mysh_string current_dir;
@@ -19,6 +20,20 @@ typedef struct mysh_resource_tag {
     bool is_interactive;
     pid_t group_id;
     void* first_job;
+
+    mysh_scope* scope;
+    void* functions;
+    int last_status;
+    bool is_exiting;
+    bool is_returning;
+
+    // fds of process substitutions whose command has not started yet.
+    // every other child closes them
+    int* subst_fds;
+    int num_subst_fds;
+
+    // bumped whenever cached prompt segments may be outdated, see prompt.h
+    unsigned int prompt_generation;
 } mysh_resource;
 
 static void mysh_set_curdir_name(mysh_resource* shell) {
@@ -27,9 +42,12 @@ static void mysh_set_curdir_name(mysh_resource* shell) {
         return;
     }
 
+    ++shell->prompt_generation;
+
     size_t name_len = strlen(name);
     if (name_len < shell->home_dir.length) {
         ms_assign_raw(&shell->current_dir, name);
+        free(name);
         return;
     }
 
@@ -60,9 +78,28 @@ static void mysh_set_curdir_name(mysh_resource* shell) {
     free(name);
 }
 
+// the state every shell starts from. job control is set up by the caller if it wants a terminal
+static void mysh_init_resource(mysh_resource* shell) {
+    memset(shell, 0, sizeof(*shell));
+
+    ms_init(&shell->home_dir, getenv("HOME"));
+    mysh_set_curdir_name(shell);
+
+    shell->first_job = NULL;
+    shell->scope = mysh_new_scope(NULL, 1, (char*[]){ "mysh", NULL });
+    shell->terminal_fd = STDIN_FILENO;
+    shell->is_interactive = false;
+}
+
 static void mysh_release_resource(mysh_resource* shell) {
     ms_relase(&shell->current_dir);
     ms_relase(&shell->home_dir);
+
+    free(shell->subst_fds);
+
+    while (shell->scope != NULL) {
+        shell->scope = mysh_release_scope(shell->scope);
+    }
 }
 
 #endif // MYSH_SHELL_RESOURCE_H
\ No newline at end of file
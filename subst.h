@@ -0,0 +1,134 @@
+#ifndef MYSH_SUBST_H
+#define MYSH_SUBST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "mystring.h"
+#include "shell_resource.h"
+#include "process.h"
+#include "job.h"
+#include "parser.h"
+
+static void mysh_add_subst_fd(mysh_resource* shell, int fd) {
+    shell->subst_fds = (int*)realloc(shell->subst_fds, sizeof(int) * (shell->num_subst_fds + 1));
+    if (shell->subst_fds == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    shell->subst_fds[shell->num_subst_fds++] = fd;
+}
+
+static void mysh_forget_subst_fd(mysh_resource* shell, int fd) {
+    for (int i = 0; i < shell->num_subst_fds; ++i) {
+        if (shell->subst_fds[i] == fd) {
+            shell->subst_fds[i] = shell->subst_fds[--shell->num_subst_fds];
+            return;
+        }
+    }
+}
+
+// `proc` runs in the shell itself, so whatever it starts may use its process substitutions
+static void mysh_inherit_subst_fds(mysh_resource* shell, mysh_process* proc) {
+    for (int i = 0; i < proc->num_subst_fds; ++i) {
+        fcntl(proc->subst_fds[i], F_SETFD, 0);
+        mysh_forget_subst_fd(shell, proc->subst_fds[i]);
+    }
+}
+
+// closes the process substitution fds of `proc` once it has started (or finished, if it ran inline)
+static void mysh_release_subst_fds(mysh_resource* shell, mysh_process* proc) {
+    for (int i = 0; i < proc->num_subst_fds; ++i) {
+        close(proc->subst_fds[i]);
+        mysh_forget_subst_fd(shell, proc->subst_fds[i]);
+    }
+
+    proc->num_subst_fds = 0;
+}
+
+// starts `source` as a background job connected to a pipe and returns our end of it,
+// which the command sees as /dev/fd/N. `dir` is '<' if the command reads the output of `source`
+static int mysh_open_procsub(mysh_resource* shell, char dir, const char* source) {
+    mysh_string line = { NULL, 0, 0, { 0 } };
+    ms_init(&line, source);
+    mysh_command_list* body = mysh_parse_input(line.ptr, NULL, NULL);
+    if (body == NULL) {
+        ms_relase(&line);
+        return -1;
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        perror("mysh: failed to create pipe");
+        mysh_release_list(body);
+        ms_relase(&line);
+        return -1;
+    }
+
+    int ours = (dir == '<' ? fds[0] : fds[1]);
+    int theirs = (dir == '<' ? fds[1] : fds[0]);
+
+    // registered before forking so that the substituted command closes our end
+    mysh_add_subst_fd(shell, ours);
+
+    mysh_process* proc = mysh_new_process();
+    proc->kind = process_subshell;
+    proc->body = body;
+
+    mysh_job* job = mysh_add_job(shell);
+    job->first_proc = proc;
+    job->in_fd = (dir == '<' ? STDIN_FILENO : theirs);
+    job->out_fd = (dir == '<' ? theirs : STDOUT_FILENO);
+    job->err_fd = STDERR_FILENO;
+    job->termios = shell->original_termios;
+    job->is_subst = true;
+
+    ms_assign_raw(&job->command, (dir == '<' ? "<(" : ">("));
+    ms_append_raw(&job->command, source);
+    ms_push(&job->command, ')');
+    ms_relase(&line);
+
+    bool ok = mysh_launch_job(shell, job, false);
+    close(theirs);
+
+    if (!ok) {
+        if (job->group_id == 0) {
+            mysh_remove_job(shell, job);
+        }
+
+        mysh_forget_subst_fd(shell, ours);
+        close(ours);
+        return -1;
+    }
+
+    return ours;
+}
+
+// removes the process substitutions which have exited. like other shells, the command using one
+// does not wait for it, so one which outlives its command goes away on a later call
+static void mysh_reap_substs(mysh_resource* shell) {
+    mysh_job* job = shell->first_job;
+    while (job != NULL) {
+        mysh_job* next = job->next;
+        if (job->is_subst) {
+            // only their own pids, so that nothing another wait is for gets taken
+            for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+                int status;
+                if (!proc->is_completed && proc->pid > 0 && waitpid(proc->pid, &status, WNOHANG) > 0) {
+                    mysh_set_status(job, proc->pid, status);
+                }
+            }
+
+            if (mysh_is_job_completed(job)) {
+                mysh_remove_job(shell, job);
+            }
+        }
+        job = next;
+    }
+}
+
+#endif // MYSH_SUBST_H
@@ -0,0 +1,347 @@
+#ifndef MYSH_TIMER_H
+#define MYSH_TIMER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+
+#include "shell_resource.h"
+#include "process.h"
+#include "job.h"
+#include "builtins.h"
+#include "event.h"
+#include "lineedit.h"
+
+// `timeout DURATION cmd` and `every INTERVAL cmd` keep a timerfd on their job. the shell
+// services it from the event loop at the prompt and from mysh_wait_any() while it waits,
+// so no helper process sits between the shell and the command
+
+// what `timeout` sends after the first signal unless -k says otherwise
+#define MYSH_TIMEOUT_KILL_AFTER (5.0)
+// status of a command `timeout` had to stop, as coreutils timeout has it
+#define MYSH_TIMEOUT_STATUS (124)
+
+struct mysh_timer_tag {
+    int fd;
+    bool is_periodic;
+
+    // timeout: 0 before the first signal, 1 before SIGKILL, 2 after it
+    int stage;
+    int signal;
+    double kill_after;
+
+    // every: runs started and ticks which came while the previous run was still going
+    unsigned long num_runs;
+    unsigned long num_skipped;
+};
+
+// accepts `1.5`, `500ms`, `30s`, `2m` and `1h`
+static bool mysh_parse_duration(const char* text, double* seconds) {
+    char* end;
+    double value = strtod(text, &end);
+    if (end == text || value < 0.0) {
+        return false;
+    }
+
+    if (strcmp(end, "ms") == 0) {
+        value /= 1000.0;
+    }
+    else if (strcmp(end, "m") == 0) {
+        value *= 60.0;
+    }
+    else if (strcmp(end, "h") == 0) {
+        value *= 3600.0;
+    }
+    else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return false;
+    }
+
+    *seconds = value;
+    return true;
+}
+
+static struct timespec mysh_seconds_to_timespec(double seconds) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)seconds;
+    ts.tv_nsec = (long)((seconds - (double)ts.tv_sec) * 1e9);
+
+    // a zero it_value disarms the timer
+    if (ts.tv_sec == 0 && ts.tv_nsec == 0) {
+        ts.tv_nsec = 1;
+    }
+
+    return ts;
+}
+
+// `interval` of 0 fires once
+static void mysh_arm_timer(mysh_timer* timer, double value, double interval) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (value >= 0.0) {
+        spec.it_value = mysh_seconds_to_timespec(value);
+    }
+    if (interval > 0.0) {
+        spec.it_interval = mysh_seconds_to_timespec(interval);
+    }
+
+    timerfd_settime(timer->fd, 0, &spec, NULL);
+}
+
+// reaps what is left of the last run by pid, so that no WAIT_ANY loop meets a pid which
+// belongs to no process of the job any more
+static bool mysh_is_run_finished(mysh_resource* shell, mysh_job* job) {
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        if (proc->is_completed || proc->pid <= 0) {
+            continue;
+        }
+
+        int status;
+        pid_t pid = waitpid(proc->pid, &status, WNOHANG);
+        if (pid == proc->pid) {
+            mysh_set_status(shell->first_job, pid, status);
+        }
+        else if (pid < 0 && errno == ECHILD) {
+            proc->is_completed = proc->is_stopped = true;
+        }
+    }
+
+    return mysh_is_job_completed(job);
+}
+
+static void mysh_start_periodic_run(mysh_resource* shell, mysh_job* job) {
+    for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+        proc->pid = 0;
+        proc->status = 0;
+        proc->is_completed = false;
+        proc->is_stopped = false;
+    }
+    job->group_id = 0;
+    job->is_notified = false;
+
+    ++job->timer->num_runs;
+    if (!mysh_launch_job(shell, job, false)) {
+        for (mysh_process* proc = job->first_proc; proc != NULL; proc = proc->next) {
+            proc->is_completed |= (proc->pid == 0);
+            proc->is_stopped |= (proc->pid == 0);
+        }
+    }
+}
+
+static void mysh_job_timer_fired(mysh_resource* shell, int fd, void* ctx) {
+    mysh_job* job = (mysh_job*)ctx;
+    mysh_timer* timer = job->timer;
+
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+
+    if (timer->is_periodic) {
+        // runs never overlap, and ticks missed meanwhile are not made up for
+        if (!mysh_is_run_finished(shell, job)) {
+            timer->num_skipped += expirations;
+            return;
+        }
+
+        timer->num_skipped += expirations - 1;
+        mysh_start_periodic_run(shell, job);
+        mysh_request_repaint();
+        return;
+    }
+
+    if (timer->stage == 0) {
+        timer->stage = 1;
+        mysh_signal_job(job, timer->signal);
+        // a stopped job only acts on the signal once it runs again
+        mysh_signal_job(job, SIGCONT);
+
+        if (timer->kill_after > 0.0) {
+            mysh_arm_timer(timer, timer->kill_after, 0.0);
+        }
+    }
+    else if (timer->stage == 1) {
+        timer->stage = 2;
+        mysh_signal_job(job, SIGKILL);
+    }
+}
+
+static mysh_timer* mysh_new_job_timer(mysh_job* job, bool is_periodic) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        perror("mysh: failed to create timer");
+        return NULL;
+    }
+
+    mysh_timer* timer = (mysh_timer*)calloc(1, sizeof(mysh_timer));
+    if (timer == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    timer->fd = fd;
+    timer->is_periodic = is_periodic;
+    timer->signal = SIGTERM;
+    timer->kill_after = MYSH_TIMEOUT_KILL_AFTER;
+    job->timer = timer;
+
+    mysh_watch_fd(fd, POLLIN, mysh_job_timer_fired, job);
+    return timer;
+}
+
+void mysh_release_job_timer(mysh_job* job) {
+    if (job->timer == NULL) {
+        return;
+    }
+
+    mysh_unwatch_fd(job->timer->fd);
+    close(job->timer->fd);
+    free(job->timer);
+    job->timer = NULL;
+}
+
+// adds the timer fds of jobs to `fds` for mysh_wait_any(). returns how many
+int mysh_job_timer_fds(mysh_resource* shell, struct pollfd* fds) {
+    int n = 0;
+    for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+        if (job->timer != NULL) {
+            fds[n].fd = job->timer->fd;
+            fds[n].events = POLLIN;
+            fds[n++].revents = 0;
+        }
+    }
+
+    return n;
+}
+
+// fires the timers that poll() found ready among `fds`. a job is looked up again for each,
+// since firing one may have released another
+void mysh_service_job_timers(mysh_resource* shell, struct pollfd* fds, int n) {
+    for (int i = 0; i < n; ++i) {
+        if (fds[i].revents == 0) {
+            continue;
+        }
+
+        for (mysh_job* job = shell->first_job; job != NULL; job = job->next) {
+            if (job->timer != NULL && job->timer->fd == fds[i].fd) {
+                mysh_job_timer_fired(shell, fds[i].fd, job);
+                break;
+            }
+        }
+    }
+}
+
+bool mysh_is_job_periodic(mysh_job* job) {
+    return job->timer != NULL && job->timer->is_periodic;
+}
+
+// a signal which ends an `every` job also ends its future runs
+bool mysh_cancel_periodic(mysh_job* job) {
+    if (!mysh_is_job_periodic(job)) {
+        return false;
+    }
+
+    mysh_release_job_timer(job);
+    return true;
+}
+
+bool mysh_describe_periodic(mysh_job* job, char* buf, size_t size) {
+    if (!mysh_is_job_periodic(job)) {
+        return false;
+    }
+
+    const char* state = (mysh_is_job_completed(job) ? "waiting" : mysh_is_job_stopped(job) ? "stopped" : "running");
+    if (job->timer->num_skipped > 0) {
+        snprintf(buf, size, "%s, %lu runs, %lu skipped", state, job->timer->num_runs, job->timer->num_skipped);
+    }
+    else {
+        snprintf(buf, size, "%s, %lu runs", state, job->timer->num_runs);
+    }
+
+    return true;
+}
+
+// timeout [-s SIG] [-k DURATION] [--] DURATION cmd...
+// anything else, such as --preserve-status or -v, and malformed arguments run the real timeout
+int mysh_timeout(mysh_resource* shell, char** argv) {
+    int sig = SIGTERM;
+    double kill_after = MYSH_TIMEOUT_KILL_AFTER;
+    double duration;
+
+    int i = 1;
+    for (; argv[i] != NULL && argv[i][0] == '-'; i += 2) {
+        if (strcmp(argv[i], "--") == 0) {
+            ++i;
+            break;
+        }
+
+        bool is_known = (argv[i + 1] != NULL
+            && ((strcmp(argv[i], "-s") == 0 && (sig = mysh_signal_number(argv[i + 1])) > 0)
+                || (strcmp(argv[i], "-k") == 0 && mysh_parse_duration(argv[i + 1], &kill_after))));
+        if (!is_known) {
+            return mysh_run_external(shell, argv);
+        }
+    }
+
+    if (argv[i] == NULL || argv[i + 1] == NULL || !mysh_parse_duration(argv[i], &duration)) {
+        return mysh_run_external(shell, argv);
+    }
+
+    mysh_job* job = mysh_new_argv_job(shell, argv, argv + i + 1);
+    mysh_timer* timer = mysh_new_job_timer(job, false);
+    if (timer == NULL) {
+        mysh_remove_job(shell, job);
+        return 1;
+    }
+    timer->signal = sig;
+    timer->kill_after = kill_after;
+    mysh_arm_timer(timer, duration, 0.0);
+
+    if (!mysh_launch_job(shell, job, true)) {
+        if (job->group_id == 0) {
+            mysh_remove_job(shell, job);
+        }
+        return 1;
+    }
+
+    int status = mysh_job_status(job);
+    if (mysh_is_job_completed(job)) {
+        if (timer->stage > 0) {
+            status = MYSH_TIMEOUT_STATUS;
+        }
+        mysh_remove_job(shell, job);
+    }
+
+    return status;
+}
+
+// every INTERVAL cmd... runs cmd in the background now and then every INTERVAL, counted from
+// the start and not from the end of the last run, until it is killed
+int mysh_every(mysh_resource* shell, char** argv) {
+    double interval;
+    if (argv[1] == NULL || argv[2] == NULL || !mysh_parse_duration(argv[1], &interval) || interval <= 0.0) {
+        fprintf(stderr, "usage: every INTERVAL command [arg...]\n");
+        return 2;
+    }
+
+    mysh_job* job = mysh_new_argv_job(shell, argv, argv + 2);
+    mysh_timer* timer = mysh_new_job_timer(job, true);
+    if (timer == NULL) {
+        mysh_remove_job(shell, job);
+        return 1;
+    }
+
+    mysh_arm_timer(timer, interval, interval);
+    mysh_start_periodic_run(shell, job);
+
+    return 0;
+}
+
+#endif // MYSH_TIMER_H
@@ -11,23 +11,50 @@
 #include "mystring.h"
 #include "redirect.h"
 
+// words keep `$name` references unexpanded as MYSH_CTL_VAR name MYSH_CTL_VAR.
+// they are resolved by expand.h every time the command runs
+#define MYSH_CTL_VAR ('\x01')
+// `<(list)` and `>(list)` are kept as MYSH_CTL_PROCSUB '<' or '>' source MYSH_CTL_PROCSUB
+#define MYSH_CTL_PROCSUB ('\x02')
+// `$(list)` is kept as MYSH_CTL_CMDSUB source MYSH_CTL_CMDSUB
+#define MYSH_CTL_CMDSUB ('\x03')
+// quoted or escaped `*`, `?` and `[` are kept as MYSH_CTL_ESC char so that they are not globbed
+#define MYSH_CTL_ESC ('\x04')
+// `$((expr))` is kept as MYSH_CTL_ARITH expr MYSH_CTL_ARITH
+#define MYSH_CTL_ARITH ('\x05')
+
+static bool mysh_is_glob_char(char c) {
+	return c == '*' || c == '?' || c == '[';
+}
+
 typedef enum {
 	token_string,
 	token_background,
 	token_pipe,
-	token_redirect
+	token_and,
+	token_or,
+	token_redirect,
+	token_semicolon,
+	token_lparen,
+	token_rparen,
+	token_lbrace,
+	token_rbrace
 } mysh_token;
 
 typedef struct {
 	mysh_token token;
 	void* data;
+
+	// position in the input line, [begin, end)
+	int begin;
+	int end;
 } mysh_tokenized_component;
 
 void free_tokenized_component(mysh_tokenized_component* com) {
 	if (com == NULL)
 		return;
 	
-	if (com->token == token_string) {
+	if (com->token == token_string || com->token == token_lbrace || com->token == token_rbrace) {
 		ms_free(com->data);
 	}
 	if (com->token == token_background) {
@@ -119,17 +146,157 @@ static char mysh_cursor_get_escaped(mysh_cursor* cursor, bool ignore_last) {
 		return cursor->last_char;
 }
 
-static const char* mysh_expand_env(mysh_cursor* cursor) {
-	mysh_string* var_name = ms_new();
-	ms_init(var_name, "");
+static bool mysh_is_word_operator(char c) {
+	return c == '<' || c == '>' || c == '|' || c == '&' || c == ';' || c == '(' || c == ')';
+}
+
+// cursor->last_char is '('. appends the source up to the matching ')' to `s` and leaves the cursor on it
+static bool mysh_cursor_read_balanced(mysh_cursor* cursor, mysh_string* s) {
+	int depth = 1;
+	char quote = 0;
+
+	while (mysh_cursor_consume(cursor) != 0) {
+		char c = cursor->last_char;
+
+		if (c == '\\' && quote != '\'') {
+			ms_push(s, c);
+			if (mysh_cursor_consume(cursor) == 0) {
+				return false;
+			}
+			ms_push(s, cursor->last_char);
+			continue;
+		}
+
+		if (quote != 0) {
+			if (c == quote) {
+				quote = 0;
+			}
+		}
+		else if (c == '"' || c == '\'') {
+			quote = c;
+		}
+		else if (c == '(') {
+			++depth;
+		}
+		else if (c == ')' && --depth == 0) {
+			return true;
+		}
+
+		ms_push(s, c);
+	}
+
+	return false;
+}
 
+static int mysh_lex_skip_balanced(const char* line, int len, int i);
+
+// cursor->last_char is '$'. appends the reference to `s` without expanding it and leaves the cursor on its last char
+static bool mysh_tokenize_variable(mysh_cursor* cursor, mysh_string* s) {
 	char c = mysh_cursor_consume(cursor);
-	while (isalnum(c) || c == '_') {
-		ms_push(var_name, c);
-		c = mysh_cursor_consume(cursor);
+
+	if (c == '(') {
+		mysh_string body = { NULL, 0, 0, { 0 } };
+		ms_init(&body, "");
+		if (!mysh_cursor_read_balanced(cursor, &body)) {
+			fprintf(stderr, "mysh: syntax error: unterminated command substitution\n");
+			ms_relase(&body);
+			return false;
+		}
+
+		// `$((a) | b)` is still a command substitution
+		bool is_arith = (body.length >= 2 && body.ptr[0] == '(' && body.ptr[body.length - 1] == ')'
+			&& mysh_lex_skip_balanced(body.ptr, body.length, 0) == (int)body.length);
+		if (is_arith) {
+			ms_push(s, MYSH_CTL_ARITH);
+			ms_append_n(s, body.ptr + 1, body.length - 2);
+			ms_push(s, MYSH_CTL_ARITH);
+		}
+		else {
+			ms_push(s, MYSH_CTL_CMDSUB);
+			ms_append(s, &body);
+			ms_push(s, MYSH_CTL_CMDSUB);
+		}
+		ms_relase(&body);
+	}
+	else if (c == '{') {
+		ms_push(s, MYSH_CTL_VAR);
+		while (mysh_cursor_consume(cursor) != '}' && !mysh_cursor_isend(cursor)) {
+			ms_push(s, cursor->last_char);
+		}
+		ms_push(s, MYSH_CTL_VAR);
+	}
+	else if (isdigit(c) || c == '#' || c == '@' || c == '*' || c == '?' || c == '$') {
+		ms_push(s, MYSH_CTL_VAR);
+		ms_push(s, c);
+		ms_push(s, MYSH_CTL_VAR);
+	}
+	else if (isalpha(c) || c == '_') {
+		ms_push(s, MYSH_CTL_VAR);
+		while (isalnum(c) || c == '_') {
+			ms_push(s, c);
+			c = mysh_cursor_consume(cursor);
+		}
+		ms_push(s, MYSH_CTL_VAR);
+
+		mysh_cursor_rollback(cursor);
+	}
+	else {
+		ms_push(s, '$');
+		mysh_cursor_rollback(cursor);
+	}
+
+	return true;
+}
+
+// cursor->last_char is '<' or '>' followed by '('
+static bool mysh_tokenize_procsub(mysh_cursor* cursor, mysh_string* s) {
+	char dir = cursor->last_char;
+	mysh_cursor_consume(cursor);
+
+	ms_push(s, MYSH_CTL_PROCSUB);
+	ms_push(s, dir);
+	if (!mysh_cursor_read_balanced(cursor, s)) {
+		fprintf(stderr, "mysh: syntax error: unterminated process substitution\n");
+		return false;
 	}
+	ms_push(s, MYSH_CTL_PROCSUB);
 
-	return getenv(var_name->ptr);
+	return true;
+}
+
+static bool mysh_cursor_peek_paren(mysh_cursor* cursor) {
+	return cursor->last_char != 0 && cursor->input[cursor->pos] == '(';
+}
+
+// encodes `$` references of a here-document body the same way as words
+static void mysh_tokenize_heredoc(const char* body, mysh_string* out) {
+	mysh_cursor cursor;
+	cursor.last_char = -1;
+	cursor.input = (char*)body;
+	cursor.pos = 0;
+
+	ms_assign_raw(out, "");
+	while (mysh_cursor_consume(&cursor) != 0) {
+		char c = cursor.last_char;
+		if (c == '\\') {
+			if (mysh_cursor_consume(&cursor) == 0) {
+				ms_push(out, '\\');
+				break;
+			}
+			if (cursor.last_char != '$' && cursor.last_char != '\\') {
+				ms_push(out, '\\');
+			}
+			ms_push(out, cursor.last_char);
+		}
+		else if (c == '$') {
+			if (!mysh_tokenize_variable(&cursor, out)) {
+				break;
+			}
+		}
+		else {
+			ms_push(out, c);
+		}
+	}
 }
 
 static mysh_tokenized_component* mysh_tokenize_string(mysh_cursor* cursor) {
@@ -150,24 +317,44 @@ static mysh_tokenized_component* mysh_tokenize_string(mysh_cursor* cursor) {
 	bool is_quoted = cursor->last_char == '"' || cursor->last_char == '\'';
 	char quote = (cursor->last_char == '"' ? '"' : '\'');
 
+	ms_init(s, "");
+
 	char c = (is_quoted ? mysh_cursor_consume(cursor) : cursor->last_char);
 	while (!mysh_cursor_isend(cursor) && (is_quoted ? cursor->last_char != quote : !mysh_isdelim(c))) {
 		if (c == '\\') {
-			ms_push(s, mysh_cursor_get_escaped(cursor, false));
+			char escaped = mysh_cursor_get_escaped(cursor, false);
+			if (mysh_is_glob_char(escaped)) {
+				ms_push(s, MYSH_CTL_ESC);
+			}
+			ms_push(s, escaped);
 		}
-		else if (c == '$') {
-			const char *var = mysh_expand_env(cursor);
-			ms_append_raw(s, (var != NULL ? var : ""));
+		else if (c == '$' && !(is_quoted && quote == '\'')) {
+			if (!mysh_tokenize_variable(cursor, s)) {
+				ms_free(s);
+				free(ret);
+				return NULL;
+			}
 		}
-		else if (c == '<' || c == '>') {
+		else if (!is_quoted && (c == '<' || c == '>') && mysh_cursor_peek_paren(cursor)) {
+			if (!mysh_tokenize_procsub(cursor, s)) {
+				ms_free(s);
+				free(ret);
+				return NULL;
+			}
+		}
+		else if (!is_quoted && mysh_is_word_operator(c)) {
 			mysh_cursor_rollback(cursor);
 			break;
 		}
 		else if (!is_quoted && (c == '"' || c == '\'')) {
 			ms_free(s);
+			free(ret);
 			return NULL;
 		}
 		else {
+			if (is_quoted && mysh_is_glob_char(c)) {
+				ms_push(s, MYSH_CTL_ESC);
+			}
 			ms_push(s, c);
 		}
 
@@ -177,6 +364,24 @@ static mysh_tokenized_component* mysh_tokenize_string(mysh_cursor* cursor) {
 	ret->token = token_string;
 	ret->data = s;
 
+	// reserved words are only recognized unquoted; the parser turns them back into words outside of command position
+	if (!is_quoted && s->length == 1 && (s->ptr[0] == '{' || s->ptr[0] == '}')) {
+		ret->token = (s->ptr[0] == '{' ? token_lbrace : token_rbrace);
+	}
+
+	return ret;
+}
+
+static mysh_tokenized_component* mysh_tokenize_operator(mysh_cursor* cursor, mysh_token token) {
+	mysh_tokenized_component* ret = (mysh_tokenized_component*)malloc(sizeof(mysh_tokenized_component));
+	if (ret == NULL) {
+		fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+	}
+
+	ret->token = token;
+	ret->data = NULL;
+
 	return ret;
 }
 
@@ -194,6 +399,14 @@ static mysh_tokenized_component* mysh_tokenize_pipe(mysh_cursor* cursor) {
 	ret->token = token_pipe;
 	ret->data = NULL;
 
+	// `||`
+	if (mysh_cursor_consume(cursor) == '|') {
+		ret->token = token_or;
+	}
+	else {
+		mysh_cursor_rollback(cursor);
+	}
+
 	return ret;
 }
 
@@ -207,6 +420,14 @@ static mysh_tokenized_component* mysh_tokenize_background(mysh_cursor* cursor) {
 	ret->token = token_background;
 	ret->data = NULL;
 
+	// `&&`
+	if (mysh_cursor_consume(cursor) == '&') {
+		ret->token = token_and;
+	}
+	else {
+		mysh_cursor_rollback(cursor);
+	}
+
 	return ret;
 }
 
@@ -242,12 +463,19 @@ static mysh_tokenized_component* mysh_tokenize_redirect(mysh_cursor* cursor) {
 					tfd += cursor->last_char - '0';
 				}
 
+				mysh_cursor_rollback(cursor);
+
 				if (tfd == -1) {
 					return NULL;
 				}
 				if (ffd == -1) {
 					ffd = 1;
 				}
+
+				// `N>&M` duplicates M onto N
+				int src = tfd;
+				tfd = ffd;
+				ffd = src;
 			}
 			else {
 				kind = redirect_out;
@@ -257,7 +485,19 @@ static mysh_tokenized_component* mysh_tokenize_redirect(mysh_cursor* cursor) {
 			}
 			break;
 		case '<':
-			kind = redirect_in;
+			if (mysh_cursor_consume(cursor) == '<') {
+				kind = (mysh_cursor_consume(cursor) == '<' ? redirect_herestring : redirect_heredoc);
+				if (kind == redirect_heredoc) {
+					mysh_cursor_rollback(cursor);
+				}
+
+				tfd = ffd;
+				ffd = -1;
+			}
+			else {
+				kind = redirect_in;
+				mysh_cursor_rollback(cursor);
+			}
 			break;
 		default:
 			return NULL;
@@ -306,6 +546,8 @@ static mysh_tokenized_component** mysh_tokenize(char* line, int* written_size) {
 			break;
 		}
 
+		int begin = cursor.pos - 1;
+
 		mysh_tokenized_component* com;
 		if (c == '|') {
 			com = mysh_tokenize_pipe(&cursor);
@@ -313,6 +555,15 @@ static mysh_tokenized_component** mysh_tokenize(char* line, int* written_size) {
 		else if (c == '&') {
 			com = mysh_tokenize_background(&cursor);
 		}
+		else if (c == ';') {
+			com = mysh_tokenize_operator(&cursor, token_semicolon);
+		}
+		else if (c == '(') {
+			com = mysh_tokenize_operator(&cursor, token_lparen);
+		}
+		else if (c == ')') {
+			com = mysh_tokenize_operator(&cursor, token_rparen);
+		}
 		else if (isdigit(c)) {
 			int pos = cursor.pos;
 			com = mysh_tokenize_redirect(&cursor);
@@ -322,6 +573,9 @@ static mysh_tokenized_component** mysh_tokenize(char* line, int* written_size) {
 				com = mysh_tokenize_string(&cursor);
 			}
 		}
+		else if ((c == '<' || c == '>') && mysh_cursor_peek_paren(&cursor)) {
+			com = mysh_tokenize_string(&cursor);
+		}
 		else if (c == '<' || c == '>') {
 			com = mysh_tokenize_redirect(&cursor);
 		}
@@ -333,10 +587,17 @@ static mysh_tokenized_component** mysh_tokenize(char* line, int* written_size) {
 			for (int i = 0; i < size; ++i) {
 				free_tokenized_component(components[i]);
 			}
+			free(components);
 
 			return NULL;
 		}
 
+		com->begin = begin;
+		com->end = cursor.pos;
+		if (com->end > begin + 1 && (line[com->end - 1] == '\0' || line[com->end - 1] == EOF || mysh_isdelim(line[com->end - 1]))) {
+			--com->end;
+		}
+
 		if (capacity < size + 1) {
 			capacity *= 2;
 			components = (mysh_tokenized_component**)realloc(components, sizeof(void*) * capacity);
@@ -350,4 +611,193 @@ static mysh_tokenized_component** mysh_tokenize(char* line, int* written_size) {
 	return components;
 }
 
+// lexer for highlighting. it does not allocate or report errors and lexes one token at a time,
+// so that a caller can keep the tokens of a line and re-lex only from where it was edited.
+// a token depends on nothing but the text from its beginning and the state before it
+
+typedef enum {
+	lexeme_word,
+	lexeme_command,
+	lexeme_assign,
+	lexeme_operator,
+	lexeme_redirect
+} mysh_lexeme_kind;
+
+typedef struct {
+	// the next word is a command name
+	bool is_command;
+	// the next word is the target of a redirect
+	bool is_target;
+} mysh_lex_state;
+
+typedef struct {
+	mysh_lexeme_kind kind;
+	int begin;
+	int end;
+	// quotes somewhere in the word
+	bool is_quoted;
+	// `$`, a quote or a backslash, so what runs is only known after expansion
+	bool is_dynamic;
+} mysh_lexeme;
+
+static bool mysh_lex_state_equal(mysh_lex_state a, mysh_lex_state b) {
+	return a.is_command == b.is_command && a.is_target == b.is_target;
+}
+
+// line[i] is '('. returns the position after the matching ')', or `len` if there is none
+static int mysh_lex_skip_balanced(const char* line, int len, int i) {
+	int depth = 0;
+	char quote = 0;
+
+	for (; i < len; ++i) {
+		char c = line[i];
+		if (c == '\\' && quote != '\'') {
+			++i;
+		}
+		else if (quote != 0) {
+			quote = (c == quote ? 0 : quote);
+		}
+		else if (c == '"' || c == '\'') {
+			quote = c;
+		}
+		else if (c == '(') {
+			++depth;
+		}
+		else if (c == ')' && --depth == 0) {
+			return i + 1;
+		}
+	}
+
+	return len;
+}
+
+// returns the end of a redirect operator at `i`, or -1 if there is none
+static int mysh_lex_redirect(const char* line, int len, int i, bool* has_target) {
+	while (i < len && isdigit(line[i])) {
+		++i;
+	}
+	if (i == len || (line[i] != '<' && line[i] != '>') || (i + 1 < len && line[i + 1] == '(')) {
+		return -1;
+	}
+
+	*has_target = true;
+	char c = line[i++];
+	if (c == '>' && i < len && line[i] == '&') {
+		// `N>&M` has no word after it
+		for (++i; i < len && isdigit(line[i]); ++i) {
+			*has_target = false;
+		}
+	}
+	else {
+		for (int n = (c == '<' ? 2 : 1); n > 0 && i < len && line[i] == c; --n) {
+			++i;
+		}
+	}
+
+	return i;
+}
+
+static bool mysh_lex_is_assign(const char* word, int len) {
+	if (len == 0 || !(isalpha(word[0]) || word[0] == '_')) {
+		return false;
+	}
+
+	for (int i = 1; i < len; ++i) {
+		if (word[i] == '=') {
+			return true;
+		}
+		if (!(isalnum(word[i]) || word[i] == '_')) {
+			return false;
+		}
+	}
+
+	return false;
+}
+
+// lexes the token at or after `*pos` and moves `*pos` past it. returns false at the end of the line
+static bool mysh_lex_next(const char* line, int len, int* pos, mysh_lex_state* state, mysh_lexeme* out) {
+	int i = *pos;
+	while (i < len && mysh_isdelim(line[i])) {
+		++i;
+	}
+	if (i == len) {
+		*pos = len;
+		return false;
+	}
+
+	out->begin = i;
+	out->is_quoted = false;
+	out->is_dynamic = false;
+
+	char c = line[i];
+	bool has_target;
+	int end;
+	if (c == '|' || c == '&' || c == ';' || c == '(' || c == ')') {
+		end = i + 1 + ((c == '|' || c == '&') && i + 1 < len && line[i + 1] == c);
+		out->kind = lexeme_operator;
+		state->is_command = (c != ')');
+		state->is_target = false;
+	}
+	else if ((end = mysh_lex_redirect(line, len, i, &has_target)) >= 0) {
+		out->kind = lexeme_redirect;
+		state->is_target = has_target;
+	}
+	else {
+		for (end = i; end < len && !mysh_isdelim(line[end]); ) {
+			char d = line[end];
+			if ((d == '<' || d == '>') && end + 1 < len && line[end + 1] == '(') {
+				end = mysh_lex_skip_balanced(line, len, end + 1);
+				out->is_dynamic = true;
+			}
+			else if (mysh_is_word_operator(d)) {
+				break;
+			}
+			else if (d == '\\') {
+				end += 2;
+				out->is_dynamic = true;
+			}
+			else if (d == '"' || d == '\'') {
+				// an unterminated quote runs to the end of the line
+				for (++end; end < len && line[end] != d; ++end) {
+					end += (d == '"' && line[end] == '\\');
+				}
+				++end;
+				out->is_quoted = true;
+				out->is_dynamic = true;
+			}
+			else if (d == '$' && end + 1 < len && line[end + 1] == '(') {
+				end = mysh_lex_skip_balanced(line, len, end + 1);
+				out->is_dynamic = true;
+			}
+			else {
+				out->is_dynamic |= (d == '$');
+				++end;
+			}
+		}
+		end = (end < len ? end : len);
+
+		int word_len = end - i;
+		out->kind = lexeme_word;
+		if (state->is_target) {
+			state->is_target = false;
+		}
+		else if (state->is_command && word_len == 1 && (c == '{' || c == '}')) {
+			out->kind = lexeme_operator;
+			state->is_command = (c == '{');
+		}
+		else if (state->is_command && mysh_lex_is_assign(line + i, word_len)) {
+			out->kind = lexeme_assign;
+		}
+		else if (state->is_command) {
+			out->kind = lexeme_command;
+			state->is_command = false;
+		}
+	}
+
+	out->end = end;
+	*pos = end;
+
+	return true;
+}
+
 #endif // MYSH_TOKENIZER_H
\ No newline at end of file
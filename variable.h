@@ -0,0 +1,181 @@
+#ifndef MYSH_VARIABLE_H
+#define MYSH_VARIABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "mystring.h"
+
+#define MYSH_VAR_BUCKETS (32)
+
+typedef struct mysh_variable_tag {
+    struct mysh_variable_tag* next;
+    char* name;
+    mysh_string value;
+} mysh_variable;
+
+// a scope is pushed for every function call and temporary assignment.
+// lookup walks the parent chain, so variables are dynamically scoped like in other shells.
+typedef struct mysh_scope_tag {
+    struct mysh_scope_tag* parent;
+    mysh_variable* buckets[MYSH_VAR_BUCKETS];
+
+    // positional parameters, argv[0] is $0. NULL if the scope doesn't own them
+    char** argv;
+    int argc;
+} mysh_scope;
+
+static uint32_t mysh_hash_name(const char* name) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p != '\0'; ++p) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static bool mysh_is_var_name(const char* name, size_t len) {
+    if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return false;
+    }
+
+    for (size_t i = 1; i < len; ++i) {
+        if (!(isalnum((unsigned char)name[i]) || name[i] == '_')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static mysh_scope* mysh_new_scope(mysh_scope* parent, int argc, char** argv) {
+    mysh_scope* scope = (mysh_scope*)calloc(1, sizeof(mysh_scope));
+    if (scope == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    scope->parent = parent;
+    if (argv != NULL) {
+        scope->argv = (char**)malloc(sizeof(char*) * (argc + 1));
+        if (scope->argv == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < argc; ++i) {
+            scope->argv[i] = strdup(argv[i]);
+        }
+        scope->argv[argc] = NULL;
+        scope->argc = argc;
+    }
+
+    return scope;
+}
+
+// releases the scope and returns its parent
+static mysh_scope* mysh_release_scope(mysh_scope* scope) {
+    assert(scope != NULL);
+
+    for (int i = 0; i < MYSH_VAR_BUCKETS; ++i) {
+        mysh_variable* var = scope->buckets[i];
+        while (var != NULL) {
+            mysh_variable* next = var->next;
+            free(var->name);
+            ms_relase(&var->value);
+            free(var);
+            var = next;
+        }
+    }
+
+    for (int i = 0; i < scope->argc; ++i) {
+        free(scope->argv[i]);
+    }
+    free(scope->argv);
+
+    mysh_scope* parent = scope->parent;
+    free(scope);
+
+    return parent;
+}
+
+static mysh_variable* mysh_scope_find(mysh_scope* scope, const char* name) {
+    uint32_t h = mysh_hash_name(name) % MYSH_VAR_BUCKETS;
+    for (mysh_variable* var = scope->buckets[h]; var != NULL; var = var->next) {
+        if (strcmp(var->name, name) == 0) {
+            return var;
+        }
+    }
+
+    return NULL;
+}
+
+static void mysh_set_local_var(mysh_scope* scope, const char* name, const char* value) {
+    assert(scope != NULL && name != NULL && value != NULL);
+
+    mysh_variable* var = mysh_scope_find(scope, name);
+    if (var == NULL) {
+        var = (mysh_variable*)malloc(sizeof(mysh_variable));
+        if (var == NULL) {
+            fprintf(stderr, "mysh: error occurred in allocation.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        uint32_t h = mysh_hash_name(name) % MYSH_VAR_BUCKETS;
+        var->name = strdup(name);
+        var->value.ptr = NULL;
+        var->next = scope->buckets[h];
+        scope->buckets[h] = var;
+    }
+
+    ms_assign_raw(&var->value, value);
+}
+
+// assigns to the innermost scope which already has `name`, or to the global scope
+static void mysh_set_var(mysh_scope* scope, const char* name, const char* value) {
+    assert(scope != NULL);
+
+    mysh_scope* target = scope;
+    for (mysh_scope* s = scope; s != NULL; s = s->parent) {
+        if (mysh_scope_find(s, name) != NULL) {
+            target = s;
+            break;
+        }
+
+        target = s;
+    }
+
+    mysh_set_local_var(target, name, value);
+}
+
+// shell variables shadow the environment
+static const char* mysh_lookup_var(mysh_scope* scope, const char* name) {
+    for (mysh_scope* s = scope; s != NULL; s = s->parent) {
+        mysh_variable* var = mysh_scope_find(s, name);
+        if (var != NULL) {
+            return var->value.ptr;
+        }
+    }
+
+    return getenv(name);
+}
+
+// the scope which holds the current positional parameters
+static mysh_scope* mysh_positional_scope(mysh_scope* scope) {
+    for (mysh_scope* s = scope; s != NULL; s = s->parent) {
+        if (s->argv != NULL) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+#endif // MYSH_VARIABLE_H
@@ -0,0 +1,475 @@
+#ifndef MYSH_ZYGOTE_H
+#define MYSH_ZYGOTE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "mystring.h"
+#include "redirect.h"
+#include "shell_resource.h"
+#include "process.h"
+#include "function.h"
+#include "builtins.h"
+
+extern char** environ;
+
+// the zygote is mysh itself re-executed with `--zygote FD`, so it has none of the memory of the shell.
+// it forks external commands for the shell with CLONE_PARENT, which makes them children of the shell,
+// so waitpid() and job control work as if the shell had forked them
+
+// cwd, stdin, stdout and stderr come first
+#define MYSH_ZYGOTE_FIXED_FDS (4)
+// below SCM_MAX_FD
+#define MYSH_ZYGOTE_MAX_FDS (250)
+
+typedef struct {
+    uint32_t argc;
+    uint32_t num_assigns;
+    uint32_t envc;
+    uint32_t num_redirects;
+    uint32_t data_length;
+    uint32_t umask;
+    // -1 without job control
+    int32_t group_id;
+    uint32_t is_foreground;
+    // 0 in the group of the shell, see mysh_exec_process()
+    uint32_t may_stop;
+    // the last fd is the cgroup to start the process in, see cgroup.h
+    uint32_t has_cgroup;
+} mysh_zygote_request;
+
+#ifndef CLONE_INTO_CGROUP
+#define CLONE_INTO_CGROUP (0x200000000ULL)
+#endif
+
+// struct clone_args of <linux/sched.h>, which does not get along with <sched.h>
+typedef struct {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+    uint64_t set_tid;
+    uint64_t set_tid_size;
+    uint64_t cgroup;
+} mysh_clone_args;
+
+static struct {
+    int fd;
+    pid_t pid;
+    // the process which started the zygote; its children must not talk to it
+    pid_t owner;
+} mysh_zygote = { -1, 0, 0 };
+
+static bool mysh_send_fds(int sock, const void* data, size_t len, const int* fds, int num_fds) {
+    struct iovec iov = { (void*)data, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MYSH_ZYGOTE_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+
+    // the rest goes without fds
+    return n >= 0 && mysh_write_all(sock, (const char*)data + n, len - n);
+}
+
+static bool mysh_read_exact(int fd, void* data, size_t len) {
+    char* p = (char*)data;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+
+        p += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+// receives `len` bytes and the fds attached to them, which are close-on-exec
+static bool mysh_recv_fds(int sock, void* data, size_t len, int* fds, int* num_fds) {
+    struct iovec iov = { data, len };
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * MYSH_ZYGOTE_MAX_FDS)];
+        struct cmsghdr align;
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return false;
+    }
+
+    *num_fds = 0;
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds + *num_fds, CMSG_DATA(cmsg), sizeof(int) * count);
+            *num_fds += count;
+        }
+    }
+
+    return mysh_read_exact(sock, (char*)data + n, len - n);
+}
+
+// ---- the zygote process ----
+
+// runs in the new process; never returns
+static void mysh_zygote_exec(const mysh_zygote_request* req, char* data, int* fds, int tty_fd) {
+    char** argv = (char**)malloc(sizeof(char*) * (req->argc + 1));
+    char** envp = (char**)malloc(sizeof(char*) * (req->envc + 1));
+    if (argv == NULL || envp == NULL) {
+        fprintf(stderr, "mysh: error occurred in allocation.\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    char* p = data;
+    for (uint32_t i = 0; i < req->argc; ++i) {
+        argv[i] = p;
+        p += strlen(p) + 1;
+    }
+    argv[req->argc] = NULL;
+    for (uint32_t i = 0; i < req->envc; ++i) {
+        envp[i] = p;
+        p += strlen(p) + 1;
+    }
+    envp[req->envc] = NULL;
+
+    if (req->group_id >= 0) {
+        pid_t group_id = (req->group_id == 0 ? getpid() : req->group_id);
+        setpgid(0, group_id);
+        if (req->is_foreground && tty_fd >= 0) {
+            tcsetpgrp(tty_fd, group_id);
+        }
+    }
+
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, (req->may_stop ? SIG_DFL : SIG_IGN));
+    signal(SIGTTIN, (req->may_stop ? SIG_DFL : SIG_IGN));
+    signal(SIGTTOU, (req->may_stop ? SIG_DFL : SIG_IGN));
+    signal(SIGCHLD, SIG_DFL);
+
+    if (fchdir(fds[0]) < 0) {
+        perror("mysh: failed to change directory");
+        _exit(EXIT_FAILURE);
+    }
+    umask(req->umask);
+
+    for (int i = 0; i < 3; ++i) {
+        if (dup2(fds[1 + i], i) < 0) {
+            perror("mysh: failed to duplicate FD");
+            _exit(EXIT_FAILURE);
+        }
+    }
+
+    // each redirect is its target and either the fd number to duplicate or -1 for the next passed fd
+    int next_fd = MYSH_ZYGOTE_FIXED_FDS;
+    for (uint32_t i = 0; i < req->num_redirects; ++i) {
+        int32_t pair[2];
+        memcpy(pair, p, sizeof(pair));
+        p += sizeof(pair);
+
+        int from = (pair[1] >= 0 ? pair[1] : fds[next_fd++]);
+        dup2(from, pair[0]);
+    }
+
+    environ = envp;
+    for (uint32_t i = 0; i < req->num_assigns; ++i) {
+        char* eq = strchr(argv[i], '=');
+        *eq = '\0';
+        setenv(argv[i], eq + 1, 1);
+        *eq = '=';
+    }
+
+    execvp(argv[req->num_assigns], argv + req->num_assigns);
+    perror("mysh: failed to call execvp()");
+    _exit(EXIT_FAILURE);
+}
+
+// `mysh --zygote FD`: serves launch requests on FD until the shell closes it
+static int mysh_zygote_main(int sock) {
+    fcntl(sock, F_SETFD, FD_CLOEXEC);
+
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+
+    int tty_fd = (isatty(STDIN_FILENO) ? fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10) : -1);
+
+    int fds[MYSH_ZYGOTE_MAX_FDS];
+    mysh_zygote_request req;
+    char* data = NULL;
+    size_t capacity = 0;
+
+    while (true) {
+        int num_fds = 0;
+        if (!mysh_recv_fds(sock, &req, sizeof(req), fds, &num_fds)) {
+            break;
+        }
+
+        if (req.data_length + 1 > capacity) {
+            capacity = req.data_length + 1;
+            data = (char*)realloc(data, capacity);
+            if (data == NULL) {
+                fprintf(stderr, "mysh: error occurred in allocation.\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        bool ok = mysh_read_exact(sock, data, req.data_length);
+        if (!ok) {
+            break;
+        }
+
+        int32_t reply;
+        if (num_fds < MYSH_ZYGOTE_FIXED_FDS) {
+            reply = -EINVAL;
+        }
+        else {
+            // the new process becomes a child of the shell, not ours.
+            // it starts in the cgroup of its job, so nothing it forks can escape
+            pid_t pid = -1;
+            if (req.has_cgroup && num_fds > MYSH_ZYGOTE_FIXED_FDS) {
+                mysh_clone_args args;
+                memset(&args, 0, sizeof(args));
+                args.flags = CLONE_PARENT | CLONE_INTO_CGROUP;
+                args.exit_signal = SIGCHLD;
+                args.cgroup = fds[num_fds - 1];
+                pid = (pid_t)syscall(SYS_clone3, &args, sizeof(args));
+            }
+            if (pid < 0) {
+                pid = (pid_t)syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+            }
+            if (pid == 0) {
+                close(sock);
+                mysh_zygote_exec(&req, data, fds, tty_fd);
+            }
+
+            reply = (pid < 0 ? -errno : pid);
+        }
+
+        for (int i = 0; i < num_fds; ++i) {
+            close(fds[i]);
+        }
+
+        if (!mysh_write_all(sock, (const char*)&reply, sizeof(reply))) {
+            break;
+        }
+    }
+
+    free(data);
+    return 0;
+}
+
+// ---- the shell side ----
+
+static void mysh_stop_zygote() {
+    if (mysh_zygote.fd < 0) {
+        return;
+    }
+
+    // the zygote exits on EOF, and is reaped here so that no job wait takes its pid
+    close(mysh_zygote.fd);
+    if (mysh_zygote.owner == getpid()) {
+        while (waitpid(mysh_zygote.pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+    mysh_zygote.fd = -1;
+    mysh_zygote.pid = 0;
+}
+
+static bool mysh_start_zygote() {
+    if (mysh_zygote.fd >= 0) {
+        return true;
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        perror("mysh: zygote: failed to create socket");
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("mysh: zygote: failed to fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // exec right away so that the zygote doesn't keep a copy of our memory
+        dup2(fds[1], 3);
+        execl("/proc/self/exe", "mysh", "--zygote", "3", (char*)NULL);
+        _exit(EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    mysh_zygote.fd = fds[0];
+    mysh_zygote.pid = pid;
+    mysh_zygote.owner = getpid();
+
+    return true;
+}
+
+// launches `proc` through the zygote. returns the pid, or -1 if `proc` has to be forked by the caller
+pid_t mysh_zygote_spawn(mysh_resource* shell, mysh_process* proc, pid_t group_id, int cgroup_fd, int in_fd, int out_fd, int err_fd, bool is_foreground) {
+    if (mysh_zygote.fd < 0 || mysh_zygote.owner != getpid()) {
+        return -1;
+    }
+
+    // functions, builtins and commands using process substitutions need the shell
+    if (proc->kind != process_simple || proc->argc == proc->num_assigns || proc->num_subst_fds > 0
+        || proc->num_redirects > MYSH_ZYGOTE_MAX_FDS - MYSH_ZYGOTE_FIXED_FDS - 1) {
+        return -1;
+    }
+
+    const char* name = proc->argv[proc->num_assigns];
+    if (!proc->is_external && (mysh_find_function(shell, name) != NULL || mysh_find_builtin(name) != NULL)) {
+        return -1;
+    }
+
+    int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd_fd < 0) {
+        return -1;
+    }
+
+    mysh_zygote_request req;
+    memset(&req, 0, sizeof(req));
+    req.argc = proc->argc;
+    req.num_assigns = proc->num_assigns;
+    req.num_redirects = proc->num_redirects;
+    req.group_id = (shell->is_interactive ? group_id : -1);
+    req.is_foreground = is_foreground;
+    req.may_stop = (!shell->is_interactive || group_id != shell->group_id);
+
+    mode_t mask = umask(0);
+    umask(mask);
+    req.umask = mask;
+
+    mysh_string data = { NULL, 0, 0, { 0 } };
+    ms_init(&data, "");
+
+    int fds[MYSH_ZYGOTE_MAX_FDS] = { cwd_fd, in_fd, out_fd, err_fd };
+    int num_fds = MYSH_ZYGOTE_FIXED_FDS;
+
+    for (int i = 0; i < proc->argc; ++i) {
+        ms_append_raw(&data, proc->argv[i]);
+        ms_push(&data, '\0');
+    }
+    for (char** env = environ; *env != NULL; ++env) {
+        ms_append_raw(&data, *env);
+        ms_push(&data, '\0');
+        ++req.envc;
+    }
+    for (int i = 0; i < proc->num_redirects; ++i) {
+        mysh_redirect_data* red = &proc->redirects[i];
+        int32_t pair[2] = { red->tfd, -1 };
+        if (red->kind == redirect_fd) {
+            pair[1] = red->ffd;
+        }
+        else {
+            fds[num_fds++] = red->ffd;
+        }
+
+        ms_append_n(&data, (const char*)pair, sizeof(pair));
+    }
+    req.data_length = data.length;
+
+    if (cgroup_fd >= 0) {
+        req.has_cgroup = true;
+        fds[num_fds++] = cgroup_fd;
+    }
+
+    int32_t reply = -1;
+    bool ok = mysh_send_fds(mysh_zygote.fd, &req, sizeof(req), fds, num_fds)
+        && mysh_write_all(mysh_zygote.fd, data.ptr, data.length)
+        && mysh_read_exact(mysh_zygote.fd, &reply, sizeof(reply));
+
+    close(cwd_fd);
+    ms_relase(&data);
+
+    if (!ok) {
+        fprintf(stderr, "mysh: zygote: lost, forking commands again\n");
+        mysh_stop_zygote();
+        return -1;
+    }
+
+    return (reply > 0 ? (pid_t)reply : -1);
+}
+
+// zygote [on|off]
+int mysh_zygote_builtin(mysh_resource* shell, char** argv) {
+    if (argv[1] == NULL) {
+        if (mysh_zygote.fd >= 0) {
+            printf("zygote: on (pid %d)\n", (int)mysh_zygote.pid);
+        }
+        else {
+            printf("zygote: off\n");
+        }
+        return 0;
+    }
+
+    if (strcmp(argv[1], "on") == 0) {
+        return mysh_start_zygote() ? 0 : 1;
+    }
+    if (strcmp(argv[1], "off") == 0) {
+        mysh_stop_zygote();
+        return 0;
+    }
+
+    fprintf(stderr, "usage: zygote [on|off]\n");
+    return 2;
+}
+
+#endif // MYSH_ZYGOTE_H